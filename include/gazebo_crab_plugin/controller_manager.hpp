@@ -0,0 +1,80 @@
+#ifndef GAZEBO_CRAB_PLUGIN_CONTROLLER_MANAGER_HPP
+#define GAZEBO_CRAB_PLUGIN_CONTROLLER_MANAGER_HPP
+
+// GAZEBO headers
+#include <gazebo/common/common.hh>
+
+// project headers
+#include "worker_pool.hpp"
+
+// C++ headers
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+
+
+
+
+namespace gazebo {
+	
+	
+	class ModelPIDJoint;
+	
+	
+	/** @brief updates the controllers of all crab models of a world in one world update callback.
+	 *
+	 * without a manager every ModelPIDJoint connects its own world update callback. the manager is created by the world
+	 * plugin (WorldCrabControllers); the models that are loaded afterwards attach to it instead of connecting their own
+	 * callback. every update is one batched pass over all models in three sweeps:
+	 *   - prepareUpdate of all models: parameters, resets, reading the joints (gazebo, serial)
+	 *   - computeUpdate of all models: setpoints, pid, watchdog, episodes, telemetry (on the worker pool, if any)
+	 *   - finishUpdate of all models: applying the forces (gazebo, serial, after all models are computed)
+	 *
+	 * the models are independent, so computeUpdate runs in parallel with one task per model (setThreads()). the
+	 * gazebo calls stay on the update thread.
+	 *
+	 * the managers are registered by world name, so that the model plugin finds the manager of its world.
+	 */
+	class ControllerManager {
+		public:
+			/// @brief creates and registers the manager of a world (replaces an earlier manager of the same world)
+			static std::shared_ptr< ControllerManager > create( const std::string &world );
+			
+			/// @brief the manager of a world, or an empty pointer if the world has no manager
+			static std::shared_ptr< ControllerManager > find( const std::string &world );
+			
+			/// @brief adds a model to the batched update (from now on the model must not update itself)
+			void attach( ModelPIDJoint *model );
+			
+			/// @brief removes a model from the batched update (the model is destroyed)
+			void detach( ModelPIDJoint *model );
+			
+			/** @brief starts 'threads' workers for computeUpdate in addition to the update thread (0: serial). the workers
+			 *         spin for 'spin' microseconds after a tick before they block
+			 */
+			void setThreads( int threads, int spin );
+			
+			/// @brief updates all attached models. called by the world update callback of the world plugin
+			void update( const common::UpdateInfo &info );
+			
+			/// @brief number of attached models
+			int size();
+			
+		private:
+			/// @brief task of the worker pool: computeUpdate of model 'index'
+			static void computeTask( void *context, int index );
+			
+			/// @brief the attached models, in the order they were attached
+			std::vector< ModelPIDJoint* > models_;
+			
+			/// @brief serializes attach/detach (model loading and removal) and the update
+			std::mutex mutex_;
+			
+			/// @brief workers for computeUpdate
+			WorkerPool pool_;
+	};
+	
+} // end of namespace
+
+#endif
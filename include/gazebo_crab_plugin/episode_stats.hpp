@@ -0,0 +1,65 @@
+#ifndef GAZEBO_CRAB_PLUGIN_EPISODE_STATS_HPP
+#define GAZEBO_CRAB_PLUGIN_EPISODE_STATS_HPP
+
+// C++ headers
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+
+
+
+
+namespace gazebo {
+
+
+	/** @brief running error accumulators of every joint for the current episode.
+	 *
+	 * an episode of a joint starts with start() (at load and whenever the joint is reset) and ends with the next reset.
+	 * after a warm-up window (seconds of simulation time) every tick adds the squared velocity and angle error to the sums
+	 * and updates the maximum errors, so the optimizer gets one summary per episode instead of one message per tick.
+	 *
+	 * the accumulators are only touched by the physics thread. a summary can be requested from any thread (request()),
+	 * the physics thread picks the request up with takeRequest().
+	 */
+	class EpisodeStats {
+		public:
+			EpisodeStats() : joints_(0), warmup_(0.0), request_(false) {};
+
+			/// @brief allocates the accumulators. 'warmup' is the time at the start of an episode that is not accumulated
+			void configure( int joints, double warmup );
+
+			/// @brief the warm-up window (seconds)
+			double warmup() const { return warmup_; }
+
+			/// @brief starts a new episode of joint 'j' at simulation time 'now' (clears the accumulators)
+			void start( int j, double now );
+
+			/// @brief adds the errors of all joints after their warm-up window. the arrays are the engine arrays
+			void accumulate( double now, const double *desired, const double *angle, const double *velocity,
+				const double *desired_velocity );
+
+			/// @brief requests a summary of the running episodes. any thread
+			void request() { request_.store( true, std::memory_order_release ); }
+
+			/// @brief returns and clears a pending summary request. physics thread
+			bool takeRequest() { return request_.load( std::memory_order_relaxed ) && request_.exchange( false, std::memory_order_acquire ); }
+
+			// accumulators, one entry per joint
+
+			std::vector< double > start_;				// simulation time of the start of the episode
+			std::vector< double > warm_until_;			// errors before this time are not accumulated
+			std::vector< uint32_t > count_;				// number of accumulated ticks
+			std::vector< double > velocity_sq_sum_;		// sum of the squared velocity errors
+			std::vector< double > angle_sq_sum_;		// sum of the squared angle errors
+			std::vector< double > velocity_max_;		// maximum absolute velocity error
+			std::vector< double > angle_max_;			// maximum absolute angle error
+
+		private:
+			int joints_;
+			double warmup_;
+			std::atomic< bool > request_;
+	};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef GAZEBO_CRAB_PLUGIN_EXCITATION_HPP
+#define GAZEBO_CRAB_PLUGIN_EXCITATION_HPP
+
+// C++ headers
+#include <vector>
+#include <string>
+#include <atomic>
+#include <stdint.h>
+
+
+
+
+namespace gazebo {
+
+
+	/// @brief parameters of the excitation signal of one joint (see ExcitationGenerator)
+	struct ExcitationSignal {
+		ExcitationSignal() : type(0), offset(0.0), amplitude(0.0), f0(0.1), f1(1.0), duration(0.0), hold(1.0), seed(0),
+			repeat(false) {};
+
+		int type;						// ExcitationGenerator::OFF, STEPS, CHIRP, PRBS or SWEEP
+		double offset;					// center angle (radians)
+		double amplitude;				// radians
+		double f0;						// chirp/sweep: start frequency (Hz)
+		double f1;						// chirp/sweep: end frequency (Hz)
+		double duration;				// length of one pass (seconds). 0: endless (steps, prbs)
+		double hold;					// steps/prbs: hold time of a level (seconds)
+		std::vector< double > levels;	// steps: levels relative to offset, cycled. empty: random levels in [-amplitude, amplitude]
+		uint32_t seed;					// random seed (steps, prbs). 0: the seed of the model
+		bool repeat;					// start over after 'duration'
+	};
+
+
+	/** @brief per-joint excitation signals (steps, chirp, prbs, sine sweep) that replace the desired angle of the joint,
+	 *         so that tuning runs do not need an external node that streams setpoints.
+	 *
+	 * the signals are a function of the time since the signal was (re)started, the random signals are generated from
+	 * the seed of the joint: the seed of the model combined with the joint name (or the seed of the signal). so every
+	 * model with the same configuration sees the same reference signal, and restart() (called on a model reset) starts
+	 * the same signal again.
+	 *
+	 * new signals are handed over from the ros callbacks with set() (one pointer exchange per joint, like ParamHandoff)
+	 * and picked up by the physics thread in update(). the replaced signal is retired and freed by the next set(), so the
+	 * physics thread does not call the allocator.
+	 */
+	class ExcitationGenerator {
+		public:
+			/// @brief signal types
+			enum {
+				OFF = 0,
+				STEPS = 1,		// random (or given) levels, each held for 'hold' seconds
+				CHIRP = 2,		// sine with a linear frequency sweep from f0 to f1 over 'duration'
+				PRBS = 3,		// pseudo random binary sequence (offset +- amplitude), one bit per 'hold' seconds
+				SWEEP = 4		// sine with a logarithmic frequency sweep from f0 to f1 over 'duration'
+			};
+
+			ExcitationGenerator() : joints_(0), seed_(1), version_(0), applied_version_(0), pending_(NULL), retired_(NULL),
+				active_count_(0), restart_(false) {};
+			~ExcitationGenerator();
+
+			/// @brief allocates the state for the joints (engine order). 'seed' is the seed of the model
+			void configure( const std::vector< std::string > &names, uint32_t seed );
+
+			/// @brief returns the signal type for a name ("off", "steps", "chirp", "prbs", "sweep"), -1 if unknown
+			static int parseType( const std::string &name );
+
+			/// @brief returns a description of the first invalid parameter of 'signal', or NULL if the signal is valid
+			static const char* check( const ExcitationSignal &signal );
+
+			/// @brief sets the signal of joint 'j', starting at the next update. writer side (ros callbacks, Load())
+			void set( int j, const ExcitationSignal &signal );
+
+			/// @brief starts all signals from the beginning at the next update. physics thread
+			void restart() { restart_ = true; }
+
+			/// @brief picks up new signals and writes the desired angle of all joints with a signal. physics thread
+			void update( double now, double *desired );
+
+			/// @brief returns true if at least one joint has a signal. physics thread
+			bool active() const { return active_count_ > 0; }
+
+		private:
+			ExcitationGenerator( const ExcitationGenerator& );
+			ExcitationGenerator& operator=( const ExcitationGenerator& );
+
+			/// @brief state of the signal of one joint (physics thread)
+			struct State {
+				ExcitationSignal *signal;	// NULL or type OFF: no signal
+				double start;				// simulation time of the start, < 0: start at the next update, inf: ended
+				int64_t step;				// steps/prbs: index of the current level
+				double level;				// steps/prbs: current level (relative to offset)
+				uint64_t random;			// steps: state of the random generator
+				uint32_t lfsr;				// prbs: state of the shift register
+			};
+
+			/// @brief starts the signal of joint 'j' at time 'now'
+			void start( int j, double now );
+
+			/// @brief value of the signal of joint 'j' (relative to the offset) at time 't' after the start
+			double sample( int j, double t );
+
+			/// @brief random seed of joint 'j' for 'signal'
+			uint64_t jointSeed( int j, const ExcitationSignal &signal ) const;
+
+			int joints_;
+
+			/// @brief seed of the model
+			uint32_t seed_;
+
+			/// @brief hash of every joint name (part of the joint seed)
+			std::vector< uint64_t > name_hash_;
+
+			/// @brief incremented by every set(), so that update() only looks at the joints after a change
+			std::atomic< unsigned int > version_;
+			unsigned int applied_version_;
+
+			/// @brief newest signal of every joint that was not picked up yet (NULL if there is none)
+			std::atomic< ExcitationSignal* > *pending_;
+			
+			/// @brief signal of every joint that was replaced by the physics thread, freed by the next set() (or NULL)
+			std::atomic< ExcitationSignal* > *retired_;
+
+			std::vector< State > state_;
+			int active_count_;
+			bool restart_;
+	};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef GAZEBO_CRAB_PLUGIN_GAIN_SCHEDULE_HPP
+#define GAZEBO_CRAB_PLUGIN_GAIN_SCHEDULE_HPP
+
+// project headers
+#include "pid_kernel.hpp"
+
+// C++ headers
+#include <vector>
+#include <atomic>
+#include <stddef.h>
+
+
+
+
+namespace gazebo {
+
+
+	/** @brief gain schedule of one joint: pid gains at the points of a 1-D or 2-D grid over the joint angle and the
+	 *         desired velocity (see GainScheduler). all vectors empty: no schedule (the fixed gains of the joint)
+	 */
+	struct GainTable {
+		std::vector< double > angle;		// breakpoints of the joint angle (radians, ascending). empty: not keyed on the angle
+		std::vector< double > velocity;		// breakpoints of the desired velocity (rad/s, ascending). empty: not keyed on it
+		std::vector< double > p_gain;		// gains at the grid points, angle-major: [a * max(1, velocity.size()) + v]
+		std::vector< double > i_gain;
+		std::vector< double > d_gain;
+	};
+
+
+	/** @brief per-joint gain scheduling: the p, i and d gains of a joint are interpolated (bilinear, linear for a 1-D
+	 *         table) from its GainTable at the current joint angle and desired velocity on every tick. outside of the
+	 *         breakpoints the gains of the outermost points hold, a NaN or infinite key counts as 0.
+	 *
+	 * the desired velocity is the one of the velocity input (damping * angle error / dt, limited to max_velocity), also
+	 * for joints with position input. a scheduled joint gets its gains only from the table, the gains of its parameter
+	 * sets are overwritten on every tick (until the schedule is removed).
+	 *
+	 * new tables are handed over from the ros callbacks with set() (one pointer exchange per joint, like
+	 * ExcitationGenerator) and picked up by the physics thread in update(). the replaced table is retired and freed by
+	 * the next set(), so the physics thread does not call the allocator.
+	 *
+	 * the lookup keeps the grid cell of every joint as a bilinear polynomial (its bounds and four coefficients per
+	 * gain), structure of arrays in joint order like the engine (pid_kernel::GainCells). while the angle and the velocity
+	 * stay in the cell (the common case, they move little between ticks) a tick evaluates the polynomials of all joints
+	 * of a range in one vectorized pass without branches (pid_kernel::scheduleGains()): a joint without a schedule has an
+	 * unbounded cell and keeps its gains by a mask, a range without scheduled joints is skipped. the joints that left their cell are looked up again in a second pass
+	 * (only the groups of joints that the first pass reported): it searches the table from the last cell and computes
+	 * the polynomial of the new one.
+	 */
+	class GainScheduler {
+		public:
+			/// @brief maximum number of breakpoints per axis
+			static const int MAX_POINTS = 64;
+
+			GainScheduler() : joints_(0), version_(0), applied_version_(0), pending_(NULL), retired_(NULL), active_count_(0) {};
+			~GainScheduler();
+
+			/// @brief allocates the state for the joints (engine order)
+			void configure( int joints );
+
+			/// @brief returns a description of the first invalid part of 'table', or NULL if the table is valid
+			static const char* check( const GainTable &table );
+
+			/// @brief sets the schedule of joint 'j' (an empty table removes it), used from the next tick. writer side
+			void set( int j, const GainTable &table );
+
+			/// @brief picks up new tables. physics thread
+			void update();
+
+			/// @brief returns true if at least one joint has a schedule. physics thread
+			bool active() const { return active_count_ > 0; }
+
+			/** @brief writes the scheduled gains of the joints [begin, end) that have a table into 'p_gain', 'i_gain' and
+			 *         'd_gain' (the arrays of 'b') and recomputes their gain coefficients of the discrete form (c_p, c_i,
+			 *         c_d). dt of the joints in seconds. physics thread
+			 */
+			void apply( const PidBatch &b, double dt, int begin, int end, double *p_gain, double *i_gain, double *d_gain );
+
+		private:
+			GainScheduler( const GainScheduler& );
+			GainScheduler& operator=( const GainScheduler& );
+
+			/** @brief a table: angle breakpoints (n_angle), velocity breakpoints (n_velocity), then the grid (max(1,n_angle)
+			 *         * max(1,n_velocity) points of p, i, d). 'data' is empty for a removed schedule
+			 */
+			struct Schedule {
+				int n_angle;
+				int n_velocity;
+				std::vector< double > data;
+			};
+
+			/// @brief schedule of one joint, only used when the joint leaves its cell (physics thread)
+			struct State {
+				Schedule *schedule;		// NULL or empty: no schedule
+				int angle_index;		// interval of the last cell
+				int velocity_index;
+			};
+
+			/// @brief finds the cell of joint 'j' around 'angle' and 'velocity' (finite) and computes its polynomials
+			void locate( int j, double angle, double velocity );
+
+			/// @brief sets the cell of joint 'j' to no valid cell (NaN bounds, located by the next lookup) or to an unbounded one
+			void resetCell( int j, bool scheduled );
+
+			int joints_;
+
+			/// @brief incremented by every set(), so that update() only looks at the joints after a change
+			std::atomic< unsigned int > version_;
+			unsigned int applied_version_;
+
+			/// @brief newest table of every joint that was not picked up yet (NULL if there is none)
+			std::atomic< Schedule* > *pending_;
+
+			/// @brief table of every joint that was replaced by the physics thread, freed by the next set() (or NULL)
+			std::atomic< Schedule* > *retired_;
+
+			/** @brief the cell of the grid around the last angle and velocity of every joint (see pid_kernel::GainCells):
+			 *         bounds infinite beyond the outermost breakpoints, NaN if there is no valid cell. read on every tick
+			 */
+			std::vector< double > angle_lo_, angle_hi_;
+			std::vector< double > velocity_lo_, velocity_hi_;
+			std::vector< double > p_k_[4], i_k_[4], d_k_[4];
+			std::vector< double > scheduled_;		// 1.0 if the joint has a (non-empty) schedule
+			std::vector< int > scheduled_before_;	// number of scheduled joints before every joint, joints+1 entries
+			pid_kernel::GainCells cells_;			// pointers to the arrays above
+			std::vector< int > outside_;			// groups of joints outside of their cell (see pid_kernel::scheduleGains())
+			std::vector< State > state_;
+			int active_count_;
+	};
+
+} // end of namespace
+
+#endif
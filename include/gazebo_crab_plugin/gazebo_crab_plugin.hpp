@@ -2,8 +2,10 @@
 #include <ros/ros.h>
 #include <std_msgs/Float64.h>
 #include <std_msgs/String.h>
+#include <std_msgs/Empty.h>
 #include <dynamic_reconfigure/server.h>
 #include <gazebo_crab_plugin/dyn_paramsConfig.h>		// auto-generated, based on ../cfg/dyn_params.cfg
+#include <gazebo_crab_plugin/telemetry_paramsConfig.h>	// auto-generated, based on ../cfg/telemetry_params.cfg
 
 // header, as sugested in http://wiki.gazebosim.org/wiki/Tutorials/1.9/Creating_ROS_plugins_for_Gazebo
 //#include <gazebo/common/Plugin.hh>
@@ -18,9 +20,29 @@
 #include <gazebo_crab_plugin/pid_joint_state.h>		// auto-generated by the project, based on msg/pid_joint_state.msg
 #include <gazebo_crab_plugin/pid_joint_param.h>		// auto-generated by the project, based on msg/pid_joint_param.msg
 #include <gazebo_crab_plugin/pid_joint_error.h>		// auto-generated by the project, based on msg/pid_joint_param.msg
+#include <gazebo_crab_plugin/joint_trajectory.h>		// auto-generated by the project, based on msg/joint_trajectory.msg
+#include <gazebo_crab_plugin/excitation_param.h>		// auto-generated by the project, based on msg/excitation_param.msg
+#include <gazebo_crab_plugin/latency_stats.h>		// auto-generated by the project, based on msg/latency_stats.msg
+#include <gazebo_crab_plugin/gain_schedule.h>		// auto-generated by the project, based on msg/gain_schedule.msg
+
+// project headers
+#include "joint_engine.hpp"
+#include "gazebo_joint_access.hpp"
+#include "telemetry.hpp"
+#include "joint_log.hpp"
+#include "joint_config.hpp"
+#include "trajectory.hpp"
+#include "excitation.hpp"
+#include "episode_stats.hpp"
+#include "watchdog.hpp"
+#include "latency_profiler.hpp"
+#include "gain_schedule.hpp"
+#include "controller_manager.hpp"
 
 // C++ headers
 #include <stdio.h>
+#include <map>
+#include <mutex>
 
 // BOOST headers
 #include <boost/bind.hpp>
@@ -43,22 +65,131 @@ namespace gazebo {
 	class ModelPIDJoint : public ModelPlugin {
 		
 		public:
+			/// @brief the scalar members are set here, Load() may return early (e.g. if ros is not initialized)
+			ModelPIDJoint() : nh_(NULL), log_to_file_(false), telemetry_reconf_server_(NULL), tick_(0),
+				reset_model_on_params_(true), per_joint_topics_(true), watchdog_enabled_(false), profiler_(NULL),
+				episode_count_(0), update_now_(0.0), update_dt_(0.0), tick_ns_(0), fixed_step_(false), fixed_dt_(0.0) {};
+			
+			/// @brief detaches the model from the controller manager of the world (if any)
+			~ModelPIDJoint();
+			
 			/// @brief called when the plugin is loaded. initializes the object
 			void Load( physics::ModelPtr parent, sdf::ElementPtr sdf );
 
 			/// @brief called by the world update start event. in this function we update the state of all joints
-			void OnUpdate( const common::UpdateInfo &/*_info*/ );
+			void OnUpdate( const common::UpdateInfo &info );
+			
+			/** @brief first part of an update: controller clock, parameters, resets and reading the joints. OnUpdate (or
+			 *         the controller manager of the world) calls prepareUpdate, computeUpdate and finishUpdate in this order
+			 */
+			void prepareUpdate( const common::UpdateInfo &info );
+			
+			/** @brief second part of an update: setpoints, pid, watchdog, episodes, telemetry and log. no gazebo calls,
+			 *         may run in parallel with the computeUpdate of other models
+			 */
+			void computeUpdate();
+			
+			/// @brief last part of an update: applying the new forces
+			void finishUpdate();
 			
 			/// @brief getter function to get a pointer to the node handle
 			ros::NodeHandle* getNH() { return nh_; }
 			
+			/// @brief getter function to get a pointer to the joint controller engine
+			JointEngine* getEngine() { return &engine_; }
+			
+			/// @brief adds a joint to the engine and the joint access (same index in both) and returns its index
+			int addJoint( physics::Joint *joint, ParamHandoff *handoff ) {
+				joint_access_.addJoint( joint );
+				return engine_.addJoint( handoff );
+			}
+			
+			/// @brief getter function to get a pointer to the telemetry publisher
+			TelemetryPublisher* getTelemetry() { return &telemetry_; }
+			
+			/// @brief getter function to get a pointer to the joint log writer
+			JointLogWriter* getLog() { return &log_; }
+			
+			/// @brief returns true if the joints write log files (sdf: logToFile, default false)
+			bool logToFile() const { return log_to_file_; }
+			
+			/// @brief returns true if the per-joint telemetry topics (<joint>_pid_state, <joint>_errors) are enabled
+			bool perJointTopics() const { return per_joint_topics_; }
+			
 			void resetModel() {
 				ROS_INFO( "resetting model" );
 				model_->Reset();
 			}
 			
+			/// @brief returns true if the dynamic reconfigure server of a joint is created at startup (sdf: dynReconfigure)
+			bool reconfigureAtStartup( const std::string &joint ) const;
+			
+			/** @brief reset flags (ParamHandoff) for a joint whose parameters were set: the joint and, unless disabled in the
+			 *         sdf (resetModelOnParams), the whole model
+			 */
+			int resetFlags() const {
+				return ParamHandoff::RESET_JOINT | (reset_model_on_params_ ? ParamHandoff::RESET_MODEL : 0);
+			}
+			
 			
 		private:
+			/// @brief creates the dynamic reconfigure server of the joint in the message (or of all joints for "all" or "")
+			void subReconfigureCallback( const std_msgs::String::ConstPtr &msg );
+			
+			/// @brief hands the waypoints of a trajectory message over to the physics thread (see JointTrajectories)
+			void trajectoryCallback( const gazebo_crab_plugin::joint_trajectory::ConstPtr &msg );
+			
+			/// @brief sets the excitation signal of the joint in the message (or of all joints for "")
+			void excitationCallback( const gazebo_crab_plugin::excitation_param::ConstPtr &msg );
+			
+			/// @brief sets the gain schedule of the joint in the message (or of all joints for ""). empty tables remove it
+			void gainScheduleCallback( const gazebo_crab_plugin::gain_schedule::ConstPtr &msg );
+			
+			/// @brief publishes the latency percentiles of the last period (timer of the ros thread)
+			void latencyTimerCallback( const ros::WallTimerEvent &event );
+			
+			/// @brief publishes (and prints) the latency percentiles since the start (latency_dump)
+			void latencyDumpCallback( const std_msgs::Empty::ConstPtr &msg );
+			
+			/// @brief publishes the latency percentiles of all phases, since the start or since the last periodic report
+			void publishLatency( bool cumulative );
+			
+			/// @brief reads the watchdog thresholds from the sdf (element 'watchdog')
+			void loadWatchdog();
+			
+			/// @brief checks the joints with the watchdog and resets the joints that failed
+			void checkWatchdog( double now, double dt );
+			
+			/// @brief reads the excitation signals from the sdf (element 'excitation')
+			void loadExcitation();
+			
+			/// @brief reads the gain schedules (parameter 'gain_schedules' or sdf element 'gainSchedules')
+			void loadGainSchedules();
+			
+			/// @brief requests a summary of the running episodes (episode_summary_request)
+			void episodeRequestCallback( const std_msgs::Empty::ConstPtr &msg );
+			
+			/** @brief hands the episode records of all joints ('all') or of the joints with a pending reset (reason 0: the
+			 *         episodes end, 1: requested, 2: the watchdog failed a joint) over to the telemetry thread. returns the
+			 *         end record of the summary, the caller pushes it (with the reset report for a reset)
+			 */
+			EpisodeRecord pushEpisodes( double now, int reason, bool all );
+			
+			/// @brief applies the pending resets: the model once (if requested), then every joint that requested a reset
+			void applyResets();
+			
+			/// @brief copies the state of all joints with subscribed telemetry topics into the telemetry ring
+			void pushTelemetry( double stamp );
+			
+			/// @brief copies the state of all joints with an open log file into the log ring
+			void pushLog( const ros::Time &stamp );
+			
+			/// @brief reads the telemetry rates from the sdf and creates the telemetry dynamic reconfigure server
+			void loadTelemetryRates();
+			
+			/// @brief dynamic reconfigure callback for the telemetry rates
+			void telemetryCallback( gazebo_crab_plugin::telemetry_paramsConfig &config, uint32_t level );
+			
 			/// @brief pointer to the model
 			physics::ModelPtr model_;
 			
@@ -68,12 +199,125 @@ namespace gazebo {
 			/// @brief ros node handle
 			ros::NodeHandle *nh_;
 			
-			/// @brief pointer to the update event connection
+			/// @brief pointer to the update event connection (empty if the controller manager of the world updates the model)
 			event::ConnectionPtr update_connection_;
 			
+			/// @brief the controller manager of the world that updates the model (sdf: batchUpdate), empty if none
+			std::shared_ptr< ControllerManager > manager_;
+			
 			/// @brief list (vector) of PidJoint objects. we create one PidJoint object for every joint
 			std::vector< PidJoint* > pid_joint_vec_;
 			
+			/// @brief batched controller for all joints of the model (hot data)
+			JointEngine engine_;
+			
+			/// @brief the gazebo joints of the engine
+			GazeboJointAccess joint_access_;
+			
+			/// @brief publishes the joint state/error topics from its own thread (cold data)
+			TelemetryPublisher telemetry_;
+			
+			/// @brief writes the binary joint logs from its own thread (cold data)
+			JointLogWriter log_;
+			
+			/// @brief if true, the joints write log files (sdf: logToFile, logDirectory, logFileSize, logQueueSize)
+			bool log_to_file_;
+			
+			/// @brief dynamic reconfigure server for the telemetry rates (namespace telemetry_dyn)
+			dynamic_reconfigure::Server<gazebo_crab_plugin::telemetry_paramsConfig> *telemetry_reconf_server_;
+			
+			/// @brief number of updates since the plugin was loaded (used for the telemetry decimation)
+			uint64_t tick_;
+			
+			/// @brief joints whose dynamic reconfigure server is created at startup ("all" for every joint)
+			std::vector< std::string > reconfigure_joints_;
+			
+			/// @brief subscriber for creating dynamic reconfigure servers on demand (enable_dyn_reconfigure)
+			ros::Subscriber sub_reconfigure_;
+			
+			/// @brief if false, new joint parameters only reset the joint, not the whole model (sdf: resetModelOnParams, default true)
+			bool reset_model_on_params_;
+			
+			/// @brief if true, every joint advertises its own state and error topic (sdf: perJointTopics, default true)
+			bool per_joint_topics_;
+			
+			/// @brief time-stamped waypoints of the joints, interpolated on every tick (sdf: trajectoryBufferSize)
+			JointTrajectories trajectories_;
+			
+			/// @brief subscriber for the trajectories (joint_trajectory)
+			ros::Subscriber sub_trajectory_;
+			
+			/// @brief serializes the writer side of trajectories_
+			std::mutex trajectory_mutex_;
+			
+			/// @brief excitation signals that replace the desired angles (sdf: excitation, topic: excitation)
+			ExcitationGenerator excitation_;
+			
+			/// @brief subscriber for the excitation signals (excitation)
+			ros::Subscriber sub_excitation_;
+			
+			/// @brief gain schedules of the joints, interpolated by the engine (parameter: gain_schedules, topic: gain_schedule)
+			GainScheduler gain_scheduler_;
+			
+			/// @brief subscriber for the gain schedules (gain_schedule)
+			ros::Subscriber sub_gain_schedule_;
+			
+			/// @brief error accumulators of the current episode of every joint (sdf: episodeWarmup)
+			EpisodeStats episodes_;
+			
+			/// @brief aborts episodes of unstable joints (sdf: watchdog)
+			DivergenceWatchdog watchdog_;
+			
+			/// @brief true if the sdf has a 'watchdog' element
+			bool watchdog_enabled_;
+			
+			/// @brief latency histograms of the update phases (sdf: latencyStats, latencyPeriod). NULL if disabled
+			LatencyProfiler *profiler_;
+			
+			/// @brief histogram counts at the last periodic latency report
+			std::vector< uint64_t > latency_last_[LatencyProfiler::N_PHASES];
+			
+			/// @brief time of the last periodic latency report
+			ros::WallTime latency_last_time_;
+			
+			/// @brief serializes the latency reports
+			std::mutex latency_mutex_;
+			
+			/// @brief publishes the latency reports (latency_stats)
+			ros::Publisher latency_pub_;
+			
+			/// @brief subscriber for latency dumps (latency_dump)
+			ros::Subscriber sub_latency_dump_;
+			
+			/// @brief timer of the periodic latency reports
+			ros::WallTimer latency_timer_;
+			
+			/// @brief number of episode summaries (published by the telemetry thread, topic episode_summary)
+			uint32_t episode_count_;
+			
+			/// @brief subscriber for summary requests (episode_summary_request)
+			ros::Subscriber sub_episode_request_;
+			
+			/// @brief engine index of every controlled joint, by name
+			std::map< std::string, int > joint_index_;
+			
+			/// @brief simulation time of the last update
+			common::Time time_last_update_;
+			
+			/// @brief simulation time, time stamp and dt of the current update (set by prepareUpdate)
+			double update_now_;
+			ros::Time update_stamp_;
+			double update_dt_;
+			
+			/// @brief profiler: time of the current update so far (ns)
+			int64_t tick_ns_;
+			
+			/// @brief if true, every update uses fixed_dt_ instead of the simulation time difference (sdf: fixedStep)
+			bool fixed_step_;
+			
+			/// @brief dt of the fixed-step mode (sdf: fixedStepSize, default: physics step size)
+			double fixed_dt_;
+			
 	};
 	
 } // end of namespace
@@ -0,0 +1,54 @@
+#ifndef GAZEBO_CRAB_PLUGIN_GAZEBO_CRAB_WORLD_PLUGIN_HPP
+#define GAZEBO_CRAB_PLUGIN_GAZEBO_CRAB_WORLD_PLUGIN_HPP
+
+// GAZEBO headers
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+#include <gazebo/common/common.hh>
+
+// project headers
+#include "controller_manager.hpp"
+
+// BOOST headers
+#include <boost/bind.hpp>
+
+
+
+
+namespace gazebo {
+	
+	
+	/** @brief optional world plugin: updates the controllers of all crab models (ModelPIDJoint) of the world in one world
+	 *         update callback (see ControllerManager).
+	 *
+	 * the plugin has to be loaded before the models (world plugins in the world file are). models that are spawned later
+	 * attach as well, models with <batchUpdate>false</batchUpdate> keep their own callback.
+	 *
+	 *   <plugin name="crab_controllers" filename="libgazebo_crab_world_plugin.so">
+	 *     <threads>0</threads>          worker threads for the controllers, in addition to the update thread (default 0)
+	 *     <workerSpin>50</workerSpin>   microseconds the workers spin after a tick before they block (default 50)
+	 *   </plugin>
+	 */
+	class WorldCrabControllers : public WorldPlugin {
+		
+		public:
+			/// @brief called when the plugin is loaded. creates the controller manager of the world
+			void Load( physics::WorldPtr world, sdf::ElementPtr sdf );
+			
+			/// @brief called by the world update start event. updates all attached models
+			void OnUpdate( const common::UpdateInfo &info );
+			
+		private:
+			/// @brief pointer to the world
+			physics::WorldPtr world_;
+			
+			/// @brief the controllers of the models of the world
+			std::shared_ptr< ControllerManager > manager_;
+			
+			/// @brief pointer to the update event connection
+			event::ConnectionPtr update_connection_;
+	};
+	
+} // end of namespace
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef GAZEBO_CRAB_PLUGIN_GAZEBO_JOINT_ACCESS_HPP
+#define GAZEBO_CRAB_PLUGIN_GAZEBO_JOINT_ACCESS_HPP
+
+// GAZEBO headers
+#include <gazebo/physics/physics.hh>
+
+// project headers
+#include "joint_access.hpp"
+
+// C++ headers
+#include <vector>
+
+
+
+
+namespace gazebo {
+
+
+	/// @brief JointAccess for gazebo joints. assumes rotary joints with a single axis
+	class GazeboJointAccess : public JointAccess {
+		public:
+			/// @brief adds a joint and returns its index (has to match the index of the joint in the engine)
+			int addJoint( physics::Joint *joint ) {
+				joints_.push_back( joint );
+				return joints_.size() - 1;
+			}
+
+			virtual void readAngles( double *angle );
+			virtual bool readVelocities( double *velocity );
+			virtual void writeForces( const double *force );
+			virtual void resetJoint( int index );
+
+		private:
+			/// @brief the joints that we are manipulating
+			std::vector< physics::Joint* > joints_;
+	};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef GAZEBO_CRAB_PLUGIN_JOINT_ACCESS_HPP
+#define GAZEBO_CRAB_PLUGIN_JOINT_ACCESS_HPP
+
+
+
+
+namespace gazebo {
+
+
+	/** @brief access to the simulated (or fake) joints of a JointEngine, so that the controller core does not depend on
+	 *         gazebo. the joints are addressed by their engine index.
+	 *
+	 * the functions work on all joints at once (one virtual call per tick, not per joint). the plugin implements them with
+	 * gazebo joints (GazeboJointAccess), the benchmark with a simple joint model.
+	 */
+	class JointAccess {
+		public:
+			virtual ~JointAccess() {};
+
+			/// @brief writes the current angle of every joint (radians) into 'angle'
+			virtual void readAngles( double *angle ) = 0;
+
+			/** @brief writes the velocity of every joint (rad/s) as computed by the physics engine into 'velocity'. returns
+			 *         false if the joints have no such velocity (the default)
+			 */
+			virtual bool readVelocities( double * /*velocity*/ ) { return false; }
+
+			/// @brief applies 'force' to every joint
+			virtual void writeForces( const double *force ) = 0;
+
+			/// @brief resets joint 'index' in the simulation (angle & velocity 0)
+			virtual void resetJoint( int index ) = 0;
+	};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef GAZEBO_CRAB_PLUGIN_JOINT_CONFIG_HPP
+#define GAZEBO_CRAB_PLUGIN_JOINT_CONFIG_HPP
+
+// ROS headers
+#include <ros/ros.h>
+
+// GAZEBO headers
+#include <sdf/sdf.hh>
+
+// project headers
+#include "param_handoff.hpp"
+#include "gain_schedule.hpp"
+
+// C++ headers
+#include <string>
+#include <vector>
+
+
+
+
+namespace gazebo {
+
+
+	/// @brief a joint that is controlled by the plugin, with its initial parameters
+	struct JointConfig {
+		std::string name;
+		JointParams params;
+	};
+
+
+	/// @brief the gain schedule of a joint
+	struct GainScheduleConfig {
+		std::string name;
+		GainTable table;
+	};
+
+
+	/** @brief reads the list of controlled joints.
+	 *
+	 * the list is read from the parameter 'controlled_joints' (typically loaded from a yaml file with <rosparam>) or, if
+	 * that does not exist, from the sdf element 'controlledJoints'. both have one entry per joint, the keys are the same:
+	 *
+	 *   yaml:                                  sdf:
+	 *     controlled_joints:                     <controlledJoints>
+	 *       leg_1_joint_3:                         <joint name="leg_1_joint_3">
+	 *         p: 0.275515                            <p>0.275515</p>
+	 *         max_force: 5.0                         <max_force>5.0</max_force>
+	 *                                              </joint>
+	 *                                            </controlledJoints>
+	 *
+	 * keys: desired, p, i, d, i_max, i_min, multiplier, max_velocity, damping, max_force, input_type (0=position,
+	 * 1=velocity), update_type (0=directForce, 1=deltaForce), pid_form (0=classic, 1=discrete), anti_windup (0=clamping,
+	 * 1=back-calculation, 2=conditional integration), d_filter, tracking_time, velocity_estimator (0=tick difference,
+	 * 1=finite difference, 2=fir, 3=alpha-beta, 4=joint velocity), velocity_taps, velocity_alpha, rate_divider (the
+	 * joint is computed every n-th physics step, give the joints of a group the same divider). missing keys keep the
+	 * defaults of JointParams.
+	 *
+	 * @return false if neither the parameter nor the sdf element exists (all joints are controlled in that case)
+	 */
+	bool readJointConfigs( const ros::NodeHandle &nh, sdf::ElementPtr sdf, std::vector< JointConfig > &configs );
+
+	/** @brief reads the gain schedules of the joints (see GainScheduler).
+	 *
+	 * the schedules are read from the parameter 'gain_schedules' (typically loaded from a yaml file with <rosparam>) or,
+	 * if that does not exist, from the sdf element 'gainSchedules'. the keys are the fields of msg/gain_schedule.msg,
+	 * lists in the sdf are separated by spaces. the gains are angle-major (one row of velocities per angle):
+	 *
+	 *   yaml:                                  sdf:
+	 *     gain_schedules:                        <gainSchedules>
+	 *       leg_1_joint_2:                         <joint name="leg_1_joint_2">
+	 *         angle: [-0.5, 0.0, 0.5]                <angle>-0.5 0.0 0.5</angle>
+	 *         p_gain: [0.3, 0.25, 0.2]               <p_gain>0.3 0.25 0.2</p_gain>
+	 *         i_gain: [0.0, 0.0, 0.0]                <i_gain>0 0 0</i_gain>
+	 *         d_gain: [0.01, 0.01, 0.02]             <d_gain>0.01 0.01 0.02</d_gain>
+	 *                                              </joint>
+	 *                                            </gainSchedules>
+	 *
+	 * the tables are not checked (GainScheduler::check()).
+	 */
+	void readGainSchedules( const ros::NodeHandle &nh, sdf::ElementPtr sdf, std::vector< GainScheduleConfig > &configs );
+
+} // end of namespace
+
+#endif
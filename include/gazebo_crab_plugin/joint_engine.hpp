@@ -0,0 +1,268 @@
+#ifndef GAZEBO_CRAB_PLUGIN_JOINT_ENGINE_HPP
+#define GAZEBO_CRAB_PLUGIN_JOINT_ENGINE_HPP
+
+// project headers
+#include "pid_kernel.hpp"
+#include "param_handoff.hpp"
+#include "joint_access.hpp"
+#include "latency_profiler.hpp"
+#include "velocity_estimator.hpp"
+#include "gain_schedule.hpp"
+
+// C++ headers
+#include <vector>
+#include <atomic>
+
+
+
+
+namespace gazebo {
+
+
+	/** @brief batched PID controller for all controlled joints of one model.
+	 *
+	 * the per-joint state that is touched on every tick (setpoint, angle history, pid integrator, gains, force) is stored
+	 * in contiguous arrays (structure of arrays), indexed by the joint index returned by addJoint(). a single call to
+	 * update() runs the controller for every joint of the model. ros handles, the dynamic reconfigure server and the log
+	 * files are not part of the engine, they are kept in the (cold) PidJoint objects.
+	 *
+	 * @note the default pid math is the same as in control_toolbox::Pid::computeCommand( error, dt ) (derivative from
+	 *       the last error, integral term clamped to [i_min, i_max]), so the gains keep their meaning. joints with
+	 *       pid_form 1 use the discrete form with precomputed coefficients, a filtered derivative and anti-windup (see
+	 *       pid_kernel.hpp). the math itself is done by the (vectorized) pid_kernel, with one specialized kernel per run
+	 *       of joints that share the same modes.
+	 *
+	 * @note every joint can run at a lower rate (rate_divider_: every 2nd, 4th, ... tick, with the time since its last
+	 *       update as dt). the engine keeps a schedule with one list of runs per tick of the period (the largest
+	 *       divider) and spreads the sub-rate joints over the ticks, in chunks that keep a leg together, so that every
+	 *       tick computes about the same number of joints. the angles, the velocity estimates and the applied forces are
+	 *       updated on every tick (a sub-rate joint holds its force).
+	 *
+	 * @note with a GainScheduler (see setGainScheduler()) the gains of the scheduled joints are looked up right before
+	 *       the kernel computes them (blocks of SCHEDULE_BLOCK joints of a run), at the rate of the joint.
+	 *
+	 * @note the arrays are only touched by the physics update thread. parameters from the ros callbacks arrive through
+	 *       the ParamHandoff of each joint and are copied into the arrays by applyParams() at the start of a tick.
+	 *
+	 * @note the engine does not depend on gazebo or ros (library crab_controller_core). the joints are read and written
+	 *       through a JointAccess (see setAccess()).
+	 */
+	class JointEngine {
+		public:
+			/// @brief largest rate divider of a joint (power of two), the length of the schedule
+			static const int MAX_RATE_DIVIDER = 16;
+
+			/// @brief number of consecutive joints with the same divider that are scheduled on the same tick (a leg, one avx2 group)
+			static const int SCHEDULE_CHUNK = 4;
+
+			JointEngine() : access_(NULL), profiler_(NULL), scheduler_(NULL), size_(0), param_version_(0), applied_version_(0), regroup_(false), reset_joints_(0),
+				reset_model_(false), reset_time_(0), joint_velocity_joints_(0), period_(1), tick_(0), time_(0.0) {
+				for( int n=0; n<=MAX_RATE_DIVIDER; n++ )
+					phase_begin_[n] = 0;
+			};
+
+			/// @brief sets the joints that the engine reads and writes. the joints have the indices returned by addJoint()
+			void setAccess( JointAccess *access ) { access_ = access; }
+
+			/// @brief measures the phases read, compute and write of update() (NULL: no measurement)
+			void setProfiler( LatencyProfiler *profiler ) { profiler_ = profiler; }
+
+			/// @brief interpolates the gains of the scheduled joints on every tick (NULL: the fixed gains). configured for size() joints
+			void setGainScheduler( GainScheduler *scheduler ) { scheduler_ = scheduler; }
+
+			/** @brief adds a joint to the engine and returns its index. the controller values are set to the defaults.
+			 *         new parameters for the joint are read from 'handoff' (see applyParams())
+			 */
+			int addJoint( ParamHandoff *handoff );
+
+			/// @brief change counter for the ParamHandoff objects of this engine
+			std::atomic<unsigned int>* paramVersion() { return &param_version_; }
+
+			/// @brief copies new parameter sets and requests from the ParamHandoff objects into the arrays. never blocks
+			void applyParams();
+
+			/// @brief number of joints in the engine
+			int size() const { return size_; }
+
+			/// @brief sets the pid gains of a joint. same argument order as control_toolbox::Pid::setGains()
+			void setGains( int index, double p, double i, double d, double i_max, double i_min );
+
+			/// @brief returns the pid gains of a joint. same argument order as control_toolbox::Pid::getGains()
+			void getGains( int index, double &p, double &i, double &d, double &i_max, double &i_min ) const;
+
+			/// @brief resets the pid state (integrator and errors) of a joint
+			void resetPid( int index );
+
+			/// @brief resets the joint in the simulation (angle & velocity) and all controller values that depend on it
+			void resetJoint( int index );
+
+			/// @brief requests a reset of a joint (and the model if 'model' is set) before the next update. physics thread
+			void requestReset( int index, bool model );
+
+			/// @brief returns true if a joint (reset_) or the whole model has to be reset before the next update
+			bool resetPending() const { return reset_model_  ||  reset_joints_ > 0; }
+
+			/// @brief returns true if a joint requested a reset of the whole model
+			bool resetModelPending() const { return reset_model_; }
+
+			/** @brief clears the model reset request and returns the time of the oldest pending reset request (steady
+			 *         clock in ns, see ParamHandoff::now(), 0 if unknown). the joints are cleared by resetJoint()
+			 */
+			int64_t takeResetRequest();
+
+			/// @brief runs the controller for all joints: reads the angles, computes the new forces and applies them. dt in seconds
+			void update( double dt ) {
+				read( dt );
+				compute( dt );
+				write();
+			}
+			
+			/// @brief first step of update(): reads the angles of all joints (JointAccess) and estimates the velocities. dt in seconds
+			void read( double dt );
+			
+			/// @brief second step of update(): computes the new forces of all joints. only touches the engine arrays
+			void compute( double dt );
+			
+			/// @brief last step of update(): applies the new forces (JointAccess)
+			void write();
+			
+			/// @brief returns pointers to the engine arrays for the pid kernel. invalidated by addJoint()
+			PidBatch batch();
+
+			/// @brief the rate divider of a parameter set: the largest power of two <= 'divider', 1..MAX_RATE_DIVIDER
+			static int rateDivider( int divider );
+
+			/// @brief number of joints that are computed on tick 'phase' of the schedule (after the next update if a mode changed)
+			int scheduledJoints( int phase ) const;
+
+
+			// hot per-joint state, one entry per joint
+
+			std::vector< double > desired_;				// the desired joint state (angle, radians)
+			std::vector< double > angle_;				// the current angle of the joint
+			std::vector< double > velocity_;			// current joint velocity, unit depends on the estimator (see velocity_estimator)
+			std::vector< double > desired_velocity_;	// the desired velocity by the controller
+			std::vector< double > force_;				// the force that we are currently applying to the joint
+			std::vector< double > delta_force_;			// the difference of the applied force between now and the last update
+			std::vector< VelocityState > velocity_state_;	// history of the velocity estimator (fixed size per joint)
+			std::vector< double > joint_velocity_;		// velocity reported by the simulation (only read for JOINT_VELOCITY)
+
+			// pid controller (gains and state)
+
+			std::vector< double > p_gain_;
+			std::vector< double > i_gain_;
+			std::vector< double > d_gain_;
+			std::vector< double > i_max_;				// upper limit of the integral term
+			std::vector< double > i_min_;				// lower limit of the integral term
+			std::vector< double > p_error_;				// last error (input of the controller)
+			std::vector< double > i_error_;				// integrated error (discrete form: the integral term, in force units)
+			std::vector< double > d_error_;				// derivative of the error (discrete form: filtered)
+			std::vector< double > c_p_;					// coefficients of the discrete form (see pid_kernel::coefficients())
+			std::vector< double > c_i_;
+			std::vector< double > c_d_;
+			std::vector< double > c_filter_;
+			std::vector< double > c_slope_;
+			std::vector< double > c_track_;
+			std::vector< double > c_i_lo_;
+			std::vector< double > c_i_hi_;
+
+			// controller parameters
+
+			std::vector< double > multiplier_;			// factor to adjust the output of the PID controller
+			std::vector< double > max_force_;			// the maximum joint force that we apply
+			std::vector< double > max_velocity_;		// the maximum velocity of the joint (in rad/s). not a physical limit
+			std::vector< double > damping_;				// damping factor when computing the desired joint velocity
+			std::vector< int > input_type_;				// controller input: 0=position, 1=velocity
+			std::vector< int > update_type_;			// update type: 0=directForce, 1=deltaForce
+			std::vector< int > pid_form_;				// controller form: 0=classic, 1=discrete
+			std::vector< int > anti_windup_;			// discrete form: 0=clamping, 1=back-calculation, 2=conditional integration
+			std::vector< double > d_filter_;			// discrete form: time constant of the derivative filter (s)
+			std::vector< double > tracking_time_;		// discrete form: time constant of the back-calculation (s)
+			std::vector< int > velocity_estimator_;		// see velocity_estimator::Estimator
+			std::vector< int > velocity_taps_;			// fir estimator: number of angles
+			std::vector< double > velocity_alpha_;		// alpha-beta estimator: gain of the angle correction
+			std::vector< int > rate_divider_;			// the joint is computed every rate_divider_ ticks (power of two)
+			std::vector< int > rate_phase_;				// the tick of the schedule (modulo the divider) at which it is computed
+			std::vector< char > reset_;					// if set we are resetting the joint state at the next update
+			std::vector< ParamHandoff* > handoff_;		// parameter input from the ros callbacks
+
+		private:
+			/// @brief recomputes the coefficients of the discrete form of a joint for its current dt
+			void updateCoefficients( int index );
+
+			/// @brief assigns the sub-rate joints to the ticks of the schedule and builds the runs of every tick
+			void schedule();
+
+			/// @brief marks the time of the last update of the joints of the run(s) of joint 'index' as unknown (reset)
+			void clearUpdateTime( int index );
+
+			/** @brief dt of run 'n' at the current tick: the time since the last update of its joints (the same for all
+			 *         joints of a run). if that is unknown (after a reschedule or a reset) the nominal period of the run,
+			 *         its divider times 'dt'
+			 */
+			double runDt( int n, double dt ) const {
+				double last = update_time_[runs_[n].begin];
+				return last == last ? time_ - last : run_divider_[n] * dt;
+			}
+
+			/// @brief the joints that we are manipulating
+			JointAccess *access_;
+
+			/// @brief latency histograms of the update phases (NULL if disabled)
+			LatencyProfiler *profiler_;
+
+			/// @brief gain schedules of the joints (NULL if disabled)
+			GainScheduler *scheduler_;
+
+			/// @brief number of joints per lookup of the gain schedules and kernel call (see compute())
+			static const int SCHEDULE_BLOCK = 64;
+
+			/// @brief number of joints
+			int size_;
+
+			/// @brief incremented by every ParamHandoff::publish()
+			std::atomic<unsigned int> param_version_;
+
+			/// @brief value of param_version_ at the last applyParams() call
+			unsigned int applied_version_;
+
+			/// @brief desired state of the last parameter set taken from the ParamHandoff (applied with SET_DESIRED)
+			std::vector< double > param_desired_;
+
+			/** @brief the schedule: runs of joints with the same kernel and rate divider, for every tick of the period. the
+			 *         runs of tick t are [phase_begin_[t], phase_begin_[t+1])
+			 */
+			std::vector< pid_kernel::Run > runs_;
+			std::vector< int > run_divider_;
+			int phase_begin_[MAX_RATE_DIVIDER+1];
+
+			/// @brief set if a joint was added or a mode or rate changed, the schedule is rebuilt at the next update()
+			bool regroup_;
+
+			/// @brief number of joints with a pending reset (reset_)
+			int reset_joints_;
+
+			/// @brief set if a joint requested a reset of the whole model
+			bool reset_model_;
+
+			/// @brief time of the oldest pending reset request (ParamHandoff::now(), 0 if unknown)
+			int64_t reset_time_;
+
+			/// @brief dt of the coefficients of the discrete form of every joint, they are recomputed when dt changes
+			std::vector< double > coeff_dt_;
+
+			/// @brief number of joints with the JOINT_VELOCITY estimator (the velocities are only read if there are any)
+			int joint_velocity_joints_;
+
+			/// @brief length of the schedule (largest rate divider in use) and the number of compute() calls
+			int period_;
+			unsigned int tick_;
+
+			/// @brief sum of the dt of all compute() calls, and the value at the last update of every joint (NaN: unknown)
+			double time_;
+			std::vector< double > update_time_;
+	};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef GAZEBO_CRAB_PLUGIN_JOINT_LOG_HPP
+#define GAZEBO_CRAB_PLUGIN_JOINT_LOG_HPP
+
+// project headers
+#include "spsc_ring.hpp"
+
+// C++ headers
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <memory>
+
+
+
+
+namespace gazebo {
+
+
+	/** @brief header at the start of every binary joint log file. it is followed by 'text_size' bytes of text (the
+	 *         parameter line of the text format, including the newline) and then by JointLogRecords up to the end of the file
+	 */
+	struct JointLogFileHeader {
+		char magic[8];				// JOINT_LOG_MAGIC
+		uint32_t version;			// JOINT_LOG_VERSION
+		uint32_t record_size;		// sizeof(JointLogRecord)
+		uint32_t text_size;			// length of the text that follows the header
+		uint32_t reserved;
+	};
+
+	#define JOINT_LOG_MAGIC "CRABLOG"
+	#define JOINT_LOG_VERSION 1
+
+
+	/// @brief fixed-width record of one joint for one tick. same fields as one line of the text log
+	struct JointLogRecord {
+		uint32_t sec;				// time of the update (ros::Time)
+		uint32_t nsec;
+		double desired;				// target angle
+		double angle;				// actual angle
+		double velocity;			// current velocity
+		double angle_error;			// position error (desired - angle)
+		double velocity_error;		// velocity error (velocity - desired velocity)
+	};
+
+
+	/** @brief binary, ring-buffered log writer for the joints of a model.
+	 *
+	 * the physics thread copies fixed-width records into a lock-free single producer / single consumer ring (push()),
+	 * a background thread writes them to one binary file per joint through a large stdio buffer and flushes the files
+	 * when the ring runs empty. nothing on the physics thread formats text, flushes or makes a system call.
+	 *
+	 * a file is (re)opened by open() from any (non-physics) thread. when a file grows beyond the maximum size, the
+	 * flusher continues in a new file with an increasing number (<name>.bin, <name>.1.bin, <name>.2.bin, ...), every
+	 * file starts with the header, so it can be converted on its own (joint_log_convert).
+	 */
+	class JointLogWriter {
+		public:
+			JointLogWriter() : max_file_size_(0), running_(false), active_(0), dropped_(0) {};
+			~JointLogWriter() { stop(); }
+
+			/** @brief sets the log directory (created if it does not exist), the maximum size of a file in bytes (0 for no
+			 *         limit) and the number of joints. must be called before start()
+			 */
+			void configure( const std::string &directory, uint64_t max_file_size, int joints );
+
+			/// @brief creates the ring with (at least) 'capacity' records and starts the flusher thread
+			void start( size_t capacity );
+
+			/// @brief stops the flusher thread, writes the records that are still in the ring and closes all files
+			void stop();
+
+			/// @brief the log directory (with a trailing slash)
+			const std::string& directory() const { return directory_; }
+
+			/** @brief (re)opens the log file of a joint. 'name' is the file name without directory and extension, 'text'
+			 *         the parameter line that is stored in the header. returns false if the file could not be created
+			 */
+			bool open( int joint, const std::string &name, const std::string &text );
+
+			/// @brief closes the log file of a joint. records that are still in the ring are discarded
+			void close( int joint );
+
+			/// @brief returns true if at least one joint has an open log file. physics thread
+			bool active() const { return active_.load( std::memory_order_relaxed ) > 0; }
+
+			/// @brief returns true if the log file of a joint is open. physics thread
+			bool isOpen( int joint ) const { return files_[joint]->open.load( std::memory_order_relaxed ); }
+
+			/// @brief queues a record for writing. drops (and counts) the record if the ring is full. physics thread
+			void push( int joint, const JointLogRecord &record ) {
+				Entry entry;
+				entry.joint = joint;
+				entry.record = record;
+				if( !ring_->push( entry ) )
+					dropped_.fetch_add( 1, std::memory_order_relaxed );
+			}
+
+			/// @brief number of records that were dropped because the ring was full
+			uint64_t dropped() const { return dropped_.load( std::memory_order_relaxed ); }
+
+		private:
+			JointLogWriter( const JointLogWriter& );
+			JointLogWriter& operator=( const JointLogWriter& );
+
+			/// @brief ring entry
+			struct Entry {
+				int joint;
+				JointLogRecord record;
+			};
+
+			/// @brief log file of one joint. 'mutex' serializes open()/close() and the flusher thread
+			struct File {
+				File() : file(NULL), size(0), part(0), open(false) {};
+
+				std::mutex mutex;
+				FILE *file;
+				std::vector< char > buffer;		// stdio buffer of 'file'
+				std::string name;				// file name without directory and extension
+				std::string text;				// parameter line for the header
+				uint64_t size;					// bytes written to the current file
+				int part;						// number of the current file (rotation)
+				std::atomic< bool > open;
+			};
+
+			/// @brief main loop of the flusher thread
+			void run();
+
+			/// @brief writes a record to the file of its joint, rotates the file if required. flusher thread
+			void write( const Entry &entry );
+
+			/// @brief opens part 'file.part' of a log file and writes the header. expects file.mutex to be locked
+			bool openPart( File &file );
+
+			/// @brief closes the current part of a log file. expects file.mutex to be locked
+			void closePart( File &file );
+
+			std::string directory_;
+			uint64_t max_file_size_;
+			std::vector< std::unique_ptr< File > > files_;
+
+			std::unique_ptr< SpscRing< Entry > > ring_;
+			std::thread thread_;
+			std::atomic< bool > running_;
+			std::atomic< int > active_;			// number of open files
+			std::atomic< uint64_t > dropped_;
+	};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef GAZEBO_CRAB_PLUGIN_LATENCY_PROFILER_HPP
+#define GAZEBO_CRAB_PLUGIN_LATENCY_PROFILER_HPP
+
+// C++ headers
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+
+
+
+namespace gazebo {
+
+
+	/** @brief lock-free latency histogram with logarithmic buckets (hdr style): values below 2*SUB ns are counted exactly,
+	 *         above that every power of two is split into SUB linear sub-buckets (relative error < 1/SUB).
+	 *
+	 * there is one writer (the physics thread) that only does a relaxed increment of a bucket. readers on other threads
+	 * take snapshots of the counts (snapshot()) and compute the percentiles of a snapshot or of the difference of two
+	 * snapshots (an interval), so the writer never waits and the histogram is never cleared.
+	 */
+	class LatencyHistogram {
+		public:
+			/// @brief log2 of the number of sub-buckets per power of two
+			static const int SUB_BITS = 5;
+			static const int SUB = 1 << SUB_BITS;
+
+			/// @brief largest value (ns) that is counted in its own bucket: 2^MAX_BITS - 1 (larger values are clamped)
+			static const int MAX_BITS = 40;
+
+			/// @brief number of buckets
+			static const int N_BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB;
+
+			LatencyHistogram();
+
+			/// @brief adds a value (ns). writer side (one thread)
+			void record( uint64_t ns ) {
+				std::atomic< uint64_t > &count = counts_[index( ns )];
+				count.store( count.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+				if( ns > max_.load( std::memory_order_relaxed ) )
+					max_.store( ns, std::memory_order_relaxed );
+			}
+
+			/// @brief copies the counts of all buckets into 'counts' (N_BUCKETS entries). any thread
+			void snapshot( std::vector< uint64_t > &counts ) const;
+
+			/// @brief the largest recorded value (ns) since the start
+			uint64_t max() const { return max_.load( std::memory_order_relaxed ); }
+
+			/// @brief the bucket of a value
+			static int index( uint64_t ns );
+
+			/// @brief a representative value (middle) of a bucket (ns)
+			static double value( int index );
+
+			/// @brief number of values in 'counts'
+			static uint64_t total( const std::vector< uint64_t > &counts );
+
+			/** @brief the value (ns) below which the fraction 'q' of the values in 'counts' are (bucket resolution). 0 if
+			 *         'counts' is empty. q=1 gives the largest bucket with a value
+			 */
+			static double percentile( const std::vector< uint64_t > &counts, double q );
+
+		private:
+			LatencyHistogram( const LatencyHistogram& );
+			LatencyHistogram& operator=( const LatencyHistogram& );
+
+			std::atomic< uint64_t > counts_[N_BUCKETS];
+			std::atomic< uint64_t > max_;
+	};
+
+
+	/** @brief latency histograms of the phases of an update (OnUpdate) of the plugin.
+	 *
+	 * the code that is measured takes a timestamp at the start (now()) and calls lap() at the end of every phase. a NULL
+	 * profiler pointer disables the measurement, so the cost without profiler is one branch per phase.
+	 */
+	class LatencyProfiler {
+		public:
+			/// @brief the phases of an update
+			enum {
+				PHASE_TICK = 0,			// the whole update
+				PHASE_PARAMS,			// parameter hand-off and resets
+				PHASE_SETPOINTS,		// trajectories and excitation signals
+				PHASE_READ,				// reading the joint angles, velocity estimation
+				PHASE_COMPUTE,			// pid kernel
+				PHASE_WRITE,			// applying the forces (SetForce)
+				PHASE_EPISODE,			// watchdog and episode accumulators
+				PHASE_PUBLISH,			// telemetry records
+				PHASE_LOG,				// log records
+				N_PHASES
+			};
+
+			/// @brief the name of a phase (as used on the diagnostics topic)
+			static const char* name( int phase );
+
+			/// @brief current time (steady clock, ns)
+			static int64_t now() {
+				return std::chrono::duration_cast< std::chrono::nanoseconds >(
+					std::chrono::steady_clock::now().time_since_epoch() ).count();
+			}
+
+			/// @brief records the time since 'since' for a phase and returns the current time (start of the next phase)
+			int64_t lap( int phase, int64_t since ) {
+				int64_t t = now();
+				histogram_[phase].record( t - since );
+				return t;
+			}
+
+			/// @brief records a measured time (ns) for a phase
+			void record( int phase, int64_t ns ) {
+				histogram_[phase].record( ns );
+			}
+			
+			/// @brief the histogram of a phase
+			const LatencyHistogram& histogram( int phase ) const { return histogram_[phase]; }
+
+		private:
+			LatencyHistogram histogram_[N_PHASES];
+	};
+
+} // end of namespace
+
+#endif
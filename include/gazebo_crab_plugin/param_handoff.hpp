@@ -0,0 +1,159 @@
+#ifndef GAZEBO_CRAB_PLUGIN_PARAM_HANDOFF_HPP
+#define GAZEBO_CRAB_PLUGIN_PARAM_HANDOFF_HPP
+
+// C++ headers
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <math.h>		// M_PI
+
+
+
+
+namespace gazebo {
+
+
+	/// @brief complete parameter set of one joint controller, as written by the ros callbacks
+	struct JointParams {
+		JointParams() : desired(0.0), p_gain(0.0), i_gain(0.0), d_gain(0.0), i_max(0.0), i_min(0.0), multiplier(1.0),
+			max_force(5.0), max_velocity(2*M_PI), damping(0.0), d_filter(0.0), tracking_time(0.0), velocity_alpha(0.5), input_type(0), update_type(1),
+			pid_form(0), anti_windup(0), velocity_estimator(0), velocity_taps(4), rate_divider(1) {};
+
+		double desired;			// the desired joint state (angle, radians)
+		double p_gain;
+		double i_gain;
+		double d_gain;
+		double i_max;
+		double i_min;
+		double multiplier;		// factor to adjust the output of the PID controller
+		double max_force;		// the maximum joint force that we apply
+		double max_velocity;	// the maximum velocity of the joint (in rad/s)
+		double damping;			// damping factor when computing the desired joint velocity
+		double d_filter;		// discrete form: time constant of the derivative filter (s), 0=unfiltered
+		double tracking_time;	// discrete form: time constant of the back-calculation (s), 0=one tick
+		double velocity_alpha;	// alpha-beta velocity estimator: gain of the angle correction (0..1)
+		int input_type;			// 0=position, 1=velocity
+		int update_type;		// 0=directForce, 1=deltaForce
+		int pid_form;			// 0=classic, 1=discrete
+		int anti_windup;		// discrete form: 0=clamping, 1=back-calculation, 2=conditional integration
+		int velocity_estimator;	// 0=tick difference, 1=finite difference, 2=fir, 3=alpha-beta, 4=joint velocity
+		int velocity_taps;		// fir velocity estimator: number of angles (2..8)
+		int rate_divider;		// the controller runs every rate_divider ticks (power of two, 1..16, rounded down)
+	};
+
+
+	/** @brief lock-free hand-off of JointParams from the ros callback threads to the physics update thread (rcu style).
+	 *
+	 * a writer copies a complete parameter set into a new block and publishes it with a single atomic exchange. the
+	 * physics thread takes the newest block at the next tick boundary (take()), so it never sees a half written gain
+	 * set and never blocks. a block that was replaced before the physics thread took it was never visible to the
+	 * reader and is deleted by the writer. one-shot requests (reset) are kept as atomic flags, so that they can not be
+	 * lost when a newer parameter set replaces a pending one.
+	 *
+	 * every publish() increments the 'version' counter given to the constructor (shared by all joints of a model), so
+	 * the physics thread only has to look at the joints when the version changed.
+	 *
+	 * @note concurrent writers are fine for the hand-off itself, but writers that modify a shared copy of the
+	 *       parameters (read-modify-publish) have to serialize among themselves.
+	 */
+	class ParamHandoff {
+		public:
+			/// @brief flags for one-shot requests
+			enum {
+				RESET_JOINT = 1,	// reset the joint (angle & velocity)
+				RESET_PID = 2,		// reset the pid state (integrator & errors)
+				RESET_MODEL = 4,	// reset the whole model (once per tick, no matter how many joints request it)
+				SET_DESIRED = 8		// the parameter set carries a new desired joint state (otherwise 'desired' is ignored)
+			};
+
+			/// @brief flags that reset the simulation (and are timed, see takeResetTime())
+			static const int RESET_SIMULATION = RESET_JOINT | RESET_MODEL;
+
+			ParamHandoff( std::atomic<unsigned int> *version ) : version_(version), pending_(NULL), retired_(NULL), flags_(0),
+				reset_time_(0) {};
+
+			~ParamHandoff() {
+				delete pending_.exchange( NULL );
+				delete retired_.exchange( NULL );
+			}
+
+			/// @brief publishes a new parameter set. writer side (ros callbacks)
+			void publish( const JointParams &params, int flags = 0 ) {
+				delete retired_.exchange( NULL, std::memory_order_acq_rel );		// taken by the reader before
+				JointParams *old = pending_.exchange( new JointParams(params), std::memory_order_acq_rel );
+				delete old;		// never seen by the reader
+				// the flags after the parameters: a reader that sees the flags also finds the parameters (see take())
+				if( flags & RESET_SIMULATION )
+					stampReset();
+				if( flags )
+					flags_.fetch_or( flags, std::memory_order_release );
+				version_->fetch_add( 1, std::memory_order_release );
+			}
+
+			/// @brief requests a one-shot action (see flags) without changing the parameters. writer side
+			void request( int flags ) {
+				if( flags & RESET_SIMULATION )
+					stampReset();
+				flags_.fetch_or( flags, std::memory_order_release );
+				version_->fetch_add( 1, std::memory_order_release );
+			}
+
+			/** @brief copies the newest parameter set into 'params'. returns false if there is no new set. reader side
+			 *
+			 * the block is not freed here but retired, the next publish() frees it, so the physics thread does not call
+			 * the allocator. only if a publish() runs concurrently with two take()s the older block is freed here
+			 */
+			bool take( JointParams &params ) {
+				JointParams *p = pending_.exchange( NULL, std::memory_order_acq_rel );
+				if( !p )
+					return false;
+				params = *p;
+				delete retired_.exchange( p, std::memory_order_acq_rel );
+				return true;
+			}
+
+			/// @brief returns and clears the pending one-shot flags. call before take(). reader side
+			int takeFlags() {
+				return flags_.exchange( 0, std::memory_order_acq_rel );
+			}
+
+			/// @brief returns and clears the time of the oldest pending reset request (steady clock, ns). reader side
+			int64_t takeResetTime() {
+				return reset_time_.exchange( 0, std::memory_order_acq_rel );
+			}
+
+			/// @brief current time of the steady clock in ns (the clock of the reset requests)
+			static int64_t now() {
+				return std::chrono::duration_cast< std::chrono::nanoseconds >(
+					std::chrono::steady_clock::now().time_since_epoch() ).count();
+			}
+
+		private:
+			/// @brief stores the time of a reset request, unless an older request is still pending
+			void stampReset() {
+				int64_t expected = 0;
+				reset_time_.compare_exchange_strong( expected, now(), std::memory_order_acq_rel );
+			}
+
+			ParamHandoff( const ParamHandoff& );
+			ParamHandoff& operator=( const ParamHandoff& );
+
+			/// @brief change counter of the model (shared by all joints)
+			std::atomic<unsigned int> *version_;
+
+			/// @brief newest parameter set that has not been taken by the reader yet (NULL if there is none)
+			std::atomic<JointParams*> pending_;
+
+			/// @brief the last block taken by the reader, freed by the next publish() (NULL if there is none)
+			std::atomic<JointParams*> retired_;
+
+			/// @brief pending one-shot requests
+			std::atomic<int> flags_;
+
+			/// @brief time of the oldest pending reset request (0 if there is none)
+			std::atomic<int64_t> reset_time_;
+	};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef GAZEBO_CRAB_PLUGIN_PID_KERNEL_HPP
+#define GAZEBO_CRAB_PLUGIN_PID_KERNEL_HPP
+
+// C++ headers
+#include <stddef.h>
+#include <vector>
+
+
+
+
+namespace gazebo {
+
+
+	/** @brief pointers to the per-joint arrays that the pid kernel reads and writes. all arrays hold 'size' entries
+	 *         (see JointEngine::batch())
+	 */
+	struct PidBatch {
+		int size;
+
+		// input, read only
+		const double *angle;			// current joint angle
+		const double *velocity;			// current joint velocity
+		const double *desired;			// desired joint angle
+		const double *p_gain;
+		const double *i_gain;
+		const double *d_gain;
+		const double *i_max;
+		const double *i_min;
+		const double *multiplier;
+		const double *max_force;
+		const double *max_velocity;
+		const double *damping;
+		const int *input_type;			// 0=position, 1=velocity
+		const int *update_type;			// 0=directForce, 1=deltaForce
+		const int *pid_form;			// 0=classic (control_toolbox), 1=discrete (precomputed coefficients)
+		const int *anti_windup;			// discrete form: 0=clamping, 1=back-calculation, 2=conditional integration
+		const double *d_filter;			// discrete form: time constant of the derivative filter (s), 0=unfiltered
+		const double *tracking_time;	// discrete form: time constant of the back-calculation (s), 0=one tick
+
+		// coefficients of the discrete form, written by coefficients() when the gains or dt change
+		double *c_p;					// multiplier * p
+		double *c_i;					// multiplier * i * dt
+		double *c_d;					// multiplier * d
+		double *c_filter;				// d_filter / (d_filter + dt)
+		double *c_slope;				// 1 / (d_filter + dt)
+		double *c_track;				// min( dt / tracking_time, 1 )
+		double *c_i_lo;					// limits of the integral term: multiplier * [i_min, i_max]
+		double *c_i_hi;
+
+		// controller state and output, read & write
+		double *desired_velocity;
+		double *p_error;				// last error
+		double *i_error;				// classic: integrated error, discrete: integral term (force)
+		double *d_error;				// derivative of the error (discrete: filtered)
+		double *force;
+		double *delta_force;
+	};
+
+
+	/** @brief batched pid controller: error, desired velocity clamp, pid command and force clamp for all joints of a batch.
+	 *
+	 * the controller modes are compile-time policies: an input policy (position or velocity error), a control law
+	 * (classic or discrete with one of three anti-windup schemes), an output policy (direct or delta force) and a clamp
+	 * policy. every combination is a separate instantiation of one kernel template
+	 * (a Kernel), which has no per-joint mode dispatch. group() splits a batch into runs of consecutive joints with the
+	 * same modes, compute() runs the kernel of every run. a new mode is a new policy class and a new entry in the kernel
+	 * table (pid_kernel.cpp), the kernel loop itself does not change.
+	 *
+	 * the kernels work on groups of joints (4 with AVX2, 2 with SSE2) and replace the remaining branches (clamps, NaN
+	 * check) by masks, the joints at the end of a run are handled one at a time. the kernels are built for the SSE2
+	 * baseline of x86-64 (scalar code on other platforms) and, with the cmake option CRAB_PLUGIN_AVX2 (default on), for
+	 * AVX2 in a separate file. the AVX2 kernels are used if the cpu supports them, so the binaries run on any x86-64 cpu.
+	 *
+	 * with modes that change from joint to joint, the runs are shorter than a SIMD step and the call per run costs more
+	 * than the vectorization saves. group() therefore merges adjacent short runs into one run of the scalar reference
+	 * (computeScalar(), one call with runtime mode checks, see coalesce()).
+	 *
+	 * @note the kernels and the scalar reference (computeScalar()) perform the same ieee operations in the same order, so
+	 *       the results are bit-identical as long as the compiler does not contract a*b+c into fma instructions (the
+	 *       kernel is built with -ffp-contract=off). the only difference to the old per-joint code is the sign of a zero
+	 *       force in directForce mode (0.0 + -0.0 = 0.0).
+	 *
+	 * the classic form is control_toolbox::Pid::computeCommand( error, dt ): two divisions by dt per tick, the integral
+	 * term is clamped to [i_min, i_max] but the integrated error keeps growing. the discrete form uses coefficients that
+	 * are precomputed when the gains or dt change (no division per tick):
+	 *
+	 *   derivative:  ed[k] = c_filter * ed[k-1] + c_slope * (e[k] - e[k-1])      (backward euler, first-order filter)
+	 *   integral:    I[k] = I[k-1] + c_i * e[k], limited to [c_i_lo, c_i_hi]      (integral term, bumpless on gain changes)
+	 *   output:      c_p * e[k] + I[k] + c_d * ed[k]
+	 *
+	 * and one of the anti-windup schemes, based on the part of the output that the force clamp cut off (s):
+	 *   clamping: only the limits of the integral term
+	 *   back-calculation: I[k] += c_track * s
+	 *   conditional integration: I[k] = I[k-1] if the output is saturated and the error drives it further
+	 */
+	namespace pid_kernel {
+
+		/// @brief a specialized kernel, updates the joints [begin, end) of a batch
+		typedef void (*Kernel)( const PidBatch &b, double dt, int begin, int end );
+
+		/// @brief consecutive joints that use the same kernel
+		struct Run {
+			int begin;
+			int end;
+			Kernel kernel;
+		};
+
+		/// @brief name of the instruction set that the kernels use ("avx2", "sse2" or "scalar")
+		const char* isa();
+
+		/// @brief scalar implementation with runtime mode checks for the joints [begin, end). reference for the kernels
+		void computeScalar( const PidBatch &b, double dt, int begin, int end );
+
+		/// @brief returns the kernel for a combination of input type, update type, controller form and anti-windup scheme
+		Kernel select( int input_type, int update_type, int pid_form, int anti_windup );
+
+		/** @brief computes the coefficients of the discrete form (c_*) of the joints [begin, end) for 'dt'. has to be
+		 *         repeated when the gains, the multiplier, the filter/tracking times or dt change
+		 */
+		void coefficients( const PidBatch &b, double dt, int begin, int end );
+
+		/** @brief computes only the gain coefficients (c_p, c_i, c_d) of joint 'i' for 'dt', for gains that change on
+		 *         every tick (see GainScheduler). the other coefficients have to be up to date
+		 */
+		inline void gainCoefficients( const PidBatch &b, double dt, int i ) {
+			double m = b.multiplier[i];
+			b.c_p[i] = m * b.p_gain[i];
+			b.c_i[i] = m * b.i_gain[i] * dt;
+			b.c_d[i] = m * b.d_gain[i];
+		}
+
+		/** @brief the grid cells of the gain schedules (see GainScheduler), structure of arrays in joint order: the cell of
+		 *         every joint, [angle_lo, angle_hi) x [velocity_lo, velocity_hi), and its gains as k[0] + k[1] angle +
+		 *         k[2] velocity + k[3] angle velocity. scheduled: 1.0 for the joints with a schedule, 0.0 for the others
+		 */
+		struct GainCells {
+			const double *angle_lo;
+			const double *angle_hi;
+			const double *velocity_lo;
+			const double *velocity_hi;
+			const double *p[4];
+			const double *i[4];
+			const double *d[4];
+			const double *scheduled;
+		};
+
+		/// @brief maximum number of joints that scheduleGains() evaluates at once
+		static const int GAIN_GROUP = 4;
+
+		/** @brief evaluates the cells of the scheduled joints of [begin, end) at their angle and desired velocity (the one
+		 *         of the velocity input, also for position input): writes their gains to 'p_gain', 'i_gain' and 'd_gain'
+		 *         (the arrays of 'b') and their gain coefficients (see gainCoefficients()), the other joints keep theirs.
+		 *         a joint outside of its cell gets wrong gains: the first joint of every group with such a joint is
+		 *         written to 'outside' (room for end - begin entries, a group has at most GAIN_GROUP joints), the return
+		 *         value is their number. dt in seconds
+		 */
+		int scheduleGains( const PidBatch &b, const GainCells &cells, double dt, int begin, int end, double *p_gain,
+			double *i_gain, double *d_gain, int *outside );
+
+		/// @brief splits the batch into runs of joints with the same kernel. only needs to be repeated if a mode changes
+		void group( const PidBatch &b, std::vector< Run > &runs );
+
+		/** @brief merges adjacent runs of runs[first, end) that are shorter than one SIMD step (and have the same
+		 *         divider[joint], if 'divider' is not NULL) into runs of computeScalar(). does not allocate
+		 */
+		void coalesce( std::vector< Run > &runs, size_t first, const int *divider );
+
+		/// @brief updates all joints of the batch, using the runs from group(). dt in seconds
+		void compute( const PidBatch &b, double dt, const std::vector< Run > &runs );
+
+		/// @brief groups and updates all joints of the batch. dt in seconds
+		void compute( const PidBatch &b, double dt );
+
+	} // end of namespace 'pid_kernel'
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef GAZEBO_CRAB_PLUGIN_SPSC_RING_HPP
+#define GAZEBO_CRAB_PLUGIN_SPSC_RING_HPP
+
+// C++ headers
+#include <stddef.h>
+#include <vector>
+#include <atomic>
+
+
+
+
+namespace gazebo {
+
+
+	/** @brief lock-free single producer / single consumer ring buffer with a fixed capacity (rounded up to a power of two).
+	 *
+	 * push() is called by exactly one thread (the producer), pop() by exactly one other thread (the consumer). neither
+	 * of them blocks or allocates: push() returns false if the ring is full, pop() returns false if it is empty.
+	 */
+	template< typename T >
+	class SpscRing {
+		public:
+			explicit SpscRing( size_t capacity = 1024 ) : head_(0), tail_(0) {
+				size_t size = 1;
+				while( size < capacity )
+					size <<= 1;
+				buffer_.resize( size );
+				mask_ = size - 1;
+			}
+
+			/// @brief number of entries that fit into the ring
+			size_t capacity() const { return mask_ + 1; }
+
+			/// @brief adds an entry. returns false if the ring is full. producer side
+			bool push( const T &item ) {
+				size_t head = head_.load( std::memory_order_relaxed );
+				if( head - tail_.load( std::memory_order_acquire ) > mask_ )
+					return false;
+				buffer_[head & mask_] = item;
+				head_.store( head + 1, std::memory_order_release );
+				return true;
+			}
+
+			/// @brief removes the oldest entry and copies it to 'item'. returns false if the ring is empty. consumer side
+			bool pop( T &item ) {
+				size_t tail = tail_.load( std::memory_order_relaxed );
+				if( tail == head_.load( std::memory_order_acquire ) )
+					return false;
+				item = buffer_[tail & mask_];
+				tail_.store( tail + 1, std::memory_order_release );
+				return true;
+			}
+
+		private:
+			SpscRing( const SpscRing& );
+			SpscRing& operator=( const SpscRing& );
+
+			std::vector< T > buffer_;
+			size_t mask_;
+
+			// head and tail on separate cache lines, so that producer and consumer do not invalidate each others line
+			char pad0_[64];
+			std::atomic< size_t > head_;	// next slot to write (producer)
+			char pad1_[64];
+			std::atomic< size_t > tail_;	// next slot to read (consumer)
+			char pad2_[64];
+	};
+
+} // end of namespace
+
+#endif
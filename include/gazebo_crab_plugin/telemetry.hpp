@@ -0,0 +1,272 @@
+#ifndef GAZEBO_CRAB_PLUGIN_TELEMETRY_HPP
+#define GAZEBO_CRAB_PLUGIN_TELEMETRY_HPP
+
+// ROS headers
+#include <ros/ros.h>
+#include <gazebo_crab_plugin/model_joint_state.h>		// auto-generated by the project, based on msg/model_joint_state.msg
+#include <gazebo_crab_plugin/episode_summary.h>		// auto-generated by the project, based on msg/episode_summary.msg
+
+// project headers
+#include "spsc_ring.hpp"
+
+// C++ headers
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <memory>
+
+
+
+
+namespace gazebo {
+
+
+	/// @brief fixed-size telemetry record of one joint for one tick. contains the data of pid_joint_state and pid_joint_error
+	struct TelemetryRecord {
+		int joint;					// index of the joint (same as in the JointEngine)
+		int topics;					// TelemetryPublisher::TOPIC_* flags
+		double stamp;				// time of the update (seconds)
+		double desired;
+		double angle;
+		double angle_error;			// desired - angle
+		double velocity;
+		double desired_velocity;
+		double velocity_error;		// velocity - desired_velocity
+		double force;
+		double delta_force;
+		double p_gain;
+		double i_gain;
+		double d_gain;
+		double p_error;
+		double i_error;
+		double d_error;
+	};
+
+
+	/// @brief fixed-size episode record of one joint (one entry of an episode_summary message) or the end of a summary
+	struct EpisodeRecord {
+		int joint;					// index of the joint, -1 for the end record of a summary
+		int flags;					// TelemetryPublisher::EPISODE_* flags
+		uint32_t episode;			// number of the summary
+		int reason;					// see msg/episode_summary.msg
+		double stamp;				// simulation time of the end of the episode (or of the request)
+		double warmup;
+		double duration;
+		uint32_t count;
+		double velocity_sq_sum;
+		double angle_sq_sum;
+		double velocity_max;
+		double angle_max;
+		int failed;					// DivergenceWatchdog::FAIL_* reasons, 0 if ok
+		int reset_joints;			// EPISODE_RESET: number of joints that were reset
+		double reset_time;			// EPISODE_RESET: time of the reset itself (seconds, wall clock)
+		double reset_latency;		// EPISODE_RESET: time from the (oldest) request until the reset was applied
+	};
+
+
+	/** @brief publishes the joint telemetry of a model from a dedicated thread.
+	 *
+	 * the physics thread only copies fixed-size records into a lock-free single producer / single consumer ring
+	 * (push()), the publisher thread builds the pid_joint_state and pid_joint_error messages and calls
+	 * ros::Publisher::publish(). the subscriber count of every topic is polled by the publisher thread as well, the
+	 * physics thread only reads the cached result (wanted()).
+	 *
+	 * besides the per-joint topics there is one model-level topic ('pid_joint_states', model_joint_state) that packs the
+	 * state of all joints of one tick into a single array-based message. while it has subscribers, the physics thread
+	 * pushes a record for every joint (flag TOPIC_MODEL) and marks the last record of the tick with TOPIC_MODEL_END, the
+	 * publisher thread collects the records and publishes the message at the end of the tick. entries of records that
+	 * were dropped are NaN.
+	 *
+	 * every topic kind (state, error, model) has its own publish rate (setRate()), a period of n ticks and a mode.
+	 * MODE_SAMPLE publishes every n-th tick, the physics thread only pushes records on these ticks (see due()).
+	 * MODE_MEAN, MODE_MAX and MODE_RMS need a record of every tick, the publisher thread aggregates the fields over a
+	 * window of n ticks and publishes the result once per window.
+	 *
+	 * the episode summaries (topic 'episode_summary') take the same way through a second ring: the physics thread pushes
+	 * one EpisodeRecord per joint of the summary (pushEpisode()) and an end record (EPISODE_END), the publisher thread
+	 * builds and publishes the message. the end record of a reset also carries the reset report (EPISODE_RESET), which
+	 * is logged, together with the joints that the watchdog failed, and published on the (latched) topic
+	 * 'reset_latency'. so a reset, even one of the watchdog, does no logging or publishing on the physics thread.
+	 *
+	 * if a ring is full, the record is dropped and counted. the number of dropped records is available through
+	 * dropped() and is published on the (latched) topic 'telemetry_dropped' whenever it changes.
+	 */
+	class TelemetryPublisher {
+		public:
+			/// @brief topic flags
+			enum {
+				TOPIC_STATE = 1,		// <joint>_pid_state (pid_joint_state)
+				TOPIC_ERROR = 2,		// <joint>_errors (pid_joint_error)
+				TOPIC_MODEL = 4,		// pid_joint_states (model_joint_state, all joints)
+				TOPIC_MODEL_END = 8		// last record of a tick for the model topic
+			};
+
+			/// @brief episode record flags
+			enum {
+				EPISODE_END = 1,		// end record of a summary
+				EPISODE_RESET = 2,		// the summary ends the episodes with a reset, the end record has the report
+				EPISODE_RESET_MODEL = 4	// the reset included the model
+			};
+
+			/// @brief topic kinds, each kind has its own publish rate
+			enum {
+				KIND_STATE = 0,
+				KIND_ERROR = 1,
+				KIND_MODEL = 2,
+				N_KINDS = 3
+			};
+
+			/// @brief publish modes (same values as the telemetry mode enum in cfg/telemetry_params.cfg)
+			enum {
+				MODE_SAMPLE = 0,		// every n-th tick
+				MODE_MEAN = 1,			// mean over the window
+				MODE_MAX = 2,			// value with the largest magnitude in the window
+				MODE_RMS = 3			// root mean square over the window
+			};
+
+			TelemetryPublisher();
+			~TelemetryPublisher() { stop(); }
+
+			/** @brief registers a joint and its per-joint publishers (which may be empty if the per-joint topics are
+			 *         disabled). must be called in joint index order, before start()
+			 */
+			void addJoint( const std::string &name, const ros::Publisher &state_pub, const ros::Publisher &error_pub );
+
+			/// @brief creates the ring with (at least) 'capacity' records and starts the publisher thread
+			void start( ros::NodeHandle &nh, size_t capacity, bool model_topic );
+
+			/// @brief stops the publisher thread. records that are still in the ring are discarded
+			void stop();
+
+			/// @brief sets the publish rate of a topic kind: one message every 'period' ticks, 'mode' see MODE_*
+			void setRate( int kind, int period, int mode );
+
+			int period( int kind ) const { return period_[kind].load( std::memory_order_relaxed ); }
+			int mode( int kind ) const { return mode_[kind].load( std::memory_order_relaxed ); }
+
+			/// @brief converts a mode name ("sample", "mean", "max", "rms") to MODE_*. returns -1 for unknown names
+			static int parseMode( const std::string &name );
+
+			/// @brief returns the topics (TOPIC_STATE | TOPIC_ERROR) of joint 'index' that have at least one subscriber. physics thread
+			int wanted( int index ) const {
+				return running_.load( std::memory_order_relaxed ) ? wanted_[index].load( std::memory_order_relaxed ) : 0;
+			}
+
+			/// @brief returns true if the model topic has at least one subscriber. physics thread
+			bool wantedModel() const {
+				return wanted_model_.load( std::memory_order_relaxed );
+			}
+
+			/// @brief returns the topics (TOPIC_STATE | TOPIC_ERROR | TOPIC_MODEL) that need a record in tick 'tick'. physics thread
+			int due( uint64_t tick ) const;
+
+			/// @brief queues a record for publishing. drops (and counts) the record if the ring is full. physics thread
+			void push( const TelemetryRecord &record ) {
+				if( !ring_->push( record ) )
+					dropped_.fetch_add( 1, std::memory_order_relaxed );
+			}
+
+			/// @brief queues an episode record for the summary. drops (and counts) the record if the ring is full. physics thread
+			void pushEpisode( const EpisodeRecord &record ) {
+				if( !episode_ring_->push( record ) )
+					dropped_.fetch_add( 1, std::memory_order_relaxed );
+			}
+
+			/// @brief number of records that were dropped because the ring was full
+			uint64_t dropped() const { return dropped_.load( std::memory_order_relaxed ); }
+
+		private:
+			TelemetryPublisher( const TelemetryPublisher& );
+			TelemetryPublisher& operator=( const TelemetryPublisher& );
+
+			/// @brief running sums of one joint and topic kind over the current window
+			struct Window {
+				enum { N_FIELDS = 14 };		// double fields of TelemetryRecord (without the stamp)
+
+				void clear();
+				void add( const TelemetryRecord &record );
+
+				/// @brief writes the mean, peak or rms (see 'mode') of every field to 'result'
+				void result( int mode, TelemetryRecord &result ) const;
+
+				int count;
+				double stamp;				// stamp of the newest record
+				double sum[N_FIELDS];
+				double sum_sq[N_FIELDS];
+				double peak[N_FIELDS];		// value with the largest magnitude
+			};
+
+			/// @brief main loop of the publisher thread
+			void run();
+
+			/// @brief publishes a record or adds it to the windows of its topics. publisher thread
+			void publish( const TelemetryRecord &record );
+
+			/// @brief builds and publishes a pid_joint_state message. publisher thread
+			void publishState( const TelemetryRecord &record );
+
+			/// @brief builds and publishes a pid_joint_error message. publisher thread
+			void publishError( const TelemetryRecord &record );
+
+			/** @brief copies an episode record into episode_msg_ and publishes the summary (and the reset report) at its
+			 *         end record. publisher thread
+			 */
+			void collectEpisode( const EpisodeRecord &record );
+
+			/// @brief removes the joints from episode_msg_
+			void clearEpisode();
+
+			/// @brief copies a record into model_msg_ and publishes the message at the end of a tick (or window). publisher thread
+			void collectModel( const TelemetryRecord &record );
+
+			/// @brief copies a record into the entries of joint 'index' of model_msg_
+			void setModelEntry( int index, const TelemetryRecord &record );
+
+			/// @brief marks all entries of model_msg_ as missing (NaN)
+			void clearModel();
+
+			/// @brief polls the subscriber count of all topics and updates wanted_. publisher thread
+			void updateWanted();
+
+			std::vector< std::string > names_;
+			std::vector< ros::Publisher > state_pub_;
+			std::vector< ros::Publisher > error_pub_;
+			ros::Publisher model_pub_;
+			ros::Publisher dropped_pub_;
+			ros::Publisher episode_pub_;
+			ros::Publisher reset_latency_pub_;
+
+			/// @brief summary that is being collected (the arrays keep their capacity). publisher thread
+			gazebo_crab_plugin::episode_summary episode_msg_;
+
+			/// @brief model message of the current tick (arrays are allocated once in start())
+			gazebo_crab_plugin::model_joint_state model_msg_;
+
+			/// @brief aggregation windows per topic kind and joint (allocated once in start()). publisher thread
+			std::vector< Window > windows_[N_KINDS];
+
+			/// @brief number of ticks in the current window of the model topic. publisher thread
+			int model_count_;
+
+			/// @brief publish rate per topic kind
+			std::atomic< int > period_[N_KINDS];
+			std::atomic< int > mode_[N_KINDS];
+
+			/// @brief cached subscriber state of the model topic, written by the publisher thread
+			std::atomic< bool > wanted_model_;
+
+			/// @brief cached subscriber state per joint (TOPIC_STATE | TOPIC_ERROR), written by the publisher thread
+			std::unique_ptr< std::atomic<int>[] > wanted_;
+
+			std::unique_ptr< SpscRing< TelemetryRecord > > ring_;
+			std::unique_ptr< SpscRing< EpisodeRecord > > episode_ring_;
+			std::thread thread_;
+			std::atomic< bool > running_;
+			std::atomic< uint64_t > dropped_;
+	};
+
+} // end of namespace
+
+#endif
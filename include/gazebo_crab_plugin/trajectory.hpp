@@ -0,0 +1,109 @@
+#ifndef GAZEBO_CRAB_PLUGIN_TRAJECTORY_HPP
+#define GAZEBO_CRAB_PLUGIN_TRAJECTORY_HPP
+
+// C++ headers
+#include <vector>
+#include <atomic>
+
+
+
+
+namespace gazebo {
+
+
+	/** @brief time-stamped waypoints for the joints of a model, interpolated (linear or cubic) at the physics rate.
+	 *
+	 * the ros callback fills a Block (writeBlock()) and hands it over with publish(). the blocks are preallocated and
+	 * passed between the callback and the physics thread as a lock-free triple buffer, so neither side blocks or
+	 * allocates. the physics thread picks up the newest block in update(), copies the waypoints of the joints in the
+	 * block into its own (preallocated) per-joint buffers and writes the interpolated desired angle of every joint with
+	 * an active trajectory.
+	 *
+	 * if the last published block was not picked up yet (several messages within one tick, or a paused simulation),
+	 * writeBlock() takes it back and the next message is merged into it: the joints of the new message replace their
+	 * waypoints, the other joints keep theirs. so messages for different joints are never lost.
+	 *
+	 * a new trajectory replaces the current trajectory of its joints. if it starts in the future, the current desired
+	 * angle is inserted as first waypoint, so the joint moves smoothly from where it is. after the last waypoint the
+	 * joint holds the last angle and the trajectory ends (other setpoints take effect again). a joint with an empty
+	 * trajectory stops its current trajectory.
+	 */
+	class JointTrajectories {
+		public:
+			enum {
+				LINEAR = 0,
+				CUBIC = 1
+			};
+
+			/// @brief waypoints of one or more messages, written by the ros callback
+			struct Block {
+				std::vector< double > start;	// per joint: start time (simulation time, seconds). 0: when the physics thread gets the block
+				std::vector< int > interpolation;	// per joint: LINEAR or CUBIC
+				std::vector< int > count;		// number of waypoints per joint, -1 if the joint is not in the block
+				std::vector< char > has_velocity;	// per joint: velocity holds given velocities (cubic)
+				std::vector< double > time;		// per joint 'capacity' entries: time relative to 'start'
+				std::vector< double > position;
+				std::vector< double > velocity;
+			};
+
+			JointTrajectories() : joints_(0), capacity_(0), middle_(0), back_(1), front_(2), active_count_(0) {};
+
+			/// @brief allocates all buffers for 'joints' joints with up to 'capacity' waypoints each
+			void configure( int joints, int capacity );
+
+			/// @brief the maximum number of waypoints per joint and message
+			int capacity() const { return capacity_; }
+
+			/** @brief returns the block to fill: the last published block if it was not picked up yet (its joints are
+			 *         kept), otherwise an empty one (all joints marked as not present). writer side (one thread at a time)
+			 */
+			Block& writeBlock();
+
+			/// @brief hands the block from writeBlock() over to the physics thread. writer side
+			void publish();
+
+			/// @brief picks up a new block and writes the desired angle of all joints with an active trajectory. physics thread
+			void update( double now, double *desired );
+
+			/// @brief returns true if at least one joint follows a trajectory. physics thread
+			bool active() const { return active_count_ > 0; }
+
+		private:
+			JointTrajectories( const JointTrajectories& );
+			JointTrajectories& operator=( const JointTrajectories& );
+
+			/// @brief bit in middle_ that marks a block that was not picked up yet
+			static const int FRESH = 4;
+
+			/// @brief copies the waypoints of the block into the buffers of the joints. physics thread
+			void take( const Block &block, double now, const double *desired );
+
+			/// @brief estimates the velocities of joint 'j' from the neighbouring waypoints (cubic interpolation)
+			void estimateVelocities( int j );
+
+			/// @brief interpolated angle of joint 'j' at time 't'. returns false after the last waypoint
+			bool sample( int j, double t, double &angle );
+
+			int joints_;
+			int capacity_;
+
+			/// @brief the three blocks of the triple buffer and their roles: writer, exchange slot (+FRESH) and reader
+			Block blocks_[3];
+			std::atomic< int > middle_;
+			int back_;
+			int front_;
+
+			// active trajectories of the physics thread, per joint 'capacity_+1' entries (+1 for the inserted start)
+
+			std::vector< double > time_;			// absolute time (simulation time, seconds)
+			std::vector< double > position_;
+			std::vector< double > velocity_;
+			std::vector< int > size_;				// number of waypoints, 0 if the joint has no active trajectory
+			std::vector< int > segment_;			// current segment (index of its first waypoint)
+			std::vector< int > interpolation_;
+			int active_count_;
+	};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef GAZEBO_CRAB_PLUGIN_VELOCITY_ESTIMATOR_HPP
+#define GAZEBO_CRAB_PLUGIN_VELOCITY_ESTIMATOR_HPP
+
+
+
+
+namespace gazebo {
+
+
+	/** @brief per-joint state of the velocity estimators. fixed size, stored inline in one array of the engine (no
+	 *         allocation per joint, no pointer chasing)
+	 */
+	struct VelocityState {
+		/// @brief number of past angles (ring buffer). must be a power of two, upper limit of the fir taps
+		static const int HISTORY = 8;
+
+		VelocityState() : index(0), primed(0), angle(0.0), velocity(0.0) {
+			for( int n=0; n<HISTORY; n++ )
+				history[n] = 0.0;
+		}
+
+		double history[HISTORY];	// past angles, history[index] is the newest
+		int index;
+		int primed;					// 0: the next angle fills the history (after adding or resetting the joint)
+		double angle;				// alpha-beta: filtered angle
+		double velocity;			// alpha-beta: filtered velocity (rad/s)
+	};
+
+
+	/** @brief pointers to the per-joint arrays of the velocity estimation. all arrays hold 'size' entries (see
+	 *         JointEngine::read())
+	 */
+	struct VelocityBatch {
+		int size;
+
+		// input, read only
+		const double *angle;			// current joint angle
+		const double *joint_velocity;	// velocity reported by the simulation (rad/s), NULL if not read
+		const int *estimator;			// see velocity_estimator::Estimator
+		const int *taps;				// fir: number of angles, 2..VelocityState::HISTORY
+		const double *alpha;			// alpha-beta: gain of the angle correction, 0..1
+
+		// state and output, read & write
+		VelocityState *state;
+		double *velocity;
+	};
+
+
+	/** @brief estimation of the joint velocities from the measured angles, one estimator per joint.
+	 *
+	 * the estimators trade noise against delay and cost (see velocity_bench):
+	 *   TICK_DIFFERENCE: angle difference of the last two ticks (rad per tick, not rad/s). the original estimate, the
+	 *                    tuned velocity gains depend on it, so it stays the default
+	 *   FINITE_DIFFERENCE: the same difference divided by dt (rad/s)
+	 *   FIR: slope of the least-squares line through the last 'taps' angles (rad/s). the noise drops with taps^1.5,
+	 *        the delay is (taps-1)/2 ticks
+	 *   ALPHA_BETA: alpha-beta tracker (rad/s), beta = alpha^2 / (2 - alpha) (critically damped)
+	 *   JOINT_VELOCITY: the velocity of the physics engine (rad/s), FINITE_DIFFERENCE if the JointAccess has none
+	 */
+	namespace velocity_estimator {
+
+		/// @brief the estimators
+		enum Estimator {
+			TICK_DIFFERENCE = 0,
+			FINITE_DIFFERENCE = 1,
+			FIR = 2,
+			ALPHA_BETA = 3,
+			JOINT_VELOCITY = 4,
+			N_ESTIMATORS
+		};
+
+		/// @brief name of an estimator (as in the benchmark output)
+		const char* name( int estimator );
+
+		/** @brief pushes the current angle of the joints [begin, end) into their history and estimates the velocity.
+		 *         dt in seconds, estimators that need dt keep the last velocity if dt <= 0
+		 */
+		void estimate( const VelocityBatch &b, double dt, int begin, int end );
+
+		/// @brief clears the history of a joint, the next angle primes it (velocity 0)
+		void reset( VelocityState &state );
+
+	} // end of namespace 'velocity_estimator'
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef GAZEBO_CRAB_PLUGIN_WATCHDOG_HPP
+#define GAZEBO_CRAB_PLUGIN_WATCHDOG_HPP
+
+// C++ headers
+#include <vector>
+#include <stdint.h>
+
+
+
+
+namespace gazebo {
+
+
+	/// @brief thresholds of the DivergenceWatchdog. a threshold of 0 disables the check
+	struct WatchdogConfig {
+		WatchdogConfig() : grace(0.2), saturation_time(0.5), max_velocity(50.0), growth_window(0.5), growth_factor(1.2),
+			growth_windows(3), growth_min_error(0.05) {};
+
+		double grace;				// time after the start of an episode without checks (except nan), seconds
+		double saturation_time;		// the force may stay at max_force for this long (seconds)
+		double max_velocity;		// bound of the measured joint velocity (rad/s)
+		double growth_window;		// length of the windows of the error growth check (seconds)
+		double growth_factor;		// the maximum angle error of a window is growing if it exceeds the last one by this factor
+		int growth_windows;			// number of consecutive growing windows that fail the episode
+		double growth_min_error;	// windows with a smaller maximum angle error (rad) never count as growing
+	};
+
+
+	/** @brief detects joints that became unstable with the current parameters, so that the episode can be aborted instead
+	 *         of running to its end.
+	 *
+	 * a joint fails if its angle, velocity or force is not finite, its measured velocity exceeds a bound, its force stays
+	 * saturated for too long or the maximum angle error grows over several consecutive windows (oscillation with rising
+	 * amplitude). a failed joint is not checked again until its next episode starts (start()).
+	 *
+	 * all state is touched by the physics thread only.
+	 */
+	class DivergenceWatchdog {
+		public:
+			/// @brief reasons of a failure (bit mask)
+			enum {
+				FAIL_NAN = 1,			// angle, velocity or force is not finite
+				FAIL_VELOCITY = 2,		// the velocity exceeded max_velocity
+				FAIL_SATURATION = 4,	// the force was saturated for longer than saturation_time
+				FAIL_GROWTH = 8			// the angle error grew over growth_windows windows
+			};
+
+			DivergenceWatchdog() : joints_(0) {};
+
+			/// @brief allocates the state for 'joints' joints
+			void configure( int joints, const WatchdogConfig &config );
+
+			/// @brief starts a new episode of joint 'j' at simulation time 'now' (clears the failure)
+			void start( int j, double now );
+
+			/** @brief checks all joints after an update. the arrays are the engine arrays. returns the number of joints that
+			 *         failed in this call (see failed_)
+			 */
+			int check( double now, double dt, const double *desired, const double *angle, const double *force,
+				const double *max_force );
+
+			/// @brief failure reasons of the current episode of every joint (0: no failure)
+			std::vector< uint8_t > failed_;
+
+		private:
+			int joints_;
+			WatchdogConfig config_;
+
+			// state of every joint
+
+			std::vector< double > checked_from_;		// start of the episode + grace time
+			std::vector< double > last_angle_;			// angle of the last check (nan after the start)
+			std::vector< double > saturated_since_;		// start of the current saturation (< 0: not saturated)
+			std::vector< double > window_start_;		// start of the current error window
+			std::vector< double > window_max_;			// maximum absolute angle error in the current window
+			std::vector< double > last_window_max_;		// maximum absolute angle error in the last window
+			std::vector< int > growing_;				// number of consecutive growing windows
+	};
+
+} // end of namespace
+
+#endif
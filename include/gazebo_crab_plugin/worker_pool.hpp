@@ -0,0 +1,85 @@
+#ifndef GAZEBO_CRAB_PLUGIN_WORKER_POOL_HPP
+#define GAZEBO_CRAB_PLUGIN_WORKER_POOL_HPP
+
+// C++ headers
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+
+
+
+namespace gazebo {
+	
+	
+	/** @brief fixed pool of worker threads that run the tasks of one batch in parallel, with a barrier at the end.
+	 *
+	 * run() hands the task indices 0..tasks-1 out to the workers and the calling thread (dynamically, one index at a
+	 * time, so that tasks of different size balance) and returns when all tasks are done. every worker takes part in
+	 * every batch, so no worker is still inside a batch when run() returns.
+	 *
+	 * the workers are meant to run one batch per physics tick. between the batches they spin for 'spin' microseconds
+	 * before they block, so that a batch that follows shortly does not pay the wake-up latency of a blocked thread.
+	 *
+	 * @note run() must only be called by one thread at a time. the tasks must not call run()
+	 */
+	class WorkerPool {
+		public:
+			/// @brief a task: 'context' is the pointer passed to run(), 'index' the task index
+			typedef void (*Task)( void *context, int index );
+			
+			WorkerPool();
+			~WorkerPool() { stop(); }
+			
+			/// @brief starts 'threads' workers (in addition to the calling thread of run()). 0: run() is serial
+			void start( int threads, int spin );
+			
+			/// @brief stops and joins the workers
+			void stop();
+			
+			/// @brief number of workers
+			int threads() const { return threads_.size(); }
+			
+			/// @brief runs task( context, i ) for i = 0..tasks-1 on the workers and the calling thread, returns when all are done
+			void run( int tasks, Task task, void *context );
+			
+		private:
+			WorkerPool( const WorkerPool& );
+			WorkerPool& operator=( const WorkerPool& );
+			
+			/// @brief main loop of a worker. 'seen' is the generation at the start (the worker waits for the next one)
+			void worker( uint64_t seen );
+			
+			/// @brief runs task indices of the current batch until there are none left
+			void work();
+			
+			std::vector< std::thread > threads_;
+			
+			/// @brief spin time of the workers before they block (microseconds)
+			int spin_;
+			
+			/// @brief the current batch. written by run() before generation_ is incremented
+			Task task_;
+			void *context_;
+			int tasks_;
+			
+			/// @brief number of the current batch, the workers wait for it to change
+			std::atomic< uint64_t > generation_;
+			
+			/// @brief next task index of the current batch
+			std::atomic< int > next_;
+			
+			/// @brief number of workers that are done with the current batch
+			std::atomic< int > finished_;
+			
+			std::atomic< bool > stop_;
+			std::mutex mutex_;
+			std::condition_variable wake_;
+	};
+	
+} // end of namespace
+
+#endif
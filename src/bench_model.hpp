@@ -0,0 +1,247 @@
+#ifndef GAZEBO_CRAB_PLUGIN_BENCH_MODEL_HPP
+#define GAZEBO_CRAB_PLUGIN_BENCH_MODEL_HPP
+
+// project headers
+#include "../include/gazebo_crab_plugin/joint_engine.hpp"
+#include "../include/gazebo_crab_plugin/episode_stats.hpp"
+#include "../include/gazebo_crab_plugin/watchdog.hpp"
+#include "../include/gazebo_crab_plugin/trajectory.hpp"
+#include "../include/gazebo_crab_plugin/excitation.hpp"
+#include "../include/gazebo_crab_plugin/latency_profiler.hpp"
+#include "../include/gazebo_crab_plugin/gain_schedule.hpp"
+
+// C++ headers
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <random>
+
+
+
+
+/** @brief the simulated model of controller_bench and tick_alloc_test: a JointEngine with fake joints and random
+ *         parameters, and the physics thread tick of ModelPIDJoint around it (no ROS/Gazebo)
+ */
+
+
+namespace gazebo {
+
+
+	/** @brief controller modes of the benchmark: input_type * 2 + update_type, MODE_MIXED: every joint a random mode,
+	 *         MODE_DISCRETE: every joint a random mode with the discrete pid form (random anti-windup, filtered derivative)
+	 */
+	static const int MODE_MIXED = 4;
+	static const int MODE_DISCRETE = 5;
+
+	/// @brief dt of the benchmark (1 kHz, the physics rate of the simulations)
+	static const double DT = 0.001;
+
+
+	/// @brief JointAccess for the benchmark: a damped rotary joint with unit inertia, integrated with the tick dt
+	class FakeJoints : public JointAccess {
+		public:
+			FakeJoints( int size ) : angle_(size, 0.0), velocity_(size, 0.0) {};
+
+			virtual void readAngles( double *angle ) {
+				for( int i=0; i<angle_.size(); i++ )
+					angle[i] = angle_[i];
+			}
+
+			virtual bool readVelocities( double *velocity ) {
+				for( int i=0; i<velocity_.size(); i++ )
+					velocity[i] = velocity_[i];
+				return true;
+			}
+
+			virtual void writeForces( const double *force ) {
+				for( int i=0; i<angle_.size(); i++ ) {
+					velocity_[i] += (force[i] - 0.1 * velocity_[i]) * DT;
+					angle_[i] += velocity_[i] * DT;
+				}
+			}
+
+			virtual void resetJoint( int index ) {
+				angle_[index] = 0.0;
+				velocity_[index] = 0.0;
+			}
+
+		private:
+			std::vector< double > angle_;
+			std::vector< double > velocity_;
+	};
+
+
+
+
+	/// @brief joints of BenchEngine that stay at full rate when the others get a rate divider (one leg that is tuned)
+	static const int TUNED_JOINTS = 3;
+
+
+	/** @brief an engine with 'size' joints in controller mode 'mode', random setpoints and gains around the tuned values.
+	 *         all joints but the first TUNED_JOINTS run every 'divider' ticks
+	 */
+	class BenchEngine {
+		public:
+			BenchEngine( int size, int mode, int divider = 1 ) : joints_(size) {
+				std::default_random_engine generator( 42 );
+				std::uniform_real_distribution<double> uni_dist( -1.0, 1.0 );
+				std::uniform_int_distribution<int> mode_dist( 0, 3 );
+				std::uniform_int_distribution<int> windup_dist( 0, 2 );
+
+				engine_.setAccess( &joints_ );
+				for( int i=0; i<size; i++ ) {
+					handoff_.push_back( new ParamHandoff( engine_.paramVersion() ) );
+					engine_.addJoint( handoff_[i] );
+
+					int joint_mode = mode >= MODE_MIXED ? mode_dist( generator ) : mode;
+					JointParams p;
+					p.desired = uni_dist( generator );
+					p.p_gain = 0.3 + 0.1 * uni_dist( generator );
+					p.i_gain = 0.001;
+					p.d_gain = 0.05;
+					p.i_max = 0.1;
+					p.i_min = -0.1;
+					p.max_velocity = 1.0;
+					p.damping = 0.05;
+					p.input_type = joint_mode / 2;
+					p.update_type = joint_mode % 2;
+					p.rate_divider = i < TUNED_JOINTS ? 1 : divider;
+					if( mode == MODE_DISCRETE ) {
+						p.pid_form = 1;
+						p.anti_windup = windup_dist( generator );
+						p.d_filter = 0.005;
+					}
+					handoff_[i]->publish( p, ParamHandoff::SET_DESIRED );
+				}
+				engine_.applyParams();
+			}
+
+			~BenchEngine() {
+				for( int i=0; i<handoff_.size(); i++ )
+					delete handoff_[i];
+			}
+
+			/// @brief publishes new gains for joint 'i' (writer side, as a ros callback)
+			void publish( int i, double p_gain ) {
+				JointParams p;
+				p.p_gain = p_gain;
+				p.i_gain = 0.001;
+				p.d_gain = 0.05;
+				p.i_max = 0.1;
+				p.i_min = -0.1;
+				p.max_velocity = 1.0;
+				p.damping = 0.05;
+				handoff_[i]->publish( p );
+			}
+
+			JointEngine engine_;
+
+		private:
+			FakeJoints joints_;
+			std::vector< ParamHandoff* > handoff_;
+	};
+
+
+	/** @brief a gain schedule with 'dims' axes: 8 angles over [-1, 1] rad, and 4 desired velocities over [-1, 1] rad/s for
+	 *         dims=2 (the range of the BenchEngine joints). 'scale' scales the gains
+	 */
+	inline GainTable benchTable( int dims, double scale = 1.0 ) {
+		GainTable table;
+		for( int a=0; a<8; a++ )
+			table.angle.push_back( -1.0 + a * 2.0 / 7 );
+		for( int v=0; dims>1 && v<4; v++ )
+			table.velocity.push_back( -1.0 + v * 2.0 / 3 );
+		int velocities = dims > 1 ? 4 : 1;
+		for( int a=0; a<8; a++ ) {
+			for( int v=0; v<velocities; v++ ) {
+				table.p_gain.push_back( scale * (0.25 + 0.01 * a + 0.02 * v) );
+				table.i_gain.push_back( scale * 0.001 );
+				table.d_gain.push_back( scale * (0.05 - 0.002 * a) );
+			}
+		}
+		return table;
+	}
+
+
+	/** @brief one tick of the physics thread as in ModelPIDJoint (without telemetry and log): parameters, trajectories,
+	 *         excitation, engine with gain schedules on every 3rd joint, watchdog, episodes and the latency profiler.
+	 *         callbacks() plays the ros callbacks: every 100 ticks new gains for a joint, every 1000 ticks a new excitation
+	 *         signal and gain schedule. all joints but the first TUNED_JOINTS run every 'divider' ticks
+	 */
+	class BenchTick {
+		public:
+			BenchTick( int joints, int divider = 1 ) : bench_(joints, MODE_MIXED, divider), joints_(joints), now_(0.0), tick_(0) {
+				JointEngine &e = bench_.engine_;
+				std::vector< std::string > names;
+				for( int i=0; i<joints; i++ )
+					names.push_back( "joint_" + std::to_string( i ) );
+				trajectories_.configure( joints, 256 );
+				excitation_.configure( names, 1 );
+				episodes_.configure( joints, 0.0 );
+				watchdog_.configure( joints, WatchdogConfig() );
+				e.setProfiler( &profiler_ );
+
+				chirp_.type = ExcitationGenerator::CHIRP;
+				chirp_.amplitude = 0.2;
+				chirp_.f0 = 0.1;
+				chirp_.f1 = 5.0;
+				chirp_.duration = 10.0;
+				chirp_.repeat = true;
+				off_.type = ExcitationGenerator::OFF;
+				for( int i=0; i<joints; i+=2 )
+					excitation_.set( i, chirp_ );
+
+				schedule_ = benchTable( 2 );
+				scaled_ = benchTable( 2, 1.1 );
+				scheduler_.configure( joints );
+				for( int i=0; i<joints; i+=3 )
+					scheduler_.set( i, schedule_ );
+				e.setGainScheduler( &scheduler_ );
+			}
+
+			/// @brief the ros callbacks of the current tick (writer side, may allocate)
+			void callbacks() {
+				if( tick_ % 100 == 99 )
+					bench_.publish( (tick_ / 100) % joints_, 0.3 + 0.001 * (tick_ % 7) );
+				if( tick_ % 1000 == 999 ) {
+					excitation_.set( (tick_ / 1000) % joints_, (tick_ / 1000) % 2 ? chirp_ : off_ );
+					scheduler_.set( (tick_ / 1000) % joints_, (tick_ / 1000) % 2 ? scaled_ : GainTable() );
+				}
+			}
+
+			/// @brief one tick of the physics thread
+			void tick() {
+				JointEngine &e = bench_.engine_;
+				int64_t t = LatencyProfiler::now();
+				now_ += DT;
+				e.applyParams();
+				trajectories_.update( now_, e.desired_.data() );
+				excitation_.update( now_, e.desired_.data() );
+				t = profiler_.lap( LatencyProfiler::PHASE_SETPOINTS, t );
+				e.update( DT );
+				watchdog_.check( now_, DT, e.desired_.data(), e.angle_.data(), e.force_.data(), e.max_force_.data() );
+				episodes_.accumulate( now_, e.desired_.data(), e.angle_.data(), e.velocity_.data(), e.desired_velocity_.data() );
+				profiler_.lap( LatencyProfiler::PHASE_EPISODE, t );
+				tick_++;
+			}
+
+		private:
+			BenchEngine bench_;
+			JointTrajectories trajectories_;
+			ExcitationGenerator excitation_;
+			EpisodeStats episodes_;
+			DivergenceWatchdog watchdog_;
+			LatencyProfiler profiler_;
+			GainScheduler scheduler_;
+			ExcitationSignal chirp_;
+			ExcitationSignal off_;
+			GainTable schedule_;
+			GainTable scaled_;
+			int joints_;
+			double now_;
+			uint64_t tick_;
+	};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,228 @@
+// project headers
+#include "../include/gazebo_crab_plugin/worker_pool.hpp"
+#include "bench_model.hpp"
+
+// C++ headers
+#include <vector>
+
+// Google Benchmark
+#include <benchmark/benchmark.h>
+
+
+
+
+/** @brief benchmark of the controller core (JointEngine, no ROS/Gazebo): time per joint and tick for every controller mode
+ *         and joint count. the counter 'time/joint' is the time of one tick divided by the number of joints.
+ *
+ * the joints are simulated by a simple joint model (FakeJoints, see bench_model.hpp), its cost is part of the
+ * measurement. the allocations of the physics thread tick (BM_Tick) are checked by tick_alloc_test.
+ *
+ * usage: controller_bench [--benchmark_filter=<regex>] (see the Google Benchmark documentation)
+ */
+
+
+using namespace gazebo;
+
+
+/// @brief reports the time per joint and tick (inverted rate of the joint updates)
+static void setCounters( benchmark::State &state, int joints ) {
+	state.SetItemsProcessed( state.iterations() * joints );
+	state.counters["time/joint"] = benchmark::Counter( state.iterations() * joints,
+		benchmark::Counter::kIsRate | benchmark::Counter::kInvert );
+}
+
+
+/// @brief one controller tick (JointEngine::update). args: joint count, mode
+static void BM_Update( benchmark::State &state ) {
+	int joints = state.range( 0 );
+	BenchEngine bench( joints, state.range( 1 ) );
+
+	for( auto _ : state ) {
+		bench.engine_.update( DT );
+		benchmark::DoNotOptimize( bench.engine_.force_.data() );
+	}
+	setCounters( state, joints );
+}
+
+
+/// @brief one controller tick with the episode accumulators and the watchdog, as in the plugin. args: joint count, mode
+static void BM_UpdateAccumulate( benchmark::State &state ) {
+	int joints = state.range( 0 );
+	BenchEngine bench( joints, state.range( 1 ) );
+	JointEngine &e = bench.engine_;
+	EpisodeStats episodes;
+	DivergenceWatchdog watchdog;
+	episodes.configure( joints, 0.0 );
+	watchdog.configure( joints, WatchdogConfig() );
+
+	double now = 0.0;
+	for( auto _ : state ) {
+		e.update( DT );
+		now += DT;
+		watchdog.check( now, DT, e.desired_.data(), e.angle_.data(), e.force_.data(), e.max_force_.data() );
+		episodes.accumulate( now, e.desired_.data(), e.angle_.data(), e.velocity_.data(), e.desired_velocity_.data() );
+		benchmark::DoNotOptimize( episodes.angle_sq_sum_.data() );
+	}
+	setCounters( state, joints );
+}
+
+
+/** @brief one controller tick with sub-rate joints (mixed modes). args: joint count, rate divider of all joints but
+ *         the first TUNED_JOINTS. time/joint is per joint of the model, max/min_joints the most/fewest joints computed
+ *         on one tick of the schedule
+ */
+static void BM_UpdateMultiRate( benchmark::State &state ) {
+	int joints = state.range( 0 );
+	int divider = state.range( 1 );
+	BenchEngine bench( joints, MODE_MIXED, divider );
+	JointEngine &e = bench.engine_;
+
+	for( auto _ : state )
+		e.update( DT );
+	setCounters( state, joints );
+
+	int max_joints = 0;
+	int min_joints = joints;
+	for( int t=0; t<divider; t++ ) {
+		int n = e.scheduledJoints( t );
+		max_joints = n > max_joints ? n : max_joints;
+		min_joints = n < min_joints ? n : min_joints;
+	}
+	state.counters["max_joints"] = max_joints;
+	state.counters["min_joints"] = min_joints;
+}
+
+
+/** @brief one controller tick with gain schedules on all joints. args: joint count, mode, table axes (0: scheduler
+ *         without tables, 1: angle, 2: angle x desired velocity). compare with BM_Update for the cost of the lookup
+ */
+static void BM_UpdateScheduled( benchmark::State &state ) {
+	int joints = state.range( 0 );
+	int dims = state.range( 2 );
+	BenchEngine bench( joints, state.range( 1 ) );
+	GainScheduler scheduler;
+	scheduler.configure( joints );
+	for( int i=0; dims>0 && i<joints; i++ )
+		scheduler.set( i, benchTable( dims ) );
+	bench.engine_.setGainScheduler( &scheduler );
+
+	for( auto _ : state ) {
+		bench.engine_.update( DT );
+		benchmark::DoNotOptimize( bench.engine_.force_.data() );
+	}
+	setCounters( state, joints );
+}
+
+
+/** @brief only the lookup of the gain schedule (GainScheduler::apply) of all joints, angles and desired velocities held
+ *         after 100 ticks, so all joints stay in their cell (the common case). args: joint count, mode, table axes,
+ *         every how many-th joint has a table
+ */
+static void BM_GainLookup( benchmark::State &state ) {
+	int joints = state.range( 0 );
+	int dims = state.range( 2 );
+	BenchEngine bench( joints, state.range( 1 ) );
+	GainScheduler scheduler;
+	scheduler.configure( joints );
+	for( int i=0; i<joints; i+=state.range( 3 ) )
+		scheduler.set( i, benchTable( dims ) );
+	bench.engine_.setGainScheduler( &scheduler );
+	for( int t=0; t<100; t++ )
+		bench.engine_.update( DT );
+
+	JointEngine &e = bench.engine_;
+	PidBatch b = e.batch();
+	for( auto _ : state ) {
+		scheduler.update();
+		scheduler.apply( b, DT, 0, joints, e.p_gain_.data(), e.i_gain_.data(), e.d_gain_.data() );
+		benchmark::DoNotOptimize( e.p_gain_.data() );
+	}
+	setCounters( state, joints );
+}
+
+
+/// @brief one tick of the physics thread as in ModelPIDJoint (see BenchTick). args: joint count
+static void BM_Tick( benchmark::State &state ) {
+	int joints = state.range( 0 );
+	BenchTick bench( joints );
+
+	for( auto _ : state ) {
+		bench.callbacks();
+		bench.tick();
+	}
+	setCounters( state, joints );
+}
+
+
+/// @brief the models of BM_Models, computed by the tasks of the worker pool
+struct BenchModels {
+	std::vector< BenchEngine* > models;
+	std::vector< EpisodeStats* > episodes;
+	double now;
+};
+
+
+/// @brief task of the worker pool: compute and accumulate one model (as ModelPIDJoint::computeUpdate)
+static void computeModel( void *context, int index ) {
+	BenchModels *b = static_cast< BenchModels* >( context );
+	JointEngine &e = b->models[index]->engine_;
+	e.compute( DT );
+	b->episodes[index]->accumulate( b->now, e.desired_.data(), e.angle_.data(), e.velocity_.data(), e.desired_velocity_.data() );
+}
+
+
+/** @brief one tick of many models as in the controller manager: read all models, compute all models on the worker pool,
+ *         write all models. args: models (24 joints each, mixed modes), worker threads
+ */
+static void BM_Models( benchmark::State &state ) {
+	int models = state.range( 0 );
+	BenchModels b;
+	b.now = 0.0;
+	for( int m=0; m<models; m++ ) {
+		b.models.push_back( new BenchEngine( 24, MODE_MIXED ) );
+		b.episodes.push_back( new EpisodeStats() );
+		b.episodes[m]->configure( 24, 0.0 );
+	}
+	WorkerPool pool;
+	pool.start( state.range( 1 ), 50 );
+	
+	for( auto _ : state ) {
+		b.now += DT;
+		for( int m=0; m<models; m++ )
+			b.models[m]->engine_.read( DT );
+		pool.run( models, &computeModel, &b );
+		for( int m=0; m<models; m++ )
+			b.models[m]->engine_.write();
+	}
+	setCounters( state, models * 24 );
+	
+	pool.stop();
+	for( int m=0; m<models; m++ ) {
+		delete b.models[m];
+		delete b.episodes[m];
+	}
+}
+
+
+/// @brief joint counts (one leg up to many models) x modes (4 fixed modes, mixed and mixed with the discrete form)
+static void jointsAndModes( benchmark::internal::Benchmark *b ) {
+	static const int joints[] = { 1, 3, 8, 24, 64, 256, 1024 };
+	for( int mode=0; mode<=MODE_DISCRETE; mode++ ) {
+		for( int n=0; n<sizeof(joints)/sizeof(joints[0]); n++ )
+			b->Args( { joints[n], mode } );
+	}
+	b->ArgNames( { "joints", "mode" } );
+}
+
+
+BENCHMARK( BM_Update )->Apply( jointsAndModes );
+BENCHMARK( BM_UpdateAccumulate )->Apply( jointsAndModes );
+BENCHMARK( BM_UpdateMultiRate )->ArgsProduct( { { 24, 256, 1024 }, { 1, 2, 4, 8, 16 } } )->ArgNames( { "joints", "divider" } );
+BENCHMARK( BM_UpdateScheduled )->ArgsProduct( { { 24, 256, 1024 }, { 0, MODE_MIXED, MODE_DISCRETE }, { 0, 1, 2 } } )
+	->ArgNames( { "joints", "mode", "dims" } );
+BENCHMARK( BM_GainLookup )->ArgsProduct( { { 24, 256, 1024 }, { MODE_MIXED, MODE_DISCRETE }, { 1, 2 }, { 1, 3 } } )
+	->ArgNames( { "joints", "mode", "dims", "every" } );
+BENCHMARK( BM_Tick )->Arg( 24 )->Arg( 256 )->ArgName( "joints" );
+BENCHMARK( BM_Models )->ArgsProduct( { { 1, 10, 20, 40 }, { 0, 1, 3, 7, 15 } } )->ArgNames( { "models", "threads" } )->UseRealTime();
+
+BENCHMARK_MAIN();
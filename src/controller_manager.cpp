@@ -0,0 +1,84 @@
+#include "../include/gazebo_crab_plugin/controller_manager.hpp"
+#include "../include/gazebo_crab_plugin/gazebo_crab_plugin.hpp"
+
+// C++ headers
+#include <map>
+#include <algorithm>
+
+
+
+
+namespace gazebo {
+	
+	
+	/// @brief the managers by world name. the models and the world plugin own the managers, the registry only finds them
+	static std::map< std::string, std::weak_ptr< ControllerManager > >& registry() {
+		static std::map< std::string, std::weak_ptr< ControllerManager > > managers;
+		return managers;
+	}
+	
+	
+	/// @brief serializes the registry
+	static std::mutex registry_mutex;
+	
+	
+	std::shared_ptr< ControllerManager > ControllerManager::create( const std::string &world ) {
+		std::shared_ptr< ControllerManager > manager( new ControllerManager() );
+		std::lock_guard<std::mutex> lock( registry_mutex );
+		registry()[world] = manager;
+		return manager;
+	}
+	
+	
+	std::shared_ptr< ControllerManager > ControllerManager::find( const std::string &world ) {
+		std::lock_guard<std::mutex> lock( registry_mutex );
+		std::map< std::string, std::weak_ptr< ControllerManager > >::iterator it = registry().find( world );
+		if( it == registry().end() )
+			return std::shared_ptr< ControllerManager >();
+		return it->second.lock();
+	}
+	
+	
+	void ControllerManager::attach( ModelPIDJoint *model ) {
+		std::lock_guard<std::mutex> lock( mutex_ );
+		models_.push_back( model );
+	}
+	
+	
+	void ControllerManager::detach( ModelPIDJoint *model ) {
+		std::lock_guard<std::mutex> lock( mutex_ );
+		models_.erase( std::remove( models_.begin(), models_.end(), model ), models_.end() );
+	}
+	
+	
+	void ControllerManager::setThreads( int threads, int spin ) {
+		std::lock_guard<std::mutex> lock( mutex_ );
+		pool_.start( threads, spin );
+	}
+	
+	
+	void ControllerManager::update( const common::UpdateInfo &info ) {
+		std::lock_guard<std::mutex> lock( mutex_ );
+		for( int m=0; m<models_.size(); m++ )
+			models_[m]->prepareUpdate( info );
+		
+		// run() returns when all models are computed (barrier before the forces are applied)
+		pool_.run( models_.size(), &ControllerManager::computeTask, this );
+		
+		for( int m=0; m<models_.size(); m++ )
+			models_[m]->finishUpdate();
+	}
+	
+	
+	void ControllerManager::computeTask( void *context, int index ) {
+		static_cast< ControllerManager* >( context )->models_[index]->computeUpdate();
+	}
+	
+	
+	int ControllerManager::size() {
+		std::lock_guard<std::mutex> lock( mutex_ );
+		return models_.size();
+	}
+	
+	
+}	// end of namespace 'gazebo'
@@ -0,0 +1,54 @@
+#include "../include/gazebo_crab_plugin/episode_stats.hpp"
+
+// C++ headers
+#include <math.h>
+
+
+
+
+namespace gazebo {
+
+
+	void EpisodeStats::configure( int joints, double warmup ) {
+		joints_ = joints;
+		warmup_ = warmup;
+		start_.assign( joints, 0.0 );
+		warm_until_.assign( joints, warmup );
+		count_.assign( joints, 0 );
+		velocity_sq_sum_.assign( joints, 0.0 );
+		angle_sq_sum_.assign( joints, 0.0 );
+		velocity_max_.assign( joints, 0.0 );
+		angle_max_.assign( joints, 0.0 );
+	}
+
+
+	void EpisodeStats::start( int j, double now ) {
+		start_[j] = now;
+		warm_until_[j] = now + warmup_;
+		count_[j] = 0;
+		velocity_sq_sum_[j] = 0.0;
+		angle_sq_sum_[j] = 0.0;
+		velocity_max_[j] = 0.0;
+		angle_max_[j] = 0.0;
+	}
+
+
+	void EpisodeStats::accumulate( double now, const double *desired, const double *angle, const double *velocity,
+			const double *desired_velocity ) {
+		for( int j=0; j<joints_; j++ ) {
+			if( now < warm_until_[j] )
+				continue;
+
+			// same error definitions as the telemetry topics
+			double velocity_error = velocity[j] - desired_velocity[j];
+			double angle_error = desired[j] - angle[j];
+			velocity_sq_sum_[j] += velocity_error * velocity_error;
+			angle_sq_sum_[j] += angle_error * angle_error;
+			velocity_max_[j] = fmax( velocity_max_[j], fabs( velocity_error ) );
+			angle_max_[j] = fmax( angle_max_[j], fabs( angle_error ) );
+			count_[j]++;
+		}
+	}
+
+
+}	// end of namespace 'gazebo'
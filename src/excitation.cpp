@@ -0,0 +1,243 @@
+#include "../include/gazebo_crab_plugin/excitation.hpp"
+
+// C++ headers
+#include <math.h>
+
+
+
+
+namespace gazebo {
+
+
+	/// @brief splitmix64: advances 'state' and returns the next random number
+	static uint64_t nextRandom( uint64_t &state ) {
+		uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+
+
+	/// @brief uniformly distributed random number in [-1, 1)
+	static double uniform( uint64_t &state ) {
+		return (nextRandom( state ) >> 11) * (2.0 / 9007199254740992.0) - 1.0;
+	}
+
+
+	/// @brief fnv-1a hash of a string (independent of the platform, unlike std::hash)
+	static uint64_t hashName( const std::string &name ) {
+		uint64_t hash = 0xCBF29CE484222325ULL;
+		for( size_t n=0; n<name.size(); n++ )
+			hash = (hash ^ (unsigned char)name[n]) * 0x100000001B3ULL;
+		return hash;
+	}
+
+
+	ExcitationGenerator::~ExcitationGenerator() {
+		for( int j=0; j<joints_; j++ ) {
+			delete pending_[j].exchange( NULL );
+			delete retired_[j].exchange( NULL );
+			delete state_[j].signal;
+		}
+		delete[] pending_;
+		delete[] retired_;
+	}
+
+
+	void ExcitationGenerator::configure( const std::vector< std::string > &names, uint32_t seed ) {
+		joints_ = names.size();
+		seed_ = seed;
+
+		name_hash_.resize( joints_ );
+		for( int j=0; j<joints_; j++ )
+			name_hash_[j] = hashName( names[j] );
+
+		pending_ = new std::atomic< ExcitationSignal* >[joints_];
+		retired_ = new std::atomic< ExcitationSignal* >[joints_];
+		for( int j=0; j<joints_; j++ ) {
+			pending_[j].store( NULL );
+			retired_[j].store( NULL );
+		}
+
+		State empty = { NULL, -1.0, 0, 0.0, 0, 0 };
+		state_.assign( joints_, empty );
+		active_count_ = 0;
+	}
+
+
+	int ExcitationGenerator::parseType( const std::string &name ) {
+		if( name == "off" )
+			return OFF;
+		if( name == "steps" )
+			return STEPS;
+		if( name == "chirp" )
+			return CHIRP;
+		if( name == "prbs" )
+			return PRBS;
+		if( name == "sweep" )
+			return SWEEP;
+		return -1;
+	}
+
+
+	const char* ExcitationGenerator::check( const ExcitationSignal &signal ) {
+		switch( signal.type ) {
+			case OFF:
+				return NULL;
+			case STEPS:
+			case PRBS:
+				if( !(signal.hold > 0.0) )
+					return "the hold time has to be > 0";
+				return NULL;
+			case CHIRP:
+			case SWEEP:
+				if( !(signal.duration > 0.0) )
+					return "the duration has to be > 0";
+				if( signal.type == SWEEP  &&  !(signal.f0 > 0.0 && signal.f1 > 0.0) )
+					return "the frequencies have to be > 0";
+				return NULL;
+			default:
+				return "unknown signal type";
+		}
+	}
+
+
+	void ExcitationGenerator::set( int j, const ExcitationSignal &signal ) {
+		delete retired_[j].exchange( NULL, std::memory_order_acq_rel );		// replaced by the reader before
+		delete pending_[j].exchange( new ExcitationSignal(signal), std::memory_order_acq_rel );		// never seen by the reader
+		version_.fetch_add( 1, std::memory_order_release );
+	}
+
+
+	void ExcitationGenerator::update( double now, double *desired ) {
+		// pick up the new signals
+		unsigned int version = version_.load( std::memory_order_acquire );
+		if( version != applied_version_ ) {
+			applied_version_ = version;
+			for( int j=0; j<joints_; j++ ) {
+				ExcitationSignal *signal = pending_[j].exchange( NULL, std::memory_order_acq_rel );
+				if( !signal )
+					continue;
+
+				// the old signal is retired (freed by the next set(), or here if a set() raced with the last pick-up).
+				// a signal of type OFF is kept as the signal of the joint, so that it is retired like any other
+				State &st = state_[j];
+				if( st.signal  &&  !isinf( st.start ) )
+					active_count_--;
+				if( st.signal )
+					delete retired_[j].exchange( st.signal, std::memory_order_acq_rel );
+				st.signal = signal;
+				if( signal->type == OFF ) {
+					st.start = INFINITY;
+					continue;
+				}
+				st.start = -1.0;
+				active_count_++;
+			}
+		}
+
+		// all signals (also the ones that ended) start from the beginning
+		if( restart_ ) {
+			restart_ = false;
+			active_count_ = 0;
+			for( int j=0; j<joints_; j++ ) {
+				if( !state_[j].signal  ||  state_[j].signal->type == OFF )
+					continue;
+				state_[j].start = -1.0;
+				active_count_++;
+			}
+		}
+
+		if( !active_count_ )
+			return;
+
+		for( int j=0; j<joints_; j++ ) {
+			State &st = state_[j];
+			if( !st.signal  ||  isinf( st.start ) )
+				continue;
+			if( st.start < 0.0 )
+				start( j, now );
+
+			// a repeated signal starts over after every pass, a single pass ends with the offset
+			double t = now - st.start;
+			double duration = st.signal->duration;
+			if( duration > 0.0  &&  t >= duration ) {
+				if( st.signal->repeat ) {
+					start( j, st.start + floor( t / duration ) * duration );
+					t = now - st.start;
+				} else {
+					desired[j] = st.signal->offset;
+					st.start = INFINITY;		// ended, until the next restart()
+					active_count_--;
+					continue;
+				}
+			}
+
+			desired[j] = st.signal->offset + sample( j, t );
+		}
+	}
+
+
+	void ExcitationGenerator::start( int j, double now ) {
+		State &st = state_[j];
+		uint64_t seed = jointSeed( j, *st.signal );
+		st.start = now;
+		st.step = -1;
+		st.level = 0.0;
+		st.random = seed;
+		st.lfsr = (uint32_t)(nextRandom( seed ) >> 33) & 0x7FFFFFFF;
+		if( !st.lfsr )
+			st.lfsr = 1;
+	}
+
+
+	double ExcitationGenerator::sample( int j, double t ) {
+		State &st = state_[j];
+		const ExcitationSignal &s = *st.signal;
+
+		switch( s.type ) {
+			case STEPS:
+			case PRBS: {
+				// the levels only depend on the number of levels since the start, not on the tick rate. the tolerance keeps
+				// rounding errors of the time from moving a switch by one tick
+				int64_t step = (int64_t)floor( t / s.hold + 1e-9 );
+				while( st.step < step ) {
+					st.step++;
+					if( s.type == PRBS ) {
+						// maximum length sequence of x^31 + x^28 + 1
+						st.level = (st.lfsr & 1) ? s.amplitude : -s.amplitude;
+						uint32_t bit = (st.lfsr ^ (st.lfsr >> 3)) & 1;
+						st.lfsr = (st.lfsr >> 1) | (bit << 30);
+					} else if( s.levels.empty() ) {
+						st.level = s.amplitude * uniform( st.random );
+					} else {
+						st.level = s.levels[st.step % s.levels.size()];
+					}
+				}
+				return st.level;
+			}
+
+			case CHIRP: {
+				double phase = 2*M_PI * (s.f0 * t + (s.f1 - s.f0) * t * t / (2 * s.duration));
+				return s.amplitude * sin( phase );
+			}
+
+			case SWEEP: {
+				double k = log( s.f1 / s.f0 );
+				double phase = fabs( k ) < 1e-12 ? 2*M_PI * s.f0 * t : 2*M_PI * s.f0 * s.duration / k * (exp( t * k / s.duration ) - 1);
+				return s.amplitude * sin( phase );
+			}
+
+			default:
+				return 0.0;
+		}
+	}
+
+
+	uint64_t ExcitationGenerator::jointSeed( int j, const ExcitationSignal &signal ) const {
+		uint64_t state = (uint64_t)(signal.seed ? signal.seed : seed_) ^ name_hash_[j];
+		return nextRandom( state );
+	}
+
+
+}	// end of namespace 'gazebo'
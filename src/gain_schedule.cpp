@@ -0,0 +1,290 @@
+#include "../include/gazebo_crab_plugin/gain_schedule.hpp"
+
+// C++ headers
+#include <math.h>
+#include <limits>
+
+
+
+
+namespace gazebo {
+
+
+	/// @brief same as in pid_kernel (minsd/maxsd, no branch)
+	static inline double min_sd( double a, double b ) { return a < b ? a : b; }
+	static inline double max_sd( double a, double b ) { return a > b ? a : b; }
+
+
+	/// @brief an interval of one axis of a table: grid points 'low' and 'high', bounds [lo, hi) and the inverse width
+	struct Interval {
+		int low, high;
+		double lo, hi;
+		double slope;
+	};
+
+
+	/** @brief the interval of 'x' on an axis with 'n' breakpoints, searched from 'index' (the interval of the last
+	 *         lookup, updated). beyond the outermost breakpoints and on an axis with less than two breakpoints the
+	 *         interval is constant (slope 0) and unbounded on the outer side
+	 */
+	static Interval interval( const double *axis, int n, double x, int &index ) {
+		const double INF = std::numeric_limits< double >::infinity();
+		Interval in;
+		if( n < 2 ) {
+			in.low = in.high = 0;
+			in.lo = -INF;
+			in.hi = INF;
+			in.slope = 0.0;
+			return in;
+		}
+		if( x < axis[0] ) {
+			in.low = in.high = 0;
+			in.lo = -INF;
+			in.hi = axis[0];
+			in.slope = 0.0;
+			return in;
+		}
+		if( x >= axis[n-1] ) {
+			in.low = in.high = n-1;
+			in.lo = axis[n-1];
+			in.hi = INF;
+			in.slope = 0.0;
+			return in;
+		}
+
+		index = index < 0 ? 0 : (index > n-2 ? n-2 : index);
+		while( x < axis[index] )
+			index--;
+		while( x >= axis[index+1] )
+			index++;
+		in.low = index;
+		in.high = index + 1;
+		in.lo = axis[index];
+		in.hi = axis[index+1];
+		in.slope = 1.0 / (in.hi - in.lo);
+		return in;
+	}
+
+
+	GainScheduler::~GainScheduler() {
+		for( int j=0; j<joints_; j++ ) {
+			delete pending_[j].exchange( NULL );
+			delete retired_[j].exchange( NULL );
+			delete state_[j].schedule;
+		}
+		delete[] pending_;
+		delete[] retired_;
+	}
+
+
+	void GainScheduler::configure( int joints ) {
+		joints_ = joints;
+
+		pending_ = new std::atomic< Schedule* >[joints_];
+		retired_ = new std::atomic< Schedule* >[joints_];
+		for( int j=0; j<joints_; j++ ) {
+			pending_[j].store( NULL );
+			retired_[j].store( NULL );
+		}
+
+		State empty = { NULL, 0, 0 };
+		state_.assign( joints_, empty );
+		angle_lo_.assign( joints_, 0.0 );
+		angle_hi_.assign( joints_, 0.0 );
+		velocity_lo_.assign( joints_, 0.0 );
+		velocity_hi_.assign( joints_, 0.0 );
+		for( int k=0; k<4; k++ ) {
+			p_k_[k].assign( joints_, 0.0 );
+			i_k_[k].assign( joints_, 0.0 );
+			d_k_[k].assign( joints_, 0.0 );
+		}
+		scheduled_.assign( joints_, 0.0 );
+		scheduled_before_.assign( joints_ + 1, 0 );
+		active_count_ = 0;
+		for( int j=0; j<joints_; j++ )
+			resetCell( j, false );
+
+		cells_.angle_lo = angle_lo_.data();
+		cells_.angle_hi = angle_hi_.data();
+		cells_.velocity_lo = velocity_lo_.data();
+		cells_.velocity_hi = velocity_hi_.data();
+		for( int k=0; k<4; k++ ) {
+			cells_.p[k] = p_k_[k].data();
+			cells_.i[k] = i_k_[k].data();
+			cells_.d[k] = d_k_[k].data();
+		}
+		cells_.scheduled = scheduled_.data();
+		outside_.assign( joints_, 0 );
+	}
+
+
+	void GainScheduler::resetCell( int j, bool scheduled ) {
+		const double NaN = std::numeric_limits< double >::quiet_NaN();
+		const double INF = std::numeric_limits< double >::infinity();
+		angle_lo_[j] = velocity_lo_[j] = scheduled ? NaN : -INF;
+		angle_hi_[j] = velocity_hi_[j] = scheduled ? NaN : INF;
+		for( int k=0; k<4; k++ )
+			p_k_[k][j] = i_k_[k][j] = d_k_[k][j] = 0.0;
+	}
+
+
+	const char* GainScheduler::check( const GainTable &table ) {
+		if( table.angle.empty()  &&  table.velocity.empty()  &&  table.p_gain.empty()  &&  table.i_gain.empty()
+				&&  table.d_gain.empty() )
+			return NULL;
+
+		const std::vector< double > *axes[2] = { &table.angle, &table.velocity };
+		for( int a=0; a<2; a++ ) {
+			const std::vector< double > &axis = *axes[a];
+			if( axis.size() > MAX_POINTS )
+				return "too many breakpoints";
+			for( int n=0; n<axis.size(); n++ ) {
+				if( !isfinite( axis[n] ) )
+					return "breakpoint is not finite";
+				if( n > 0  &&  !(axis[n] > axis[n-1]) )
+					return "breakpoints are not ascending";
+			}
+		}
+
+		size_t points = (table.angle.empty() ? 1 : table.angle.size()) * (table.velocity.empty() ? 1 : table.velocity.size());
+		const std::vector< double > *gains[3] = { &table.p_gain, &table.i_gain, &table.d_gain };
+		for( int g=0; g<3; g++ ) {
+			if( gains[g]->size() != points )
+				return "number of gains does not match the breakpoints";
+			for( int n=0; n<points; n++ ) {
+				if( !isfinite( (*gains[g])[n] ) )
+					return "gain is not finite";
+			}
+		}
+		return NULL;
+	}
+
+
+	void GainScheduler::set( int j, const GainTable &table ) {
+		Schedule *schedule = new Schedule();
+		schedule->n_angle = table.angle.size();
+		schedule->n_velocity = table.velocity.size();
+		if( !table.p_gain.empty() ) {
+			schedule->data.insert( schedule->data.end(), table.angle.begin(), table.angle.end() );
+			schedule->data.insert( schedule->data.end(), table.velocity.begin(), table.velocity.end() );
+			for( int n=0; n<table.p_gain.size(); n++ ) {
+				schedule->data.push_back( table.p_gain[n] );
+				schedule->data.push_back( table.i_gain[n] );
+				schedule->data.push_back( table.d_gain[n] );
+			}
+		}
+
+		delete retired_[j].exchange( NULL, std::memory_order_acq_rel );			// replaced by the reader before
+		delete pending_[j].exchange( schedule, std::memory_order_acq_rel );		// never seen by the reader
+		version_.fetch_add( 1, std::memory_order_release );
+	}
+
+
+	void GainScheduler::update() {
+		unsigned int version = version_.load( std::memory_order_acquire );
+		if( version == applied_version_ )
+			return;
+		applied_version_ = version;
+
+		bool changed = false;
+		for( int j=0; j<joints_; j++ ) {
+			Schedule *schedule = pending_[j].exchange( NULL, std::memory_order_acq_rel );
+			if( !schedule )
+				continue;
+
+			// the old table is retired (freed by the next set(), or here if a set() raced with the last pick-up). an
+			// empty table is kept as the table of the joint, so that it is retired like any other
+			State &st = state_[j];
+			if( st.schedule )
+				delete retired_[j].exchange( st.schedule, std::memory_order_acq_rel );
+			st.schedule = schedule;
+			st.angle_index = 0;
+			st.velocity_index = 0;
+
+			bool scheduled = !schedule->data.empty();
+			active_count_ += scheduled - (scheduled_[j] > 0.0);
+			changed |= scheduled != (scheduled_[j] > 0.0);
+			scheduled_[j] = scheduled ? 1.0 : 0.0;
+
+			// no valid cell (the next lookup locates the joint in the new table), or an unbounded one without a table
+			resetCell( j, scheduled );
+		}
+
+		for( int j=0; changed && j<joints_; j++ )
+			scheduled_before_[j+1] = scheduled_before_[j] + (scheduled_[j] > 0.0);
+	}
+
+
+	void GainScheduler::locate( int j, double angle, double velocity ) {
+		State &st = state_[j];
+		const Schedule &s = *st.schedule;
+		const double *angle_axis = s.data.data();
+		const double *velocity_axis = angle_axis + s.n_angle;
+		const double *grid = velocity_axis + s.n_velocity;
+
+		Interval a = interval( angle_axis, s.n_angle, angle, st.angle_index );
+		Interval v = interval( velocity_axis, s.n_velocity, velocity, st.velocity_index );
+
+		angle_lo_[j] = a.lo;
+		angle_hi_[j] = a.hi;
+		velocity_lo_[j] = v.lo;
+		velocity_hi_[j] = v.hi;
+
+		// the bilinear interpolation between the corners of the cell, c0 + c1 u + c2 w + c3 u w with the offsets u, w from
+		// the low corner, expanded into a polynomial of the angle and the velocity. the origin of a constant interval is
+		// its finite bound (its slope is 0, so any finite origin gives the same result)
+		int row = 3 * (s.n_velocity > 0 ? s.n_velocity : 1);
+		const double *g00 = grid + a.low * row + 3 * v.low;
+		const double *g01 = grid + a.low * row + 3 * v.high;
+		const double *g10 = grid + a.high * row + 3 * v.low;
+		const double *g11 = grid + a.high * row + 3 * v.high;
+		double a0 = a.slope > 0.0 ? a.lo : 0.0;
+		double v0 = v.slope > 0.0 ? v.lo : 0.0;
+		std::vector< double > *k[3] = { p_k_, i_k_, d_k_ };
+		for( int g=0; g<3; g++ ) {
+			double c0 = g00[g];
+			double c1 = a.slope * (g10[g] - g00[g]);
+			double c2 = v.slope * (g01[g] - g00[g]);
+			double c3 = a.slope * v.slope * (g11[g] - g10[g] - g01[g] + g00[g]);
+			k[g][0][j] = c0 - c1 * a0 - c2 * v0 + c3 * a0 * v0;
+			k[g][1][j] = c1 - c3 * v0;
+			k[g][2][j] = c2 - c3 * a0;
+			k[g][3][j] = c3;
+		}
+	}
+
+
+	void GainScheduler::apply( const PidBatch &b, double dt, int begin, int end, double *p_gain, double *i_gain,
+			double *d_gain ) {
+		if( scheduled_before_[end] == scheduled_before_[begin] )
+			return;
+
+		// all joints, one pass without branches
+		int groups = pid_kernel::scheduleGains( b, cells_, dt, begin, end, p_gain, i_gain, d_gain, outside_.data() );
+
+		// the groups with a joint that left its cell (rare): the same keys as pid_kernel::scheduleGains(), the new cell
+		// and the gains again
+		const double inv_dt = dt > 0.0 ? 1.0 / dt : 0.0;
+		for( int n=0; n<groups; n++ ) {
+			int last = outside_[n] + pid_kernel::GAIN_GROUP < end ? outside_[n] + pid_kernel::GAIN_GROUP : end;
+			for( int j=outside_[n]; j<last; j++ ) {
+				double angle = b.angle[j];
+				double velocity = b.damping[j] * (b.desired[j] - angle) * inv_dt;
+				velocity = min_sd( max_sd( velocity, -b.max_velocity[j] ), b.max_velocity[j] );
+				angle = angle - angle == 0.0 ? angle : 0.0;
+				if( !(scheduled_[j] > 0.0)  ||  ((angle_lo_[j] <= angle) & (angle < angle_hi_[j])
+						& (velocity_lo_[j] <= velocity) & (velocity < velocity_hi_[j])) )
+					continue;
+
+				locate( j, angle, velocity );
+				double cross = angle * velocity;
+				p_gain[j] = p_k_[0][j] + p_k_[1][j] * angle + p_k_[2][j] * velocity + p_k_[3][j] * cross;
+				i_gain[j] = i_k_[0][j] + i_k_[1][j] * angle + i_k_[2][j] * velocity + i_k_[3][j] * cross;
+				d_gain[j] = d_k_[0][j] + d_k_[1][j] * angle + d_k_[2][j] * velocity + d_k_[3][j] * cross;
+				pid_kernel::gainCoefficients( b, dt, j );
+			}
+		}
+	}
+
+
+}	// end of namespace 'gazebo'
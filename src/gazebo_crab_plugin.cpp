@@ -29,8 +29,7 @@
 #include <string>
 #include <vector>
 #include <iostream>
-#include <fstream>
-#include <boost/filesystem.hpp>
+#include <mutex>
 
 
 namespace gazebo {
@@ -45,27 +44,49 @@ namespace gazebo {
 	
 	
 	
+	/** @brief cold per-joint data: ros topics, dynamic reconfigure server and log file. the controller state itself (the
+	 *         values that are used on every tick) is stored in the JointEngine of the parent, at index index_
+	 * 
+	 * @note the ros callbacks never write to the engine. they modify params_ (under params_mutex_) and publish a copy
+	 *       through handoff_, which is picked up by the physics thread at the next tick
+	 */
 	class PidJoint {
 		public:
-			PidJoint( ModelPIDJoint *parent, gazebo::physics::Joint &joint ) :
-				ready_(false), joint_(&joint), desired_value_(0), save_to_file_(false),
-				past_index_(0), joint_velocity_(0), joint_max_force_(5.0), joint_max_velocity_(2*M_PI),
-				joint_desired_velocity_(0), joint_delta_force_(0), joint_angle_(0), joint_force_(0),
-				update_type_(1), input_type_(0), reset_(false) {
+			/** @brief creates the controller of a joint. 'config' are the initial parameters from the joint list (see
+			 *         readJointConfigs()), or NULL if the joint is not configured
+			 */
+			PidJoint( ModelPIDJoint *parent, gazebo::physics::Joint &joint, const JointParams *config ) :
+				parent_(parent), handoff_(parent->getEngine()->paramVersion()), joint_(&joint), save_to_file_(parent->logToFile()) {
 				
-				parent_ = parent;
 				nh_ = parent_->getNH();
-				// load some default values. the real values (possibly default defined in the cfg file) are loaded
-				// through the dynamic reconfigure callback
-				if( joint_->GetName() == "joint_3" ) {
-					pid_.initPid( 0.275515, 0.000757, 0.04958, 0.1, -0.1 );
-					joint_max_velocity_ = 0.0124;
-					velocity_damping_ = 0.0045;
-				} else {
-					pid_.initPid( 0.1724, 0.0011, 0.02, 0.04, -0.04 );
-					joint_max_velocity_ = 0.990884;
-					velocity_damping_ = 0.0890248;
+				engine_ = parent_->getEngine();
+				index_ = parent_->addJoint( joint_, &handoff_ );
+				
+				// the parameters of the reconfigure config (gains, velocity and multiplier) are loaded through the dynamic
+				// reconfigure callback below. configured values are written to the parameter server first, so that the
+				// callback loads them instead of the defaults of the cfg file
+				if( config ) {
+					params_ = *config;
+					writeReconfigureValues();
 				}
+				handoff_.publish( params_, ParamHandoff::SET_DESIRED );
+				
+				// the dynamic reconfigure server is created on demand (see enableReconfigure()), because every server
+				// advertises services and topics. without a server the joint loads the same values as the server would
+				dyn_reconf_server_ = NULL;
+				if( parent_->reconfigureAtStartup( joint_->GetName() ) )
+					enableReconfigure();
+				else
+					loadReconfigureValues();
+				
+				startup();
+			};
+			
+			/// @brief creates the dynamic reconfigure server of the joint (<joint>_dyn), if it does not exist yet
+			void enableReconfigure() {
+				std::lock_guard<std::mutex> lock( dyn_mutex_ );
+				if( dyn_reconf_server_ )
+					return;
 				
 				ros::NodeHandle dyn_nh = ros::NodeHandle( *nh_, joint_->GetName() + "_dyn" );
 				dyn_reconf_server_ = new dynamic_reconfigure::Server<gazebo_crab_plugin::dyn_paramsConfig>( dyn_nh );
@@ -73,51 +94,70 @@ namespace gazebo {
 				
 				f = boost::bind( &callback, _1, _2, this );
 				dyn_reconf_server_->setCallback( f );
-
-				
-				startup();
-			};
+			}
+			
+			/** @brief applies the values that the dynamic reconfigure server would load (parameter server or defaults of
+			 *         the cfg file) without creating the server
+			 */
+			void loadReconfigureValues() {
+				ros::NodeHandle dyn_nh = ros::NodeHandle( *nh_, joint_->GetName() + "_dyn" );
+				gazebo_crab_plugin::dyn_paramsConfig config = gazebo_crab_plugin::dyn_paramsConfig::__getDefault__();
+				config.__fromServer__( dyn_nh );
+				config.__clamp__();
+				callback( config, ~0, this );
+			}
+			
+			/// @brief writes the reconfigurable values of params_ to the parameter server (namespace <joint>_dyn)
+			void writeReconfigureValues() {
+				ros::NodeHandle dyn_nh = ros::NodeHandle( *nh_, joint_->GetName() + "_dyn" );
+				dyn_nh.setParam( "p_gain", params_.p_gain );
+				dyn_nh.setParam( "i_gain", params_.i_gain );
+				dyn_nh.setParam( "d_gain", params_.d_gain );
+				dyn_nh.setParam( "i_clamp_max", params_.i_max );
+				dyn_nh.setParam( "i_clamp_min", params_.i_min );
+				dyn_nh.setParam( "velocity_max", params_.max_velocity );
+				dyn_nh.setParam( "velocity_damping", params_.damping );
+				dyn_nh.setParam( "pid_multiplier", params_.multiplier );
+				dyn_nh.setParam( "pid_form", params_.pid_form );
+				dyn_nh.setParam( "anti_windup", params_.anti_windup );
+				dyn_nh.setParam( "d_filter", params_.d_filter );
+				dyn_nh.setParam( "tracking_time", params_.tracking_time );
+				dyn_nh.setParam( "velocity_estimator", params_.velocity_estimator );
+				dyn_nh.setParam( "velocity_taps", params_.velocity_taps );
+				dyn_nh.setParam( "velocity_alpha", params_.velocity_alpha );
+				dyn_nh.setParam( "rate_divider", params_.rate_divider );
+			}
+			
+			/// @brief the name of the joint
+			std::string name() const { return joint_->GetName(); }
 			
 			/// @brief sets the initial state of the joint and the controller
 			void startup() {
-				/* disabled for now. a log file will be created when we change the parameters via subParamStrCallback
-				if( save_to_file_ ) {
-					std::string path = std::string( "/opt/shared/developer/logs/arm_test/" );
-					boost::filesystem::path dir(path);
-					boost::system::error_code ec;
-					boost::filesystem::create_directories(dir, ec);
-					if( ec ) {
-						//std::cout << "failed to create directory '" << path << "', error=" << ec.message() << std::endl;
-						//ROS_ERROR( "failed to create directory '%s'", path.c_str() );
-					}
-					std::string filename = (std::string("") + (parent_->getNH()->getNamespace().c_str()+1) + "." + joint_->GetName() + ".log");
-					log_file_.open( (path+filename).c_str(), std::ios::out );
-					std::cout << "log file=" << (path+filename) << std::endl;
-				}
-				*/
 				sub_ = nh_->subscribe< std_msgs::Float64 >( joint_->GetName(), 2, &PidJoint::subCallback, this );
 				if( !sub_ )
 					std::cout << "failed to subscribe to joint topic for set commands" << std::endl;
 				sub_param_ = nh_->subscribe< std_msgs::String >( joint_->GetName()+"_str_param", 2, &PidJoint::subParamStrCallback, this );
+				sub_param_msg_ = nh_->subscribe< gazebo_crab_plugin::pid_joint_param >( joint_->GetName()+"_param", 2, &PidJoint::subParamCallback, this );
+				if( !sub_param_msg_ )
+					std::cout << "failed to subscribe to joint topic for parameter messages" << std::endl;
+				
+				if( parent_->perJointTopics() ) {
+					// advertise the pid state topic
+					pub_ = nh_->advertise< gazebo_crab_plugin::pid_joint_state >( joint_->GetName()+"_pid_state", 10 );
+					// advertise the joint error topic
+					pub_err_ = nh_->advertise< gazebo_crab_plugin::pid_joint_error >( joint_->GetName()+"_errors", 10 );
+				}
+				// both topics (and the model topic) are published by the telemetry thread of the model
+				parent_->getTelemetry()->addJoint( joint_->GetName(), pub_, pub_err_ );
 				
-				// advertise the pid state topic
-				pub_ = nh_->advertise< gazebo_crab_plugin::pid_joint_state >( joint_->GetName()+"_pid_state", 10 );
-				// advertise the joint error topic
-				pub_err_ = nh_->advertise< gazebo_crab_plugin::pid_joint_error >( joint_->GetName()+"_errors", 10 );
-					
-				time_last_update_ = ros::Time::now();
-				pid_.reset();
-				past_values_.resize( 4, 0.0 );
-				ready_ = true;
+				handoff_.request( ParamHandoff::RESET_PID );
 			}
 			
 			/// @brief sets the desired state of the joint in radians (double). assumes a rotary joint with a single axis
 			void subCallback( const std_msgs::Float64::ConstPtr &msg ) {
-				double data = msg->data;
-				
-				std::cout << "setting joint " << joint_->GetName() << " to " << data << std::endl;
-				
-				desired_value_ = data;
+				std::lock_guard<std::mutex> lock( params_mutex_ );
+				params_.desired = msg->data;
+				handoff_.publish( params_, ParamHandoff::SET_DESIRED );
 			};
 			
 			/** @brief this function takes a serialized (human-readable string) message and sets the parameters. the parameters
@@ -144,7 +184,7 @@ namespace gazebo {
 					int32   update_type (0=force, 1=delta-force)
 				*/
 				
-				pid_.reset();
+				std::lock_guard<std::mutex> lock( params_mutex_ );
 
 				// split string, convert values to doubles
 				std::stringstream str_stream( str );
@@ -170,31 +210,25 @@ namespace gazebo {
 						case 4:
 							i_min = atof( element.c_str() );
 							std::cout << "setGains(" << p << ", " << i << ", " << d << ", " << i_max << ", " << i_min << ")" << std::endl;
-							pid_.setGains( p, i, d, i_max, i_min );
+							setGains( p, i, d, i_max, i_min );
 							break;
 						case 5:
-							pid_multiplier_ = atof( element.c_str() );
+							params_.multiplier = atof( element.c_str() );
 							break;
 						case 6:
-							joint_max_velocity_ = atof( element.c_str() );
+							params_.max_velocity = atof( element.c_str() );
 							break;
 						case 7:
-							velocity_damping_ = atof( element.c_str() );
+							params_.damping = atof( element.c_str() );
 							break;
 						case 8:
 							reset = atoi( element.c_str() );
-							/*
-							if( reset ) {
-								parent_->resetModel();
-								joint_->Reset();
-							}
-							*/
 							break;
 						case 9:
-							input_type_ = atoi( element.c_str() );
+							params_.input_type = atoi( element.c_str() );
 							break;
 						case 10:
-							update_type_ = atoi( element.c_str() );
+							params_.update_type = atoi( element.c_str() );
 							break;
 						default:
 							// error
@@ -204,509 +238,152 @@ namespace gazebo {
 				
 				// for testing
 				//
+				// note: 'reset' is never parsed (the loop stops after 8 fields), so every parameter string resets the joint.
+				// the model is reset once per tick at most (see ModelPIDJoint::applyResets()), if enabled in the sdf
+				int flags = ParamHandoff::RESET_PID;
 				if( reset || true ) {
-					reset_ = true;
-					//parent_->resetModel();
-					//joint_->Reset();
-					//joint_->SetVelocity( 0, 0.0 );
-					//joint_->SetAngle( 0, 0.0 );
+					flags |= parent_->resetFlags();
 				}
 				//
 				// end of testing
 				
+				// hand the complete parameter set over to the physics thread
+				handoff_.publish( params_, flags );
+				
 				// open a new file to log the new parameters
 				if( save_to_file_ )
 					create_file();
-				
-				/*
-				if( log_file_.is_open() && n>4 ) {
-					// log fields: time, target_angle, current_angle, velocity, error
-					log_file_ << "#" << ros::Time::now()
-						<< " " << p
-						<< " " << i
-						<< " " << d
-						<< " " << i_max
-						<< " " << i_min
-						<< " " << pid_multiplier_
-						<< " " << joint_max_velocity_
-						<< " " << velocity_damping_
-						<< std::endl;
-				}
-				*/
-				
 			};
 			
-			/// @brief sets the desired state of the joint in radians (double). assumes a rotary joint with a single axis
+			/// @brief sets all parameters of the joint from a pid_joint_param message (topic <joint>_param)
 			void subParamCallback( const gazebo_crab_plugin::pid_joint_param::ConstPtr &msg ) {
+				std::lock_guard<std::mutex> lock( params_mutex_ );
+				params_.max_velocity = msg->velocity_max;
+				params_.damping = msg->velocity_damping;
+				params_.multiplier = msg->pid_multiplier;
+				setGains( msg->p_gain, msg->i_gain, msg->d_gain, msg->i_clamp_max, msg->i_clamp_min );
+				params_.input_type = msg->input_type;
+				params_.update_type = msg->update_type;
+				params_.pid_form = msg->pid_form;
+				params_.anti_windup = msg->anti_windup;
+				params_.d_filter = msg->d_filter;
+				params_.tracking_time = msg->tracking_time;
+				params_.velocity_estimator = msg->velocity_estimator;
+				params_.velocity_taps = msg->velocity_taps;
+				params_.velocity_alpha = msg->velocity_alpha;
+				params_.rate_divider = msg->rate_divider;
+				// reset: 0=no reset, 1=reset the joint (and the model, see resetFlags()), 2=reset only this joint
+				int flags = 0;
+				if( msg->reset == 1 )
+					flags = ParamHandoff::RESET_PID | parent_->resetFlags();
+				else if( msg->reset == 2 )
+					flags = ParamHandoff::RESET_PID | ParamHandoff::RESET_JOINT;
+				handoff_.publish( params_, flags );
 				
-				/*
-				std::cout << "setting joint '" << joint_->GetName() << "' params via topic ["
-					<< msg->data << "]"
-					<< std::endl;
-				std::string str = msg->data;
-				*/
-				
-				joint_max_velocity_ = msg->velocity_max;
-				velocity_damping_ = msg->velocity_damping;
-				pid_multiplier_ = msg->pid_multiplier;
-				pid_.setGains( msg->p_gain, msg->i_gain, msg->d_gain, msg->i_clamp_max, msg->i_clamp_min );
-				reset_ = msg->reset;
-				input_type_ = msg->input_type;
-				update_type_ = msg->update_type;
+				// open a new file to log the new parameters
+				if( save_to_file_ )
+					create_file();
 			};
 			
-			double update_input_pos() {
-				double current_angle = joint_->GetAngle( 0 ).Radian();
-				double d_angle = desired_value_ - current_angle;
-				
-				joint_desired_velocity_ = 0.0;
-				
-				return d_angle;
-			}
-			
-			double update_input_vel() {
-				double current_angle = joint_->GetAngle( 0 ).Radian();
-				double d_angle = desired_value_ - current_angle;
-				ros::Time now = ros::Time::now();					// current time
-				ros::Duration dt = now - time_last_update_;			// delta time (now - last update)
-				
-				int last_index = past_index_;
-				past_index_ = (past_index_ + 1) % past_values_.size();
-				past_values_[past_index_] = current_angle;
-				joint_velocity_ = past_values_[past_index_] - past_values_[last_index];
-				
-				// compute our desired velocity
-				//   velocity to reach the target angle with the next tick: d_angle / dt
-				//   we additionally apply a damping factor, so that we would reach the desired angle in dt/damping_factor seconds (instead of dt seconds)
-				double desired_velocity = velocity_damping_ * d_angle / dt.toSec();
-				if( desired_velocity > joint_max_velocity_ ) {
-					desired_velocity = joint_max_velocity_;
-				} else if( desired_velocity < -joint_max_velocity_ ) {
-					desired_velocity = -joint_max_velocity_;
-				}
-				
-				double d_vel = desired_velocity - joint_velocity_;			// by what value we want to change the current joint velocity
-				
-				joint_desired_velocity_ = desired_velocity;
-				
-				return d_vel;
-			}
-			
-			/// @brief called to update the joint state according to the PID controller and the desired state
-			void update_directForce() {
-				ros::Time now = ros::Time::now();
-				ros::Duration dt = now - time_last_update_;
-				math::Angle joint_angle = joint_->GetAngle( 0 );	// assuming a rotary joint with a single axis/angle
-				double current_angle = joint_angle.Radian();
-				
-				
-				
-				int last_index = past_index_;
-				past_index_ = (past_index_ + 1) % past_values_.size();
-				past_values_[past_index_] = current_angle;
-				joint_velocity_ = past_values_[past_index_] - past_values_[last_index];
-				
-				double d_angle = desired_value_ - current_angle;
-				double new_force = pid_multiplier_ * pid_.computeCommand( d_angle, dt );
-				
-				// cap the applied joint force, if it is too large or too small
-				if( new_force > joint_max_force_ ) {
-					new_force = joint_max_force_;
-				} else if( new_force < -joint_max_force_ ) {
-					new_force = -joint_max_force_;
-				}
-				
-				// apply force to joint
-				joint_->SetForce( 0, new_force );
-				
-				// save some values that we might publish
-				joint_angle_ = current_angle;
-				joint_desired_velocity_ = 0.0;
-				joint_delta_force_ = new_force - joint_force_;
-				joint_force_ = new_force;
-				
-				// we only publish when we have at least one subscriber to our topic
-				if( pub_.getNumSubscribers() > 0 ) {
-					gazebo_crab_plugin::pid_joint_state msg;
-					double p, i, d, i_max, i_min;
-					msg.desired = desired_value_;
-					msg.value = joint_->GetAngle( 0 ).Radian();
-					msg.force = new_force;
-					msg.d_force = new_force - joint_force_;
-					pid_.getGains( msg.pid_p, msg.pid_i, msg.pid_d, i_min, i_max );
-					pid_.getCurrentPIDErrors( &msg.pid_pe, &msg.pid_ie, &msg.pid_de );
-					pub_.publish( msg );
-				}
-				
-				joint_force_ = new_force;
-			}
-			
-			/** @brief called to update the joint state (applied force), based on the desired velocity (to reach the desired angle)
-			 * 
-			 * @note this code does not require constant time steps, aside the fact that gazebo does use constant
-			 *       time steps for the simulation, with one exception: the damping factor depends on the step size
-			 * 
-			 * @todo compute damping factor, based on dt
-			 */
-			void update_velForce() {
-				ros::Time now = ros::Time::now();					// current time
-				ros::Duration dt = now - time_last_update_;			// delta time (now - last update)
-				math::Angle joint_angle = joint_->GetAngle( 0 );	// assuming a rotary joint with a single axis/angle
-				double current_angle = joint_angle.Radian();		// actual angle
-				
-				if( reset_ ) {
-					parent_->resetModel();
-					joint_->Reset();
-					joint_->SetVelocity( 0, 0.0 );
-					joint_->SetAngle( 0, 0.0 );
-					reset_ = false;
-				}
-				
-				int last_index = past_index_;
-				past_index_ = (past_index_ + 1) % past_values_.size();
-				past_values_[past_index_] = current_angle;
-				joint_velocity_ = past_values_[past_index_] - past_values_[last_index];
-				
-				double d_angle = desired_value_ - current_angle;
-				
-				// compute our desired velocity
-				//   velocity to reach the target angle with the next tick: d_angle / dt
-				//   we additionally apply a damping factor, so that we would reach the desired angle in dt/damping_factor seconds (instead of dt seconds)
-				double desired_velocity = velocity_damping_ * d_angle / dt.toSec();
-				if( desired_velocity > joint_max_velocity_ ) {
-					desired_velocity = joint_max_velocity_;
-				} else if( desired_velocity < -joint_max_velocity_ ) {
-					desired_velocity = -joint_max_velocity_;
-				}
-				
-				double d_vel = desired_velocity - joint_velocity_;			// by what value we want to change the current joint velocity
-				double d_force = pid_multiplier_*pid_.computeCommand( d_vel, dt );	// currection value estimate from the PID controller
-				
-				// compute the new force that we apply to the joint
-				double new_force = joint_force_ + d_force;
-				if( new_force > joint_max_force_ ) {
-					new_force = joint_max_force_;
-				} else if( new_force < -joint_max_force_ ) {
-					new_force = -joint_max_force_;
-				}
-				joint_->SetForce( 0, new_force );
-				
-				// save some values that we might publish
-				joint_angle_ = current_angle;
-				joint_desired_velocity_ = desired_velocity;
-				joint_delta_force_ = d_force;
-				joint_force_ = new_force;
-				
-				// debug message
-				//
-				/*
-				std::cout << "test  " << joint_->GetName() << std::endl;
-				if( std::string("leg_1_joint_2") == joint_->GetName() ) {
-					std::cout << "#### d_angle=" << d_angle << ", d_vel=" << d_vel << ", new_force=" << new_force << ", d_force=" << d_force << std::endl;
-				}
-				*/
-				//
-				// end of debug message
-				
-				// we only publish when we have at least one subscriber to our topic
-				if( pub_.getNumSubscribers() > 0 ) {
-					gazebo_crab_plugin::pid_joint_state msg;
-					double p, i, d, i_max, i_min;
-					msg.desired = desired_value_;
-					msg.value = joint_->GetAngle( 0 ).Radian();
-					msg.force = new_force;
-					msg.d_force = d_force;
-					pid_.getGains( msg.pid_p, msg.pid_i, msg.pid_d, i_min, i_max );
-					pid_.getCurrentPIDErrors( &msg.pid_pe, &msg.pid_ie, &msg.pid_de );
-					pub_.publish( msg );
-				}
-				
-				
-				if( log_file_.is_open() ) {
-					// log fields: time, target_angle, current_angle, velocity, error
-					log_file_ << ros::Time::now()
-						<< " " << desired_value_		// target angle
-						<< " " << current_angle			// actuall angle
-						<< " " << joint_velocity_		// current velocity
-						<< " " << (desired_value_ - current_angle)				// position error
-						<< " " << (joint_velocity_ - joint_desired_velocity_)	// velocity error
-						<< std::endl;
-				}
-				
-				// we only publish when we have at least one subscriber to our topic
-				if( pub_err_.getNumSubscribers() > 0 ) {
-					gazebo_crab_plugin::pid_joint_error err_msg;
-					err_msg.angle = joint_angle_;
-					err_msg.angle_error = desired_value_ - joint_angle_;
-					err_msg.velocity = joint_velocity_;
-					err_msg.velocity_error = joint_velocity_ - joint_desired_velocity_;
-					err_msg.force = joint_->GetForce(0);
-					err_msg.force_delta = joint_delta_force_;
-					
-					pub_err_.publish( err_msg );
-				}
-				
-			}
-			
-			/// @brief creates a log file and writes the header to it
+			/// @brief creates a (binary) log file with the parameters in the header. expects params_mutex_ to be locked
 			void create_file() {
 				
 				if( !save_to_file_ )
 					return;
 				
-				// close the file if it is already open
-				if( log_file_.is_open() ) {
-					log_file_.close();
-				}
-				
-				// create path & folders (id not already exists)
-				std::string path = std::string( "/opt/shared/developer/logs/arm_test/" );
-				boost::filesystem::path dir(path);
-				boost::system::error_code ec;
-				boost::filesystem::create_directories(dir, ec);
-				if( !ec ) {
-					std::cout << "failed to create directory '" << path << "', error=" << ec.message() << std::endl;
-					//ROS_ERROR( "failed to create directory '%s'", path.c_str() );
-				}
-				
-				// create the filename (p_i_d_imax_imin_m_vmax_damp_<joint>.log)
+				// create the filename (p_i_d_imax_imin_m_vmax_damp_<joint>)
 				double p,i,d,imax,imin;
 				char str[256];
-				pid_.getGains( p, i, d, imax, imin );
-				snprintf( str, 256, "%0.4f_%0.4f_%0.4f_%0.4f_%0.4f_%0.4f_%0.4f_%0.4f_%s.log",
+				getGains( p, i, d, imax, imin );
+				snprintf( str, 256, "%0.4f_%0.4f_%0.4f_%0.4f_%0.4f_%0.4f_%0.4f_%0.4f_%s",
 					p,i,d,
 					imax,imin,
-					pid_multiplier_,
-					joint_max_velocity_,
-					velocity_damping_,
+					params_.multiplier,
+					params_.max_velocity,
+					params_.damping,
 					joint_->GetName().c_str()
 				);
-				//std::string filename = (std::string("") + (parent_->getNH()->getNamespace().c_str()+1) + "." + joint_->GetName() + ".log");
 				std::string filename = std::string(str);
 				
-				// open the file
-				log_file_.open( (path+filename).c_str(), std::ios::out );
-				std::cout << "log file=" << (path+filename) << std::endl;
-				
-				// write the parameters to the first line (should have a higher precesion than the ones in the filename
-				log_file_ << "#"
+				// the parameters for the first line (should have a higher precesion than the ones in the filename
+				std::ostringstream header;
+				header << "#"
 					<< " " << p
 					<< " " << i
 					<< " " << d
 					<< " " << imax
 					<< " " << imin
-					<< " " << pid_multiplier_
-					<< " " << joint_max_velocity_
-					<< " " << velocity_damping_
-					<< " " << joint_max_force_
+					<< " " << params_.multiplier
+					<< " " << params_.max_velocity
+					<< " " << params_.damping
+					<< " " << params_.max_force
 					<< " " << joint_->GetName()
 					<< std::endl;
-			}
-			
-			/// @brief called to update the joint state according to the PID controller and the desired state
-			void update() {
-				if( !ready_ )
-					return;
-				
-				if( reset_ ) {
-					parent_->resetModel();
-					joint_->Reset();
-					joint_->SetVelocity( 0, 0.0 );
-					joint_->SetAngle( 0, 0.0 );
-					reset_ = false;
-					
-					joint_angle_ = 0.0;
-					joint_desired_velocity_ = 0.0;
-					joint_delta_force_ = 0.0;
-					joint_force_ = 0.0;
-					for( int i=0; i<past_values_.size(); i++ )
-						past_values_[i] = 0.0;
-				}
-				
-				// debugging
-				//
-				/*
-				update_velForce();
-				return;
-				*/
-				//
-				// end of debugging
-				
-				ros::Time now = ros::Time::now();					// current time
-				ros::Duration dt = now - time_last_update_;			// delta time (now - last update)
-				math::Angle joint_angle = joint_->GetAngle( 0 );	// assuming a rotary joint with a single axis/angle
-				double current_angle = joint_angle.Radian();		// actual angle
-				
-				int last_index = past_index_;
-				past_index_ = (past_index_ + 1) % past_values_.size();
-				past_values_[past_index_] = current_angle;
-				joint_velocity_ = past_values_[past_index_] - past_values_[last_index];
-				
-				double d_angle = desired_value_ - current_angle;
-				
-				// compute the pid output
-				double pid_out;
-				switch( input_type_ ) {
-					default: // fall through
-					case 0:
-						pid_out = pid_multiplier_*pid_.computeCommand( update_input_pos(), dt );
-						break;
-					case 1:
-						pid_out = pid_multiplier_*pid_.computeCommand( update_input_vel(), dt );
-						break;
-				}
-				
-				// compute the new force for the joint
-				double new_force;
-				switch( update_type_ ) {
-					default:
-					case 0:
-						new_force = pid_out;
-						// cap the applied joint force, if it is too large or too small
-						if( new_force > joint_max_force_ ) {
-							new_force = joint_max_force_;
-						} else if( new_force < -joint_max_force_ ) {
-							new_force = -joint_max_force_;
-						}
-						break;
-				
-					case 1:
-						new_force = joint_force_ + pid_out;
-						if( new_force > joint_max_force_ ) {
-							new_force = joint_max_force_;
-						} else if( new_force < -joint_max_force_ ) {
-							new_force = -joint_max_force_;
-						}
-						break;
-				}
-				
-				// apply the new force
-				joint_->SetForce( 0, new_force );
-				
-				// save some values that we might publish
-				joint_angle_ = current_angle;
-				//joint_desired_velocity_ = 0.0;
-				joint_delta_force_ = new_force - joint_force_;
-				joint_force_ = new_force;
-				
-				time_last_update_ = ros::Time::now();
-				
-				// we only publish when we have at least one subscriber to our topic
-				if( pub_.getNumSubscribers() > 0 ) {
-					gazebo_crab_plugin::pid_joint_state msg;
-					double p, i, d, i_max, i_min;
-					msg.desired = desired_value_;
-					msg.value = joint_->GetAngle( 0 ).Radian();
-					msg.force = new_force;
-					msg.d_force = new_force - joint_force_;
-					pid_.getGains( msg.pid_p, msg.pid_i, msg.pid_d, i_min, i_max );
-					pid_.getCurrentPIDErrors( &msg.pid_pe, &msg.pid_ie, &msg.pid_de );
-					pub_.publish( msg );
-				}
-				
-				// write to joint log file
-				if( log_file_.is_open() ) {
-					// log fields: time, target_angle, current_angle, velocity, error
-					log_file_ << ros::Time::now()
-						<< " " << desired_value_		// target angle
-						<< " " << current_angle			// actuall angle
-						<< " " << joint_velocity_		// current velocity
-						<< " " << (desired_value_ - current_angle)				// position error
-						<< " " << (joint_velocity_ - joint_desired_velocity_)	// velocity error
-						<< std::endl;
-				}
 				
-				// we only publish when we have at least one subscriber to our topic
-				if( pub_err_.getNumSubscribers() > 0 ) {
-					gazebo_crab_plugin::pid_joint_error err_msg;
-					err_msg.angle = joint_angle_;
-					err_msg.angle_error = desired_value_ - joint_angle_;
-					err_msg.velocity = joint_velocity_;
-					err_msg.velocity_error = joint_velocity_ - joint_desired_velocity_;
-					err_msg.force = joint_->GetForce(0);
-					err_msg.force_delta = joint_delta_force_;
-					
-					pub_err_.publish( err_msg );
-				}
-				
-				/*
-				gazebo_crab_plugin::pid_joint_state msg;
-				double p, i, d, i_max, i_min;
-				msg.desired = desired_value_;
-				msg.value = joint_->GetAngle( 0 ).Radian();
-				pid_.getGains( msg.pid_p, msg.pid_i, msg.pid_d, i_min, i_max );
-				pid_.getCurrentPIDErrors( &msg.pid_pe, &msg.pid_ie, &msg.pid_de );
-				pub_.publish( msg );
-				*/
+				// (re)open the file. the records are written by the log thread of the model (see ModelPIDJoint::pushLog())
+				parent_->getLog()->open( index_, filename, header.str() );
 			}
 			
 			
 			void setVelocityDamping( double velocity_damping ) {
-				velocity_damping_ = velocity_damping;
+				std::lock_guard<std::mutex> lock( params_mutex_ );
+				params_.damping = velocity_damping;
+				handoff_.publish( params_ );
 			}
 			
 			
 			void setPidMultiplier( double pid_multiplier ) {
-				pid_multiplier_ = pid_multiplier;
+				std::lock_guard<std::mutex> lock( params_mutex_ );
+				params_.multiplier = pid_multiplier;
+				handoff_.publish( params_ );
 			}
 			
 			
-		private:
-			friend void callback( gazebo_crab_plugin::dyn_paramsConfig &config, uint32_t level, PidJoint *pid_joint );
-			
-			/// @brief pointer to the parent, a ModelPIDJoint object.
-			ModelPIDJoint *parent_;
-			
-			/// @brief set to true if the controller is ready. stays false if the initialization failed
-			bool ready_;
-			
-			/// @brief factor to adjust the output of the PID controller
-			double pid_multiplier_;
-			
-			/// @brief the desired joint state (angle, radians)
-			double desired_value_;
-			
-			/// @brief array (vector) containing the past view values to compute the velocity and acceleration. used as a ring buffer
-			std::vector<double> past_values_;
-			
-			/// @brief index of the first value in past_values_
-			int past_index_;
-			
-			/// @brief the current angle of the joint
-			double joint_angle_;
-			
-			/// @brief current joint velocity (compute from the angle of the last update to this update)
-			double joint_velocity_;
+			/// @brief publishes the parameters again (restores the gains of the joint after its gain schedule was removed)
+			void republish() {
+				std::lock_guard<std::mutex> lock( params_mutex_ );
+				handoff_.publish( params_ );
+			}
 			
-			/// @brief the desired velocity by the controller
-			double joint_desired_velocity_;
 			
-			/// @brief the force that we are currently applying to the joint
-			double joint_force_;
+		private:
+			/// @brief sets the gains in params_. same argument order as control_toolbox::Pid::setGains()
+			void setGains( double p, double i, double d, double i_max, double i_min ) {
+				params_.p_gain = p;
+				params_.i_gain = i;
+				params_.d_gain = d;
+				params_.i_max = i_max;
+				params_.i_min = i_min;
+			}
 			
-			/// @brief the difference of the applied force between now and the last update
-			double joint_delta_force_;
+			/// @brief returns the gains from params_. same argument order as control_toolbox::Pid::getGains()
+			void getGains( double &p, double &i, double &d, double &i_max, double &i_min ) const {
+				p = params_.p_gain;
+				i = params_.i_gain;
+				d = params_.d_gain;
+				i_max = params_.i_max;
+				i_min = params_.i_min;
+			}
 			
-			/// @brief the maximum joint force that we apply
-			double joint_max_force_;
+			friend void callback( gazebo_crab_plugin::dyn_paramsConfig &config, uint32_t level, PidJoint *pid_joint );
 			
-			/// @brief the maximum velocity of the joint (in rad/s). not a physical limit, just a value that we _try_ to respect
-			double joint_max_velocity_;
+			/// @brief pointer to the parent, a ModelPIDJoint object.
+			ModelPIDJoint *parent_;
 			
-			/// @brief damping factor when computing the desired joint velocity
-			double velocity_damping_;
+			/// @brief the engine that holds the controller state of this joint
+			JointEngine *engine_;
 			
-			/// @brief update type: 0=directForce, 1=deltaForce
-			int update_type_;
+			/// @brief index of this joint in the engine arrays
+			int index_;
 			
-			/// @brief controller input: 0=position, 1=velocity
-			int input_type_;
+			/// @brief writer side copy of the controller parameters (modified by the ros callbacks)
+			JointParams params_;
 			
-			/// @brief if true we are resetting the joint state (angle & velocity) at the next update
-			bool reset_;
+			/// @brief serializes the ros callbacks that modify params_
+			std::mutex params_mutex_;
 			
-			/// @brief timestamp of the last update
-			ros::Time time_last_update_;
+			/// @brief hands params_ over to the physics thread
+			ParamHandoff handoff_;
 			
 			/// @brief ros node handle
 			ros::NodeHandle *nh_;
@@ -717,26 +394,26 @@ namespace gazebo {
 			/// @brief subscriber for settting parameters (because of problems with setting dynamic parameters via matlab)
 			ros::Subscriber sub_param_;
 			
+			/// @brief subscriber for pid_joint_param messages (all parameters, including the reset type)
+			ros::Subscriber sub_param_msg_;
+			
 			/// @brief publisher for joint state data
 			ros::Publisher pub_;
 			
 			/// @brief publisher for joint error data
 			ros::Publisher pub_err_;
 			
-			/// @brief the PID controller itself
-			control_toolbox::Pid pid_;
-			
-			/// @brief dynamic reconfigure server
+			/// @brief dynamic reconfigure server (NULL until enableReconfigure() is called)
 			dynamic_reconfigure::Server<gazebo_crab_plugin::dyn_paramsConfig> *dyn_reconf_server_;
 			
+			/// @brief serializes the creation of the dynamic reconfigure server
+			std::mutex dyn_mutex_;
+			
 			/// @brief the joint that we are manipulating
 			gazebo::physics::Joint *joint_;
 			
 			/// @brief if set to true, we are writing data to a log file
 			bool save_to_file_;
-			
-			/// @brief log file object (unused, if save_to_file_ is false)
-			std::ofstream log_file_;
 	};
 	
 	
@@ -759,23 +436,47 @@ namespace gazebo {
 			<< ", c=" << config.i_clamp_max << "/" << config.i_clamp_min
 			<< ", vel_max=" << config.velocity_max
 			<< ", vel_d=" << config.velocity_damping
-			<< ", mult=" << config.pid_multiplier << "]"
+			<< ", mult=" << config.pid_multiplier
+			<< ", form=" << config.pid_form << "/" << config.anti_windup
+			<< ", d_filter=" << config.d_filter << ", tracking=" << config.tracking_time
+			<< ", velocity=" << config.velocity_estimator << "/" << config.velocity_taps << "/" << config.velocity_alpha
+			<< ", rate=1/" << config.rate_divider << "]"
 			<< std::endl;
 		
-		pid_joint->joint_max_velocity_ = config.velocity_max;
-		pid_joint->velocity_damping_ = config.velocity_damping;
-		pid_joint->pid_multiplier_ = config.pid_multiplier;
-		pid_joint->pid_.setGains( config.p_gain, config.i_gain, config.d_gain, config.i_clamp_max, config.i_clamp_min );
+		std::lock_guard<std::mutex> lock( pid_joint->params_mutex_ );
+		pid_joint->params_.max_velocity = config.velocity_max;
+		pid_joint->params_.damping = config.velocity_damping;
+		pid_joint->params_.multiplier = config.pid_multiplier;
+		pid_joint->params_.pid_form = config.pid_form;
+		pid_joint->params_.anti_windup = config.anti_windup;
+		pid_joint->params_.d_filter = config.d_filter;
+		pid_joint->params_.tracking_time = config.tracking_time;
+		pid_joint->params_.velocity_estimator = config.velocity_estimator;
+		pid_joint->params_.velocity_taps = config.velocity_taps;
+		pid_joint->params_.velocity_alpha = config.velocity_alpha;
+		pid_joint->params_.rate_divider = config.rate_divider;
+		pid_joint->setGains( config.p_gain, config.i_gain, config.d_gain, config.i_clamp_max, config.i_clamp_min );
+		pid_joint->handoff_.publish( pid_joint->params_ );
 	}
 	
 	
 	
 	
+	/// @brief detaches the model from the controller manager of the world (if any)
+	ModelPIDJoint::~ModelPIDJoint() {
+		if( manager_ )
+			manager_->detach( this );
+	}
+	
+	
 	/// @brief called when the plugin is loaded. initializes the object
 	void ModelPIDJoint::Load( physics::ModelPtr model, sdf::ElementPtr sdf ) {
+		ros::WallTime load_start = ros::WallTime::now();
+		
 		// store the pointer to the model
 		model_ = model;
 		sdf_ = sdf;
+		engine_.setAccess( &joint_access_ );
 		
 		if( sdf_->HasElement("robotNamespace") ) {
 			nh_ = new ros::NodeHandle( sdf_->GetElement("robotNamespace")->Get<std::string>() );
@@ -784,10 +485,14 @@ namespace gazebo {
 			nh_ = new ros::NodeHandle();
 		}
 
-		// listen to the update event. this event is broadcast every simulation iteration.
-		this->update_connection_ = event::Events::ConnectWorldUpdateBegin(
-			boost::bind(&ModelPIDJoint::OnUpdate, this, _1)
-		);
+		// the model is updated by the update event (broadcast every simulation iteration) or, if the world has a controller
+		// manager (world plugin WorldCrabControllers), by the manager together with all other models. both are connected
+		// at the end of Load, a partly loaded model is never updated
+		bool batch_update = true;
+		if( sdf_->HasElement("batchUpdate") )
+			batch_update = sdf_->GetElement("batchUpdate")->Get<bool>();
+		if( batch_update )
+			manager_ = ControllerManager::find( model_->GetWorld()->GetName() );
 
 		const gazebo::physics::Joint_V joints_vec = this->model_->GetJoints();
 		
@@ -805,30 +510,828 @@ namespace gazebo {
 			std::cout << "ROS is initialized" << std::endl;
 		}
 		
-		for( int i=0; i<joints_vec.size(); i++ ) {
+		// the joints that we control (parameter 'controlled_joints' or sdf element 'controlledJoints', default: all joints).
+		// the other joints are not touched at all
+		std::vector< JointConfig > configs;
+		std::vector< physics::JointPtr > controlled;
+		std::vector< const JointParams* > controlled_params;
+		if( readJointConfigs( *nh_, sdf_, configs ) ) {
+			for( int n=0; n<configs.size(); n++ ) {
+				physics::JointPtr joint = model_->GetJoint( configs[n].name );
+				if( !joint ) {
+					ROS_WARN( "controlled joint '%s' does not exist in model '%s'", configs[n].name.c_str(), model_->GetName().c_str() );
+					continue;
+				}
+				controlled.push_back( joint );
+				controlled_params.push_back( &configs[n].params );
+			}
+		} else {
+			controlled = joints_vec;
+			controlled_params.resize( controlled.size(), NULL );
+		}
+		
+		// telemetry topics: <joint>_pid_state and <joint>_errors per joint and/or pid_joint_states for the whole model
+		per_joint_topics_ = true;
+		if( sdf_->HasElement("perJointTopics") )
+			per_joint_topics_ = sdf_->GetElement("perJointTopics")->Get<bool>();
+		bool model_topic = true;
+		if( sdf_->HasElement("modelTopic") )
+			model_topic = sdf_->GetElement("modelTopic")->Get<bool>();
+		
+		// binary joint logs (written by a background thread, see JointLogWriter)
+		log_to_file_ = false;
+		if( sdf_->HasElement("logToFile") )
+			log_to_file_ = sdf_->GetElement("logToFile")->Get<bool>();
+		if( log_to_file_ ) {
+			std::string log_directory( "/opt/shared/developer/logs/arm_test/" );
+			int log_file_size = 64;		// in MB
+			if( sdf_->HasElement("logDirectory") )
+				log_directory = sdf_->GetElement("logDirectory")->Get<std::string>();
+			if( sdf_->HasElement("logFileSize") )
+				log_file_size = sdf_->GetElement("logFileSize")->Get<int>();
+			log_.configure( log_directory, (uint64_t)log_file_size << 20, controlled.size() );
+		}
+		
+		// dynamic reconfigure servers that are created at startup: "all", or a list of joint names. the servers of the other
+		// joints are created on demand, by publishing the joint name (or "all") to 'enable_dyn_reconfigure'
+		if( sdf_->HasElement("dynReconfigure") ) {
+			std::stringstream str_stream( sdf_->GetElement("dynReconfigure")->Get<std::string>() );
+			std::string element;
+			while( str_stream >> element )
+				reconfigure_joints_.push_back( element );
+		}
+		
+		// resets: new joint parameters reset the joint and (by default) the model, at most once per tick
+		reset_model_on_params_ = true;
+		if( sdf_->HasElement("resetModelOnParams") )
+			reset_model_on_params_ = sdf_->GetElement("resetModelOnParams")->Get<bool>();
+		
+		for( int i=0; i<controlled.size(); i++ ) {
 			// debug output
 			//
 			/*
-			std::cout << "  joint " << (i<10?" ":"") << i << ": name=" << joints_vec[i]->GetName()
-				<< ", type=" << joints_vec[i]->GetType()
-				<< ", axis-count=" << joints_vec[i]->GetAngleCount()
+			std::cout << "  joint " << (i<10?" ":"") << i << ": name=" << controlled[i]->GetName()
+				<< ", type=" << controlled[i]->GetType()
+				<< ", axis-count=" << controlled[i]->GetAngleCount()
 				<< std::endl;
 			*/
 			//
 			// end of debug output
 			
-			pid_joint_vec_.push_back( new PidJoint(this, *(joints_vec[i])) );
+			pid_joint_vec_.push_back( new PidJoint(this, *(controlled[i]), controlled_params[i]) );
+		}
+		
+		sub_reconfigure_ = nh_->subscribe< std_msgs::String >( "enable_dyn_reconfigure", 10, &ModelPIDJoint::subReconfigureCallback, this );
+		
+		// trajectories: all buffers are allocated here, the messages are copied into them without allocating
+		int trajectory_buffer_size = 256;
+		if( sdf_->HasElement("trajectoryBufferSize") )
+			trajectory_buffer_size = sdf_->GetElement("trajectoryBufferSize")->Get<int>();
+		for( int i=0; i<pid_joint_vec_.size(); i++ )
+			joint_index_[pid_joint_vec_[i]->name()] = i;
+		trajectories_.configure( engine_.size(), trajectory_buffer_size );
+		sub_trajectory_ = nh_->subscribe< gazebo_crab_plugin::joint_trajectory >( "joint_trajectory", 10, &ModelPIDJoint::trajectoryCallback, this );
+		
+		// excitation signals for tuning runs, generated in the plugin (no setpoint traffic)
+		loadExcitation();
+		sub_excitation_ = nh_->subscribe< gazebo_crab_plugin::excitation_param >( "excitation", 10, &ModelPIDJoint::excitationCallback, this );
+		
+		// gain schedules (angle and velocity dependent gains), interpolated by the engine
+		loadGainSchedules();
+		engine_.setGainScheduler( &gain_scheduler_ );
+		sub_gain_schedule_ = nh_->subscribe< gazebo_crab_plugin::gain_schedule >( "gain_schedule", 10, &ModelPIDJoint::gainScheduleCallback, this );
+		
+		// start the telemetry publisher thread. the ring should hold a few ticks of all joints
+		int telemetry_queue_size = 4096;
+		if( sdf_->HasElement("telemetryQueueSize") )
+			telemetry_queue_size = sdf_->GetElement("telemetryQueueSize")->Get<int>();
+		loadTelemetryRates();
+		telemetry_.start( *nh_, telemetry_queue_size, model_topic );
+		
+		// start the log thread. same ring size as the telemetry
+		if( log_to_file_ ) {
+			int log_queue_size = 4096;
+			if( sdf_->HasElement("logQueueSize") )
+				log_queue_size = sdf_->GetElement("logQueueSize")->Get<int>();
+			log_.start( log_queue_size );
+		}
+		
+		// controller clock: the simulation time of the world update. in fixed-step mode every update uses the same dt
+		// (default: the physics step size), otherwise dt is the difference of the simulation times
+		fixed_step_ = false;
+		if( sdf_->HasElement("fixedStep") )
+			fixed_step_ = sdf_->GetElement("fixedStep")->Get<bool>();
+		fixed_dt_ = model_->GetWorld()->GetPhysicsEngine()->GetMaxStepSize();
+		if( sdf_->HasElement("fixedStepSize") )
+			fixed_dt_ = sdf_->GetElement("fixedStepSize")->Get<double>();
+		if( fixed_step_ )
+			ROS_INFO( "fixed-step controller clock, dt=%f", fixed_dt_ );
+		
+		tick_ = 0;
+		time_last_update_ = model_->GetWorld()->GetSimTime();
+		
+		// episode error accumulators. an episode of a joint lasts from one reset to the next, the first 'episodeWarmup'
+		// seconds of every episode are not accumulated
+		double episode_warmup = 0.0;
+		if( sdf_->HasElement("episodeWarmup") )
+			episode_warmup = sdf_->GetElement("episodeWarmup")->Get<double>();
+		episodes_.configure( engine_.size(), episode_warmup );
+		loadWatchdog();
+		for( int i=0; i<engine_.size(); i++ ) {
+			episodes_.start( i, time_last_update_.Double() );
+			watchdog_.start( i, time_last_update_.Double() );
+		}
+		episode_count_ = 0;
+		sub_episode_request_ = nh_->subscribe< std_msgs::Empty >( "episode_summary_request", 10, &ModelPIDJoint::episodeRequestCallback, this );
+		
+		// latency histograms of the update phases, reported every latencyPeriod seconds and on request (latency_dump)
+		profiler_ = NULL;
+		bool latency_stats = false;
+		if( sdf_->HasElement("latencyStats") )
+			latency_stats = sdf_->GetElement("latencyStats")->Get<bool>();
+		if( latency_stats ) {
+			double latency_period = 1.0;
+			if( sdf_->HasElement("latencyPeriod") )
+				latency_period = sdf_->GetElement("latencyPeriod")->Get<double>();
+			profiler_ = new LatencyProfiler();
+			engine_.setProfiler( profiler_ );
+			for( int phase=0; phase<LatencyProfiler::N_PHASES; phase++ )
+				profiler_->histogram( phase ).snapshot( latency_last_[phase] );
+			latency_last_time_ = ros::WallTime::now();
+			latency_pub_ = nh_->advertise< gazebo_crab_plugin::latency_stats >( "latency_stats", 10 );
+			sub_latency_dump_ = nh_->subscribe< std_msgs::Empty >( "latency_dump", 10, &ModelPIDJoint::latencyDumpCallback, this );
+			if( latency_period > 0.0 )
+				latency_timer_ = nh_->createWallTimer( ros::WallDuration( latency_period ), &ModelPIDJoint::latencyTimerCallback, this );
+		}
+		
+		if( manager_ ) {
+			manager_->attach( this );
+			ROS_INFO( "batched update by the controller manager of the world (%i models)", manager_->size() );
+		} else {
+			this->update_connection_ = event::Events::ConnectWorldUpdateBegin(
+				boost::bind(&ModelPIDJoint::OnUpdate, this, _1)
+			);
 		}
 		
+		ROS_INFO( "plugin loaded in %.3f ms (%i joints)", (ros::WallTime::now() - load_start).toSec() * 1e3, engine_.size() );
+		
 	}
 
 	/// @brief called by the world update start event. in this function we update the state of all joints
-	void ModelPIDJoint::OnUpdate(const common::UpdateInfo & /*_info*/) {
+	void ModelPIDJoint::OnUpdate(const common::UpdateInfo &info) {
+		prepareUpdate( info );
+		computeUpdate();
+		finishUpdate();
+	}
+	
+	
+	/// @brief first part of an update: controller clock, parameters, resets and reading the joints
+	void ModelPIDJoint::prepareUpdate( const common::UpdateInfo &info ) {
+		// one timestamp per world update, shared by all joints
+		const common::Time &now = info.simTime;
+		update_dt_ = fixed_step_ ? fixed_dt_ : (now - time_last_update_).Double();
+		time_last_update_ = now;
+		update_now_ = now.Double();
+		update_stamp_ = ros::Time( now.sec, now.nsec );
+		
+		// latency of the phases (only if enabled). the time of the update is the sum of the three parts, so that the
+		// time of the other models in a batched update is not counted
+		int64_t tick_start = profiler_ ? LatencyProfiler::now() : 0;
+		int64_t t = tick_start;
+		
+		// pick up the parameters that were published by the ros callbacks since the last tick
+		engine_.applyParams();
+		
+		// apply pending resets (at most one model reset per tick), before any joint is updated
+		if( engine_.resetPending() )
+			applyResets();
+		
+		if( profiler_ )
+			profiler_->lap( LatencyProfiler::PHASE_PARAMS, t );
+		
+		// read the angles of all joints (the engine measures its own phases)
+		engine_.read( update_dt_ );
+		
+		if( profiler_ )
+			tick_ns_ = LatencyProfiler::now() - tick_start;
+	}
+	
+	
+	/** @brief second part of an update: setpoints, pid, watchdog, episodes, telemetry and log. only touches the state of
+	 *         this model (no gazebo calls), so the controller manager may run it for several models in parallel
+	 */
+	void ModelPIDJoint::computeUpdate() {
+		int64_t compute_start = profiler_ ? LatencyProfiler::now() : 0;
+		int64_t t = compute_start;
+		
+		// joints that follow a trajectory get their desired angle from it (overrides the setpoints of the joint topics)
+		trajectories_.update( update_now_, engine_.desired_.data() );
+		
+		// joints with an excitation signal get their desired angle from it (overrides trajectories and setpoints)
+		excitation_.update( update_now_, engine_.desired_.data() );
+		
+		if( profiler_ )
+			profiler_->lap( LatencyProfiler::PHASE_SETPOINTS, t );
+		
+		// compute the new forces of every joint that we control in one pass
+		engine_.compute( update_dt_ );
+		
+		if( profiler_ )
+			t = LatencyProfiler::now();
+		
+		// abort the episodes of unstable joints (the joints are reset at the next tick)
+		if( watchdog_enabled_ )
+			checkWatchdog( update_now_, update_dt_ );
 		
-		// invoke an update call for every joint that we control
+		// accumulate the errors of the episodes
+		episodes_.accumulate( update_now_, engine_.desired_.data(), engine_.angle_.data(), engine_.velocity_.data(),
+			engine_.desired_velocity_.data() );
+		if( episodes_.takeRequest() )
+			telemetry_.pushEpisode( pushEpisodes( update_now_, 1, true ) );
+		
+		if( profiler_ )
+			t = profiler_->lap( LatencyProfiler::PHASE_EPISODE, t );
+		
+		// hand the new state over to the telemetry thread (only for topics that have subscribers)
+		pushTelemetry( update_stamp_.toSec() );
+		tick_++;
+		
+		if( profiler_ )
+			t = profiler_->lap( LatencyProfiler::PHASE_PUBLISH, t );
+		
+		// hand the new state over to the log thread (only for joints with an open log file)
+		if( log_.active() )
+			pushLog( update_stamp_ );
+		
+		if( profiler_ ) {
+			t = profiler_->lap( LatencyProfiler::PHASE_LOG, t );
+			tick_ns_ += t - compute_start;
+		}
+	}
+	
+	
+	/// @brief last part of an update: applying the new forces
+	void ModelPIDJoint::finishUpdate() {
+		int64_t t = profiler_ ? LatencyProfiler::now() : 0;
+		
+		engine_.write();
+		
+		if( profiler_ )
+			profiler_->record( LatencyProfiler::PHASE_TICK, tick_ns_ + (LatencyProfiler::now() - t) );
+	}
+	
+	
+	/// @brief returns true if the dynamic reconfigure server of a joint is created at startup (sdf: dynReconfigure)
+	bool ModelPIDJoint::reconfigureAtStartup( const std::string &joint ) const {
+		for( int i=0; i<reconfigure_joints_.size(); i++ ) {
+			if( reconfigure_joints_[i] == "all"  ||  reconfigure_joints_[i] == joint )
+				return true;
+		}
+		return false;
+	}
+	
+	
+	/// @brief creates the dynamic reconfigure server of the joint in the message (or of all joints for "all" or "")
+	void ModelPIDJoint::subReconfigureCallback( const std_msgs::String::ConstPtr &msg ) {
+		bool all = msg->data.empty()  ||  msg->data == "all";
+		bool found = false;
 		for( int i=0; i<pid_joint_vec_.size(); i++ ) {
-			pid_joint_vec_[i]->update();
+			if( all  ||  pid_joint_vec_[i]->name() == msg->data ) {
+				pid_joint_vec_[i]->enableReconfigure();
+				found = true;
+			}
 		}
+		if( !found )
+			ROS_WARN( "enable_dyn_reconfigure: unknown joint '%s'", msg->data.c_str() );
+	}
+	
+	
+	/** @brief hands the waypoints of a trajectory message over to the physics thread (see JointTrajectories)
+	 * 
+	 * the message is rejected if the array sizes do not match or the times are not strictly increasing. joints that are
+	 * not controlled by the plugin are ignored, waypoints beyond trajectoryBufferSize are dropped
+	 */
+	void ModelPIDJoint::trajectoryCallback( const gazebo_crab_plugin::joint_trajectory::ConstPtr &msg ) {
+		int joints = msg->name.size();
+		int points = msg->time.size();
+		bool cubic = msg->interpolation == JointTrajectories::CUBIC;
+		bool has_velocity = cubic  &&  !msg->velocity.empty();
+		
+		if( msg->interpolation != JointTrajectories::LINEAR  &&  !cubic ) {
+			ROS_WARN( "joint_trajectory: unknown interpolation %i", msg->interpolation );
+			return;
+		}
+		if( msg->position.size() != (size_t)joints * points  ||  (has_velocity && msg->velocity.size() != msg->position.size()) ) {
+			ROS_WARN( "joint_trajectory: %i joints and %i points do not match %i positions and %i velocities",
+				joints, points, (int)msg->position.size(), (int)msg->velocity.size() );
+			return;
+		}
+		for( int k=1; k<points; k++ ) {
+			if( msg->time[k] <= msg->time[k-1] ) {
+				ROS_WARN( "joint_trajectory: the times are not strictly increasing (point %i)", k );
+				return;
+			}
+		}
+		
+		int capacity = trajectories_.capacity();
+		if( points > capacity ) {
+			ROS_WARN( "joint_trajectory: %i points, only the first %i are used (trajectoryBufferSize)", points, capacity );
+			points = capacity;
+		}
+		
+		std::lock_guard<std::mutex> lock( trajectory_mutex_ );
+		JointTrajectories::Block &block = trajectories_.writeBlock();
+		for( int j=0; j<joints; j++ ) {
+			std::map< std::string, int >::const_iterator it = joint_index_.find( msg->name[j] );
+			if( it == joint_index_.end() ) {
+				ROS_WARN( "joint_trajectory: unknown joint '%s'", msg->name[j].c_str() );
+				continue;
+			}
+			int i = it->second;
+			block.start[i] = msg->header.stamp.toSec();
+			block.interpolation[i] = msg->interpolation;
+			block.count[i] = points;
+			block.has_velocity[i] = has_velocity;
+			for( int k=0; k<points; k++ ) {
+				block.time[i*capacity + k] = msg->time[k];
+				block.position[i*capacity + k] = msg->position[k*joints + j];
+				if( has_velocity )
+					block.velocity[i*capacity + k] = msg->velocity[k*joints + j];
+			}
+		}
+		trajectories_.publish();
+	}
+	
+	
+	/// @brief sets the excitation signal of the joint in the message (or of all joints for "")
+	void ModelPIDJoint::excitationCallback( const gazebo_crab_plugin::excitation_param::ConstPtr &msg ) {
+		ExcitationSignal signal;
+		signal.type = msg->type;
+		signal.offset = msg->offset;
+		signal.amplitude = msg->amplitude;
+		signal.f0 = msg->f0;
+		signal.f1 = msg->f1;
+		signal.duration = msg->duration;
+		signal.hold = msg->hold;
+		signal.levels = msg->levels;
+		signal.seed = msg->seed;
+		signal.repeat = msg->repeat;
+		
+		const char *error = ExcitationGenerator::check( signal );
+		if( error ) {
+			ROS_WARN( "excitation: %s", error );
+			return;
+		}
+		
+		if( msg->joint.empty() ) {
+			for( int i=0; i<engine_.size(); i++ )
+				excitation_.set( i, signal );
+			return;
+		}
+		std::map< std::string, int >::const_iterator it = joint_index_.find( msg->joint );
+		if( it == joint_index_.end() ) {
+			ROS_WARN( "excitation: unknown joint '%s'", msg->joint.c_str() );
+			return;
+		}
+		excitation_.set( it->second, signal );
+	}
+	
+	
+	/// @brief sets the gain schedule of the joint in the message (or of all joints for ""). empty tables remove it
+	void ModelPIDJoint::gainScheduleCallback( const gazebo_crab_plugin::gain_schedule::ConstPtr &msg ) {
+		GainTable table;
+		table.angle = msg->angle;
+		table.velocity = msg->velocity;
+		table.p_gain = msg->p_gain;
+		table.i_gain = msg->i_gain;
+		table.d_gain = msg->d_gain;
+		
+		const char *error = GainScheduler::check( table );
+		if( error ) {
+			ROS_WARN( "gain_schedule: %s", error );
+			return;
+		}
+		
+		int begin = 0, end = engine_.size();
+		if( !msg->joint.empty() ) {
+			std::map< std::string, int >::const_iterator it = joint_index_.find( msg->joint );
+			if( it == joint_index_.end() ) {
+				ROS_WARN( "gain_schedule: unknown joint '%s'", msg->joint.c_str() );
+				return;
+			}
+			begin = it->second;
+			end = begin + 1;
+		}
+		
+		// a removed schedule leaves the last interpolated gains in the engine, the parameters bring back the fixed ones
+		bool removed = table.p_gain.empty();
+		for( int i=begin; i<end; i++ ) {
+			gain_scheduler_.set( i, table );
+			if( removed )
+				pid_joint_vec_[i]->republish();
+		}
+	}
+	
+	
+	/// @brief publishes the latency percentiles of the last period (timer of the ros thread)
+	void ModelPIDJoint::latencyTimerCallback( const ros::WallTimerEvent &event ) {
+		publishLatency( false );
+	}
+	
+	
+	/// @brief publishes (and prints) the latency percentiles since the start (latency_dump)
+	void ModelPIDJoint::latencyDumpCallback( const std_msgs::Empty::ConstPtr &msg ) {
+		publishLatency( true );
+	}
+	
+	
+	/** @brief publishes the latency percentiles of all phases. the histograms are never cleared: the periodic report uses
+	 *         the difference to the counts of the last report, the cumulative report (dump) all counts
+	 */
+	void ModelPIDJoint::publishLatency( bool cumulative ) {
+		std::lock_guard<std::mutex> lock( latency_mutex_ );
+		ros::WallTime wall_now = ros::WallTime::now();
+		
+		gazebo_crab_plugin::latency_stats msg;
+		msg.header.stamp = ros::Time( wall_now.toSec() );
+		msg.cumulative = cumulative;
+		msg.interval = cumulative ? 0.0 : (wall_now - latency_last_time_).toSec();
+		
+		std::vector< uint64_t > counts;
+		for( int phase=0; phase<LatencyProfiler::N_PHASES; phase++ ) {
+			const LatencyHistogram &histogram = profiler_->histogram( phase );
+			histogram.snapshot( counts );
+			double max = histogram.max();
+			if( !cumulative ) {
+				std::vector< uint64_t > &last = latency_last_[phase];
+				for( int n=0; n<counts.size(); n++ ) {
+					uint64_t count = counts[n];
+					counts[n] -= last[n];
+					last[n] = count;
+				}
+				max = LatencyHistogram::percentile( counts, 1.0 );
+			}
+			
+			msg.phase.push_back( LatencyProfiler::name( phase ) );
+			msg.count.push_back( LatencyHistogram::total( counts ) );
+			msg.p50.push_back( LatencyHistogram::percentile( counts, 0.5 ) * 1e-3 );
+			msg.p99.push_back( LatencyHistogram::percentile( counts, 0.99 ) * 1e-3 );
+			msg.p999.push_back( LatencyHistogram::percentile( counts, 0.999 ) * 1e-3 );
+			msg.max.push_back( max * 1e-3 );
+			
+			if( cumulative )
+				ROS_INFO( "latency %-9s n=%-10llu p50=%9.3f us  p99=%9.3f us  p999=%9.3f us  max=%9.3f us", msg.phase.back().c_str(),
+					(unsigned long long)msg.count.back(), msg.p50.back(), msg.p99.back(), msg.p999.back(), msg.max.back() );
+		}
+		if( !cumulative )
+			latency_last_time_ = wall_now;
+		
+		latency_pub_.publish( msg );
+	}
+	
+	
+	/** @brief reads the watchdog thresholds from the sdf. the watchdog is enabled by the element, missing thresholds keep
+	 *         the defaults of WatchdogConfig, 0 disables a check
+	 * 
+	 *   <watchdog>
+	 *     <grace>0.2</grace>                         seconds after a reset without checks (except nan)
+	 *     <saturationTime>0.5</saturationTime>       seconds at max_force
+	 *     <maxVelocity>50</maxVelocity>              rad/s
+	 *     <growthWindow>0.5</growthWindow>           seconds
+	 *     <growthFactor>1.2</growthFactor>
+	 *     <growthWindows>3</growthWindows>
+	 *     <growthMinError>0.05</growthMinError>      rad
+	 *   </watchdog>
+	 */
+	void ModelPIDJoint::loadWatchdog() {
+		WatchdogConfig config;
+		watchdog_enabled_ = sdf_->HasElement("watchdog");
+		if( watchdog_enabled_ ) {
+			sdf::ElementPtr element = sdf_->GetElement("watchdog");
+			if( element->HasElement("grace") )
+				config.grace = element->GetElement("grace")->Get<double>();
+			if( element->HasElement("saturationTime") )
+				config.saturation_time = element->GetElement("saturationTime")->Get<double>();
+			if( element->HasElement("maxVelocity") )
+				config.max_velocity = element->GetElement("maxVelocity")->Get<double>();
+			if( element->HasElement("growthWindow") )
+				config.growth_window = element->GetElement("growthWindow")->Get<double>();
+			if( element->HasElement("growthFactor") )
+				config.growth_factor = element->GetElement("growthFactor")->Get<double>();
+			if( element->HasElement("growthWindows") )
+				config.growth_windows = element->GetElement("growthWindows")->Get<int>();
+			if( element->HasElement("growthMinError") )
+				config.growth_min_error = element->GetElement("growthMinError")->Get<double>();
+		}
+		watchdog_.configure( engine_.size(), config );
+	}
+	
+	
+	/** @brief checks the joints with the watchdog. a joint that failed is reset at the next tick (with the model, unless
+	 *         disabled by resetModelOnParams), which ends its episode with a summary of reason 2
+	 */
+	void ModelPIDJoint::checkWatchdog( double now, double dt ) {
+		if( !watchdog_.check( now, dt, engine_.desired_.data(), engine_.angle_.data(), engine_.force_.data(),
+				engine_.max_force_.data() ) )
+			return;
+		
+		// the failure stays in failed_ until the reset, the telemetry thread logs it with the summary of the reset
+		for( int i=0; i<engine_.size(); i++ ) {
+			if( !watchdog_.failed_[i]  ||  engine_.reset_[i] )
+				continue;
+			engine_.resetPid( i );
+			engine_.requestReset( i, reset_model_on_params_ );
+		}
+	}
+	
+	
+	/** @brief reads the excitation signals from the sdf
+	 * 
+	 *   <excitation>
+	 *     <seed>1</seed>                     seed of the model (default 1)
+	 *     <joint name="leg_1_joint_1">       one element per joint, same fields as msg/excitation_param.msg
+	 *       <type>chirp</type>               off, steps, chirp, prbs or sweep
+	 *       <amplitude>0.2</amplitude>
+	 *       <f0>0.1</f0> <f1>5</f1> <duration>20</duration>
+	 *     </joint>
+	 *   </excitation>
+	 */
+	void ModelPIDJoint::loadExcitation() {
+		std::vector< std::string > names;
+		for( int i=0; i<pid_joint_vec_.size(); i++ )
+			names.push_back( pid_joint_vec_[i]->name() );
+		
+		sdf::ElementPtr list = sdf_->HasElement("excitation") ? sdf_->GetElement("excitation") : sdf::ElementPtr();
+		uint32_t seed = 1;
+		if( list && list->HasElement("seed") )
+			seed = list->GetElement("seed")->Get<unsigned int>();
+		excitation_.configure( names, seed );
+		if( !list )
+			return;
+		
+		for( sdf::ElementPtr joint = list->HasElement("joint") ? list->GetElement("joint") : sdf::ElementPtr();
+				joint; joint = joint->GetNextElement("joint") ) {
+			std::string name = joint->GetAttribute("name") ? joint->GetAttribute("name")->GetAsString() : std::string();
+			std::map< std::string, int >::const_iterator it = joint_index_.find( name );
+			if( it == joint_index_.end() ) {
+				ROS_WARN( "excitation: unknown joint '%s'", name.c_str() );
+				continue;
+			}
+			
+			ExcitationSignal signal;
+			if( joint->HasElement("type") ) {
+				std::string type = joint->GetElement("type")->Get<std::string>();
+				signal.type = ExcitationGenerator::parseType( type );
+				if( signal.type < 0 ) {
+					ROS_WARN( "excitation: unknown signal type '%s' for joint '%s'", type.c_str(), name.c_str() );
+					continue;
+				}
+			}
+			if( joint->HasElement("offset") )
+				signal.offset = joint->GetElement("offset")->Get<double>();
+			if( joint->HasElement("amplitude") )
+				signal.amplitude = joint->GetElement("amplitude")->Get<double>();
+			if( joint->HasElement("f0") )
+				signal.f0 = joint->GetElement("f0")->Get<double>();
+			if( joint->HasElement("f1") )
+				signal.f1 = joint->GetElement("f1")->Get<double>();
+			if( joint->HasElement("duration") )
+				signal.duration = joint->GetElement("duration")->Get<double>();
+			if( joint->HasElement("hold") )
+				signal.hold = joint->GetElement("hold")->Get<double>();
+			if( joint->HasElement("seed") )
+				signal.seed = joint->GetElement("seed")->Get<unsigned int>();
+			if( joint->HasElement("repeat") )
+				signal.repeat = joint->GetElement("repeat")->Get<bool>();
+			if( joint->HasElement("levels") ) {
+				std::stringstream str_stream( joint->GetElement("levels")->Get<std::string>() );
+				double level;
+				while( str_stream >> level )
+					signal.levels.push_back( level );
+			}
+			
+			const char *error = ExcitationGenerator::check( signal );
+			if( error ) {
+				ROS_WARN( "excitation of joint '%s': %s", name.c_str(), error );
+				continue;
+			}
+			excitation_.set( it->second, signal );
+		}
+	}
+	
+	
+	/// @brief reads the gain schedules from the parameter 'gain_schedules' or the sdf (see readGainSchedules())
+	void ModelPIDJoint::loadGainSchedules() {
+		gain_scheduler_.configure( engine_.size() );
+		
+		std::vector< GainScheduleConfig > configs;
+		readGainSchedules( *nh_, sdf_, configs );
+		for( int n=0; n<configs.size(); n++ ) {
+			std::map< std::string, int >::const_iterator it = joint_index_.find( configs[n].name );
+			if( it == joint_index_.end() ) {
+				ROS_WARN( "gain schedule: unknown joint '%s'", configs[n].name.c_str() );
+				continue;
+			}
+			const char *error = GainScheduler::check( configs[n].table );
+			if( error ) {
+				ROS_WARN( "gain schedule of joint '%s': %s", configs[n].name.c_str(), error );
+				continue;
+			}
+			gain_scheduler_.set( it->second, configs[n].table );
+		}
+	}
+	
+	
+	/// @brief requests a summary of the running episodes (episode_summary_request)
+	void ModelPIDJoint::episodeRequestCallback( const std_msgs::Empty::ConstPtr &msg ) {
+		episodes_.request();
+	}
+	
+	
+	/** @brief hands the episode records of all joints ('all') or of the joints with a pending reset over to the telemetry
+	 *         thread, which builds and publishes the message. returns the end record of the summary, to be pushed by the
+	 *         caller
+	 */
+	EpisodeRecord ModelPIDJoint::pushEpisodes( double now, int reason, bool all ) {
+		EpisodeRecord r = EpisodeRecord();
+		r.episode = episode_count_++;
+		r.reason = reason;
+		r.stamp = now;
+		r.warmup = episodes_.warmup();
+		
+		for( int i=0; i<engine_.size(); i++ ) {
+			if( !all  &&  !engine_.reset_[i] )
+				continue;
+			r.joint = i;
+			r.duration = now - episodes_.start_[i];
+			r.count = episodes_.count_[i];
+			r.velocity_sq_sum = episodes_.velocity_sq_sum_[i];
+			r.angle_sq_sum = episodes_.angle_sq_sum_[i];
+			r.velocity_max = episodes_.velocity_max_[i];
+			r.angle_max = episodes_.angle_max_[i];
+			r.failed = watchdog_.failed_[i];
+			telemetry_.pushEpisode( r );
+		}
+		
+		EpisodeRecord end = EpisodeRecord();
+		end.joint = -1;
+		end.flags = TelemetryPublisher::EPISODE_END;
+		end.episode = r.episode;
+		end.reason = reason;
+		end.stamp = now;
+		end.warmup = r.warmup;
+		return end;
+	}
+	
+	
+	/// @brief applies the pending resets: the model once (if requested), then every joint that requested a reset
+	void ModelPIDJoint::applyResets() {
+		int64_t start = ParamHandoff::now();
+		
+		// the reset ends the episodes of the joints (all joints for a model reset), a new episode starts now
+		double now = time_last_update_.Double();
+		bool model = engine_.resetModelPending();
+		bool failed = false;
+		for( int i=0; i<engine_.size(); i++ )
+			failed = failed  ||  watchdog_.failed_[i];
+		EpisodeRecord end = pushEpisodes( now, failed ? 2 : 0, model );
+		for( int i=0; i<engine_.size(); i++ ) {
+			if( model  ||  engine_.reset_[i] ) {
+				episodes_.start( i, now );
+				watchdog_.start( i, now );
+			}
+		}
+		
+		if( model ) {
+			resetModel();
+			// every episode starts with the same excitation signal
+			excitation_.restart();
+		}
+		
+		int joints = 0;
+		for( int i=0; i<engine_.size(); i++ ) {
+			if( engine_.reset_[i] ) {
+				engine_.resetJoint( i );
+				joints++;
+			}
+		}
+		
+		// the time of the reset itself and the latency from the (oldest) request until now, reported with the end of the
+		// summary by the telemetry thread
+		int64_t done = ParamHandoff::now();
+		int64_t requested = engine_.takeResetRequest();
+		if( !requested )
+			requested = start;
+		end.flags |= TelemetryPublisher::EPISODE_RESET | (model ? TelemetryPublisher::EPISODE_RESET_MODEL : 0);
+		end.reset_joints = joints;
+		end.reset_time = (done - start) * 1e-9;
+		end.reset_latency = (done - requested) * 1e-9;
+		telemetry_.pushEpisode( end );
+	}
+	
+	
+	/// @brief copies the state of all joints with subscribed telemetry topics into the telemetry ring
+	void ModelPIDJoint::pushTelemetry( double stamp ) {
+		// topics that are decimated only get a record every n-th tick
+		int due = telemetry_.due( tick_ );
+		
+		// if the model topic is subscribed we need the records of all joints, the last one closes the tick
+		int model = telemetry_.wantedModel() ? TelemetryPublisher::TOPIC_MODEL & due : 0;
+		int last = engine_.size() - 1;
+		
+		for( int i=0; i<engine_.size(); i++ ) {
+			int topics = (telemetry_.wanted( i ) & due) | model;
+			if( !topics )
+				continue;
+			if( model && i == last )
+				topics |= TelemetryPublisher::TOPIC_MODEL_END;
+			
+			TelemetryRecord r;
+			r.joint = i;
+			r.topics = topics;
+			r.stamp = stamp;
+			r.desired = engine_.desired_[i];
+			r.angle = engine_.angle_[i];
+			r.angle_error = engine_.desired_[i] - engine_.angle_[i];
+			r.velocity = engine_.velocity_[i];
+			r.desired_velocity = engine_.desired_velocity_[i];
+			r.velocity_error = engine_.velocity_[i] - engine_.desired_velocity_[i];
+			r.force = engine_.force_[i];
+			r.delta_force = engine_.delta_force_[i];
+			r.p_gain = engine_.p_gain_[i];
+			r.i_gain = engine_.i_gain_[i];
+			r.d_gain = engine_.d_gain_[i];
+			r.p_error = engine_.p_error_[i];
+			r.i_error = engine_.i_error_[i];
+			r.d_error = engine_.d_error_[i];
+			telemetry_.push( r );
+		}
+	}
+	
+	
+	
+	/// @brief copies the state of all joints with an open log file into the log ring
+	void ModelPIDJoint::pushLog( const ros::Time &stamp ) {
+		for( int i=0; i<engine_.size(); i++ ) {
+			if( !log_.isOpen( i ) )
+				continue;
+			
+			JointLogRecord r;
+			r.sec = stamp.sec;
+			r.nsec = stamp.nsec;
+			r.desired = engine_.desired_[i];
+			r.angle = engine_.angle_[i];
+			r.velocity = engine_.velocity_[i];
+			r.angle_error = engine_.desired_[i] - engine_.angle_[i];
+			r.velocity_error = engine_.velocity_[i] - engine_.desired_velocity_[i];
+			log_.push( i, r );
+		}
+	}
+	
+	
+	/** @brief reads the telemetry rates from the sdf and creates the dynamic reconfigure server for them
+	 * 
+	 * sdf elements: statePeriod, stateMode, errorPeriod, errorMode, modelPeriod, modelMode. a period is given in ticks,
+	 * a mode is one of "sample", "mean", "max" and "rms" (see TelemetryPublisher). the sdf values are written to the
+	 * parameter server before the server is created, so that the initial callback does not overwrite them
+	 */
+	void ModelPIDJoint::loadTelemetryRates() {
+		static const char* names[TelemetryPublisher::N_KINDS] = { "state", "error", "model" };
+		ros::NodeHandle dyn_nh = ros::NodeHandle( *nh_, "telemetry_dyn" );
+		
+		for( int kind=0; kind<TelemetryPublisher::N_KINDS; kind++ ) {
+			std::string name( names[kind] );
+			int period = 1;
+			int mode = TelemetryPublisher::MODE_SAMPLE;
+			
+			if( sdf_->HasElement(name+"Period") )
+				period = sdf_->GetElement(name+"Period")->Get<int>();
+			if( sdf_->HasElement(name+"Mode") ) {
+				std::string mode_name = sdf_->GetElement(name+"Mode")->Get<std::string>();
+				mode = TelemetryPublisher::parseMode( mode_name );
+				if( mode < 0 ) {
+					ROS_WARN( "unknown telemetry mode '%s' for the %s topics, using 'sample'", mode_name.c_str(), names[kind] );
+					mode = TelemetryPublisher::MODE_SAMPLE;
+				}
+			}
+			
+			telemetry_.setRate( kind, period, mode );
+			dyn_nh.setParam( name+"_period", telemetry_.period( kind ) );
+			dyn_nh.setParam( name+"_mode", telemetry_.mode( kind ) );
+		}
+		
+		telemetry_reconf_server_ = new dynamic_reconfigure::Server<gazebo_crab_plugin::telemetry_paramsConfig>( dyn_nh );
+		dynamic_reconfigure::Server<gazebo_crab_plugin::telemetry_paramsConfig>::CallbackType f;
+		f = boost::bind( &ModelPIDJoint::telemetryCallback, this, _1, _2 );
+		telemetry_reconf_server_->setCallback( f );
+	}
+	
+	
+	/// @brief dynamic reconfigure callback for the telemetry rates. the rates are atomics, so no lock is required
+	void ModelPIDJoint::telemetryCallback( gazebo_crab_plugin::telemetry_paramsConfig &config, uint32_t level ) {
+		telemetry_.setRate( TelemetryPublisher::KIND_STATE, config.state_period, config.state_mode );
+		telemetry_.setRate( TelemetryPublisher::KIND_ERROR, config.error_period, config.error_mode );
+		telemetry_.setRate( TelemetryPublisher::KIND_MODEL, config.model_period, config.model_mode );
 	}
 	
 	
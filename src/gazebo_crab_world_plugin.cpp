@@ -0,0 +1,47 @@
+#include "../include/gazebo_crab_plugin/gazebo_crab_world_plugin.hpp"
+
+// C++ headers
+#include <iostream>
+
+
+
+
+namespace gazebo {
+	
+	
+	/// @brief called when the plugin is loaded. creates the controller manager of the world
+	void WorldCrabControllers::Load( physics::WorldPtr world, sdf::ElementPtr sdf ) {
+		world_ = world;
+		manager_ = ControllerManager::create( world_->GetName() );
+		
+		// the controllers of the models are computed in parallel on 'threads' workers
+		int threads = 0;
+		int spin = 50;
+		if( sdf->HasElement("threads") )
+			threads = sdf->GetElement("threads")->Get<int>();
+		if( sdf->HasElement("workerSpin") )
+			spin = sdf->GetElement("workerSpin")->Get<int>();
+		if( threads > 0 )
+			manager_->setThreads( threads, spin );
+		
+		// one callback for all models
+		this->update_connection_ = event::Events::ConnectWorldUpdateBegin(
+			boost::bind(&WorldCrabControllers::OnUpdate, this, _1)
+		);
+		
+		std::cout << "crab controller manager loaded for world " << world_->GetName() << " (" << threads
+			<< " worker threads)" << std::endl;
+	}
+	
+	
+	/// @brief called by the world update start event. updates all attached models
+	void WorldCrabControllers::OnUpdate( const common::UpdateInfo &info ) {
+		manager_->update( info );
+	}
+	
+	
+	// register this plugin with the simulator
+	GZ_REGISTER_WORLD_PLUGIN( WorldCrabControllers )
+	
+	
+}	// end of namespace 'gazebo'
@@ -0,0 +1,36 @@
+#include "../include/gazebo_crab_plugin/gazebo_joint_access.hpp"
+
+
+
+
+namespace gazebo {
+
+
+	void GazeboJointAccess::readAngles( double *angle ) {
+		for( int i=0; i<joints_.size(); i++ )
+			angle[i] = joints_[i]->GetAngle( 0 ).Radian();	// assuming a rotary joint with a single axis/angle
+	}
+
+
+	bool GazeboJointAccess::readVelocities( double *velocity ) {
+		for( int i=0; i<joints_.size(); i++ )
+			velocity[i] = joints_[i]->GetVelocity( 0 );
+		return true;
+	}
+
+
+	void GazeboJointAccess::writeForces( const double *force ) {
+		for( int i=0; i<joints_.size(); i++ )
+			joints_[i]->SetForce( 0, force[i] );
+	}
+
+
+	void GazeboJointAccess::resetJoint( int index ) {
+		physics::Joint *joint = joints_[index];
+		joint->Reset();
+		joint->SetVelocity( 0, 0.0 );
+		joint->SetAngle( 0, 0.0 );
+	}
+
+
+}	// end of namespace 'gazebo'
@@ -0,0 +1,220 @@
+#include "../include/gazebo_crab_plugin/joint_config.hpp"
+
+// C++ headers
+#include <sstream>
+
+
+
+
+namespace gazebo {
+
+
+	/// @brief the keys of a joint entry and the fields of JointParams that they set
+	static const struct {
+		const char *key;
+		double JointParams::*value;
+	} DOUBLE_KEYS[] = {
+		{ "desired", &JointParams::desired },
+		{ "p", &JointParams::p_gain },
+		{ "i", &JointParams::i_gain },
+		{ "d", &JointParams::d_gain },
+		{ "i_max", &JointParams::i_max },
+		{ "i_min", &JointParams::i_min },
+		{ "multiplier", &JointParams::multiplier },
+		{ "max_velocity", &JointParams::max_velocity },
+		{ "damping", &JointParams::damping },
+		{ "max_force", &JointParams::max_force },
+		{ "d_filter", &JointParams::d_filter },
+		{ "tracking_time", &JointParams::tracking_time },
+		{ "velocity_alpha", &JointParams::velocity_alpha }
+	};
+
+	static const struct {
+		const char *key;
+		int JointParams::*value;
+	} INT_KEYS[] = {
+		{ "input_type", &JointParams::input_type },
+		{ "update_type", &JointParams::update_type },
+		{ "pid_form", &JointParams::pid_form },
+		{ "anti_windup", &JointParams::anti_windup },
+		{ "velocity_estimator", &JointParams::velocity_estimator },
+		{ "velocity_taps", &JointParams::velocity_taps },
+		{ "rate_divider", &JointParams::rate_divider }
+	};
+
+	static const int N_DOUBLE_KEYS = sizeof(DOUBLE_KEYS) / sizeof(DOUBLE_KEYS[0]);
+	static const int N_INT_KEYS = sizeof(INT_KEYS) / sizeof(INT_KEYS[0]);
+
+
+	/// @brief converts an int or double XmlRpc value. returns false for other types
+	static bool toDouble( XmlRpc::XmlRpcValue &value, double &result ) {
+		if( value.getType() == XmlRpc::XmlRpcValue::TypeDouble ) {
+			result = static_cast< double& >( value );
+			return true;
+		}
+		if( value.getType() == XmlRpc::XmlRpcValue::TypeInt ) {
+			result = static_cast< int& >( value );
+			return true;
+		}
+		return false;
+	}
+
+
+	/// @brief reads the joint list from the parameter server
+	static void readParam( XmlRpc::XmlRpcValue &list, std::vector< JointConfig > &configs ) {
+		if( list.getType() != XmlRpc::XmlRpcValue::TypeStruct ) {
+			ROS_WARN( "controlled_joints: expected a map of joint names" );
+			return;
+		}
+
+		for( XmlRpc::XmlRpcValue::iterator it=list.begin(); it!=list.end(); ++it ) {
+			JointConfig config;
+			config.name = it->first;
+			XmlRpc::XmlRpcValue &entry = it->second;
+
+			if( entry.getType() == XmlRpc::XmlRpcValue::TypeStruct ) {
+				for( int n=0; n<N_DOUBLE_KEYS; n++ ) {
+					if( entry.hasMember( DOUBLE_KEYS[n].key )  &&  !toDouble( entry[DOUBLE_KEYS[n].key], config.params.*DOUBLE_KEYS[n].value ) )
+						ROS_WARN( "controlled_joints/%s/%s: expected a number", config.name.c_str(), DOUBLE_KEYS[n].key );
+				}
+				for( int n=0; n<N_INT_KEYS; n++ ) {
+					double value;
+					if( !entry.hasMember( INT_KEYS[n].key ) )
+						continue;
+					if( toDouble( entry[INT_KEYS[n].key], value ) )
+						config.params.*INT_KEYS[n].value = (int)value;
+					else
+						ROS_WARN( "controlled_joints/%s/%s: expected a number", config.name.c_str(), INT_KEYS[n].key );
+				}
+			}
+
+			configs.push_back( config );
+		}
+	}
+
+
+	/// @brief reads the joint list from the sdf (<joint name="..."> elements)
+	static void readSdf( sdf::ElementPtr list, std::vector< JointConfig > &configs ) {
+		for( sdf::ElementPtr joint = list->HasElement("joint") ? list->GetElement("joint") : sdf::ElementPtr();
+				joint; joint = joint->GetNextElement("joint") ) {
+			JointConfig config;
+			if( joint->GetAttribute("name") )
+				config.name = joint->GetAttribute("name")->GetAsString();
+			else if( joint->HasElement("name") )
+				config.name = joint->GetElement("name")->Get<std::string>();
+			if( config.name.empty() ) {
+				ROS_WARN( "controlledJoints: joint without a name" );
+				continue;
+			}
+
+			for( int n=0; n<N_DOUBLE_KEYS; n++ ) {
+				if( joint->HasElement( DOUBLE_KEYS[n].key ) )
+					config.params.*DOUBLE_KEYS[n].value = joint->GetElement( DOUBLE_KEYS[n].key )->Get<double>();
+			}
+			for( int n=0; n<N_INT_KEYS; n++ ) {
+				if( joint->HasElement( INT_KEYS[n].key ) )
+					config.params.*INT_KEYS[n].value = joint->GetElement( INT_KEYS[n].key )->Get<int>();
+			}
+
+			configs.push_back( config );
+		}
+	}
+
+
+	bool readJointConfigs( const ros::NodeHandle &nh, sdf::ElementPtr sdf, std::vector< JointConfig > &configs ) {
+		configs.clear();
+
+		XmlRpc::XmlRpcValue list;
+		if( nh.getParam( "controlled_joints", list ) ) {
+			readParam( list, configs );
+			return true;
+		}
+
+		if( sdf->HasElement("controlledJoints") ) {
+			readSdf( sdf->GetElement("controlledJoints"), configs );
+			return true;
+		}
+
+		return false;
+	}
+
+
+	/// @brief the keys of a gain schedule and the fields of GainTable that they set
+	static const struct {
+		const char *key;
+		std::vector< double > GainTable::*value;
+	} TABLE_KEYS[] = {
+		{ "angle", &GainTable::angle },
+		{ "velocity", &GainTable::velocity },
+		{ "p_gain", &GainTable::p_gain },
+		{ "i_gain", &GainTable::i_gain },
+		{ "d_gain", &GainTable::d_gain }
+	};
+
+	static const int N_TABLE_KEYS = sizeof(TABLE_KEYS) / sizeof(TABLE_KEYS[0]);
+
+
+	void readGainSchedules( const ros::NodeHandle &nh, sdf::ElementPtr sdf, std::vector< GainScheduleConfig > &configs ) {
+		configs.clear();
+
+		XmlRpc::XmlRpcValue list;
+		if( nh.getParam( "gain_schedules", list ) ) {
+			if( list.getType() != XmlRpc::XmlRpcValue::TypeStruct ) {
+				ROS_WARN( "gain_schedules: expected a map of joint names" );
+				return;
+			}
+			for( XmlRpc::XmlRpcValue::iterator it=list.begin(); it!=list.end(); ++it ) {
+				GainScheduleConfig config;
+				config.name = it->first;
+				XmlRpc::XmlRpcValue &entry = it->second;
+				if( entry.getType() != XmlRpc::XmlRpcValue::TypeStruct ) {
+					ROS_WARN( "gain_schedules/%s: expected a map", config.name.c_str() );
+					continue;
+				}
+
+				for( int n=0; n<N_TABLE_KEYS; n++ ) {
+					if( !entry.hasMember( TABLE_KEYS[n].key ) )
+						continue;
+					XmlRpc::XmlRpcValue &values = entry[TABLE_KEYS[n].key];
+					std::vector< double > &table_values = config.table.*TABLE_KEYS[n].value;
+					bool valid = values.getType() == XmlRpc::XmlRpcValue::TypeArray;
+					for( int k=0; valid && k<values.size(); k++ ) {
+						double value;
+						valid = toDouble( values[k], value );
+						table_values.push_back( value );
+					}
+					if( !valid )
+						ROS_WARN( "gain_schedules/%s/%s: expected a list of numbers", config.name.c_str(), TABLE_KEYS[n].key );
+				}
+				configs.push_back( config );
+			}
+			return;
+		}
+
+		if( !sdf->HasElement("gainSchedules") )
+			return;
+		sdf::ElementPtr schedules = sdf->GetElement("gainSchedules");
+		for( sdf::ElementPtr joint = schedules->HasElement("joint") ? schedules->GetElement("joint") : sdf::ElementPtr();
+				joint; joint = joint->GetNextElement("joint") ) {
+			GainScheduleConfig config;
+			if( joint->GetAttribute("name") )
+				config.name = joint->GetAttribute("name")->GetAsString();
+			if( config.name.empty() ) {
+				ROS_WARN( "gainSchedules: joint without a name" );
+				continue;
+			}
+
+			for( int n=0; n<N_TABLE_KEYS; n++ ) {
+				if( !joint->HasElement( TABLE_KEYS[n].key ) )
+					continue;
+				std::stringstream str_stream( joint->GetElement( TABLE_KEYS[n].key )->Get<std::string>() );
+				double value;
+				while( str_stream >> value )
+					(config.table.*TABLE_KEYS[n].value).push_back( value );
+			}
+			configs.push_back( config );
+		}
+	}
+
+
+}	// end of namespace 'gazebo'
@@ -0,0 +1,440 @@
+#include "../include/gazebo_crab_plugin/joint_engine.hpp"
+
+// C++ headers
+#include <math.h>		// M_PI
+
+
+
+
+namespace gazebo {
+
+
+	int JointEngine::addJoint( ParamHandoff *handoff ) {
+		int index = size_++;
+
+		desired_.push_back( 0.0 );
+		angle_.push_back( 0.0 );
+		velocity_.push_back( 0.0 );
+		desired_velocity_.push_back( 0.0 );
+		force_.push_back( 0.0 );
+		delta_force_.push_back( 0.0 );
+		velocity_state_.push_back( VelocityState() );
+		joint_velocity_.push_back( 0.0 );
+
+		p_gain_.push_back( 0.0 );
+		i_gain_.push_back( 0.0 );
+		d_gain_.push_back( 0.0 );
+		i_max_.push_back( 0.0 );
+		i_min_.push_back( 0.0 );
+		p_error_.push_back( 0.0 );
+		i_error_.push_back( 0.0 );
+		d_error_.push_back( 0.0 );
+		c_p_.push_back( 0.0 );
+		c_i_.push_back( 0.0 );
+		c_d_.push_back( 0.0 );
+		c_filter_.push_back( 0.0 );
+		c_slope_.push_back( 0.0 );
+		c_track_.push_back( 0.0 );
+		c_i_lo_.push_back( 0.0 );
+		c_i_hi_.push_back( 0.0 );
+
+		multiplier_.push_back( 1.0 );
+		max_force_.push_back( 5.0 );
+		max_velocity_.push_back( 2*M_PI );
+		damping_.push_back( 0.0 );
+		input_type_.push_back( 0 );
+		update_type_.push_back( 1 );
+		pid_form_.push_back( 0 );
+		anti_windup_.push_back( 0 );
+		d_filter_.push_back( 0.0 );
+		tracking_time_.push_back( 0.0 );
+		velocity_estimator_.push_back( velocity_estimator::TICK_DIFFERENCE );
+		velocity_taps_.push_back( 4 );
+		velocity_alpha_.push_back( 0.5 );
+		reset_.push_back( false );
+		handoff_.push_back( handoff );
+		param_desired_.push_back( 0.0 );
+		rate_divider_.push_back( 1 );
+		rate_phase_.push_back( 0 );
+		coeff_dt_.push_back( 0.0 );
+		update_time_.push_back( NAN );
+
+		// at most one run per joint and tick of the schedule, so that scheduling on the physics thread does not allocate
+		runs_.reserve( MAX_RATE_DIVIDER * size_ );
+		run_divider_.reserve( MAX_RATE_DIVIDER * size_ );
+		regroup_ = true;
+
+		return index;
+	}
+
+
+	void JointEngine::applyParams() {
+		unsigned int version = param_version_.load( std::memory_order_acquire );
+		if( version == applied_version_ )
+			return;
+		applied_version_ = version;
+
+		for( int i=0; i<size_; i++ ) {
+			// flags first: the parameters that belong to them are published before the flags, so take() finds them
+			int flags = handoff_[i]->takeFlags();
+
+			JointParams p;
+			if( handoff_[i]->take( p ) ) {
+				param_desired_[i] = p.desired;
+				setGains( i, p.p_gain, p.i_gain, p.d_gain, p.i_max, p.i_min );
+				multiplier_[i] = p.multiplier;
+				max_force_[i] = p.max_force;
+				max_velocity_[i] = p.max_velocity;
+				damping_[i] = p.damping;
+				d_filter_[i] = p.d_filter;
+				tracking_time_[i] = p.tracking_time;
+				if( input_type_[i] != p.input_type  ||  update_type_[i] != p.update_type  ||  pid_form_[i] != p.pid_form
+						||  anti_windup_[i] != p.anti_windup )
+					regroup_ = true;
+
+				// the state of the two forms has different units (integrated error vs. integral term)
+				if( pid_form_[i] != p.pid_form )
+					resetPid( i );
+				input_type_[i] = p.input_type;
+				update_type_[i] = p.update_type;
+				pid_form_[i] = p.pid_form;
+				anti_windup_[i] = p.anti_windup;
+				updateCoefficients( i );
+
+				// a new estimator starts with a fresh history (the state of the alpha-beta tracker belongs to the old one)
+				if( velocity_estimator_[i] != p.velocity_estimator ) {
+					joint_velocity_joints_ += (p.velocity_estimator == velocity_estimator::JOINT_VELOCITY)
+						- (velocity_estimator_[i] == velocity_estimator::JOINT_VELOCITY);
+					velocity_estimator::reset( velocity_state_[i] );
+				}
+				velocity_estimator_[i] = p.velocity_estimator;
+				velocity_taps_[i] = p.velocity_taps;
+				velocity_alpha_[i] = p.velocity_alpha;
+
+				int divider = rateDivider( p.rate_divider );
+				if( rate_divider_[i] != divider )
+					regroup_ = true;
+				rate_divider_[i] = divider;
+			}
+
+			// the set with the new desired state may have been taken at the last call already
+			if( flags & ParamHandoff::SET_DESIRED )
+				desired_[i] = param_desired_[i];
+			if( flags & ParamHandoff::RESET_PID )
+				resetPid( i );
+			if( flags & ParamHandoff::RESET_SIMULATION ) {
+				if( (flags & ParamHandoff::RESET_JOINT)  &&  !reset_[i] ) {
+					reset_[i] = true;
+					reset_joints_++;
+				}
+				if( flags & ParamHandoff::RESET_MODEL )
+					reset_model_ = true;
+
+				// remember the oldest request (for the reset latency)
+				int64_t time = handoff_[i]->takeResetTime();
+				if( time  &&  (!reset_time_  ||  time < reset_time_) )
+					reset_time_ = time;
+			}
+		}
+	}
+
+
+	void JointEngine::setGains( int index, double p, double i, double d, double i_max, double i_min ) {
+		p_gain_[index] = p;
+		i_gain_[index] = i;
+		d_gain_[index] = d;
+		i_max_[index] = i_max;
+		i_min_[index] = i_min;
+		updateCoefficients( index );
+	}
+
+
+	void JointEngine::updateCoefficients( int index ) {
+		pid_kernel::coefficients( batch(), coeff_dt_[index], index, index+1 );
+	}
+
+
+	int JointEngine::rateDivider( int divider ) {
+		int result = 1;
+		while( result < MAX_RATE_DIVIDER  &&  2*result <= divider )
+			result *= 2;
+		return result;
+	}
+
+
+	void JointEngine::schedule() {
+		period_ = 1;
+		for( int i=0; i<size_; i++ ) {
+			if( rate_divider_[i] > period_ )
+				period_ = rate_divider_[i];
+		}
+
+		// phases: chunks of consecutive joints with the same divider go to the least loaded tick (greedy), the load of a
+		// tick is the number of joints computed on it
+		int load[MAX_RATE_DIVIDER] = { 0 };
+		int i = 0;
+		while( i < size_ ) {
+			int divider = rate_divider_[i];
+			int group_end = i + 1;
+			while( group_end < size_  &&  rate_divider_[group_end] == divider )
+				group_end++;
+
+			// a group is split into one chunk per tick, but not into chunks smaller than SCHEDULE_CHUNK
+			int chunk = (group_end - i + divider - 1) / divider;
+			if( chunk < SCHEDULE_CHUNK )
+				chunk = SCHEDULE_CHUNK;
+			for( ; i<group_end; i+=chunk ) {
+				int end = i + chunk < group_end ? i + chunk : group_end;
+
+				int phase = 0;
+				int best = -1;
+				for( int p=0; p<divider; p++ ) {
+					int worst = 0;
+					for( int t=p; t<period_; t+=divider )
+						worst = load[t] > worst ? load[t] : worst;
+					if( best < 0  ||  worst < best ) {
+						best = worst;
+						phase = p;
+					}
+				}
+				for( int t=phase; t<period_; t+=divider )
+					load[t] += end - i;
+				for( int n=i; n<end; n++ )
+					rate_phase_[n] = phase;
+			}
+		}
+
+		// runs of every tick: consecutive joints that are due, with the same kernel and divider
+		PidBatch b = batch();
+		runs_.clear();
+		run_divider_.clear();
+		for( int t=0; t<period_; t++ ) {
+			phase_begin_[t] = runs_.size();
+			for( int n=0; n<size_; n++ ) {
+				if( (t & (rate_divider_[n] - 1)) != rate_phase_[n] )
+					continue;
+				pid_kernel::Kernel kernel = pid_kernel::select( b.input_type[n], b.update_type[n], b.pid_form[n], b.anti_windup[n] );
+				if( (int)runs_.size() > phase_begin_[t]  &&  runs_.back().end == n  &&  runs_.back().kernel == kernel
+						&&  rate_divider_[runs_.back().begin] == rate_divider_[n] ) {
+					runs_.back().end = n + 1;
+				} else {
+					pid_kernel::Run run;
+					run.begin = n;
+					run.end = n + 1;
+					run.kernel = kernel;
+					runs_.push_back( run );
+				}
+			}
+
+			// joints with a different mode each are computed by one scalar run
+			pid_kernel::coalesce( runs_, phase_begin_[t], rate_divider_.data() );
+			for( size_t n=run_divider_.size(); n<runs_.size(); n++ )
+				run_divider_.push_back( rate_divider_[runs_[n].begin] );
+		}
+		phase_begin_[period_] = runs_.size();
+
+		// the joints may have moved to runs with another dt, and to another tick (the time since their last update is not
+		// the period of the new schedule)
+		for( int n=0; n<size_; n++ ) {
+			coeff_dt_[n] = 0.0;
+			update_time_[n] = NAN;
+		}
+	}
+
+
+	int JointEngine::scheduledJoints( int phase ) const {
+		int joints = 0;
+		for( int n=phase_begin_[phase % period_]; n<phase_begin_[phase % period_ + 1]; n++ )
+			joints += runs_[n].end - runs_[n].begin;
+		return joints;
+	}
+
+
+	void JointEngine::getGains( int index, double &p, double &i, double &d, double &i_max, double &i_min ) const {
+		p = p_gain_[index];
+		i = i_gain_[index];
+		d = d_gain_[index];
+		i_max = i_max_[index];
+		i_min = i_min_[index];
+	}
+
+
+	void JointEngine::resetPid( int index ) {
+		p_error_[index] = 0.0;
+		i_error_[index] = 0.0;
+		d_error_[index] = 0.0;
+		clearUpdateTime( index );
+	}
+
+
+	void JointEngine::clearUpdateTime( int index ) {
+		// the joints of a run share one dt, so the whole run starts over. a joint is in the same run on every tick that
+		// it is due (the joints of a run have the same divider and phase)
+		for( size_t n=0; n<runs_.size(); n++ ) {
+			if( runs_[n].begin <= index  &&  index < runs_[n].end ) {
+				for( int i=runs_[n].begin; i<runs_[n].end; i++ )
+					update_time_[i] = NAN;
+			}
+		}
+	}
+
+
+	void JointEngine::resetJoint( int index ) {
+		access_->resetJoint( index );
+
+		angle_[index] = 0.0;
+		desired_velocity_[index] = 0.0;
+		delta_force_[index] = 0.0;
+		force_[index] = 0.0;
+		velocity_estimator::reset( velocity_state_[index] );
+		clearUpdateTime( index );
+
+		if( reset_[index] ) {
+			reset_[index] = false;
+			reset_joints_--;
+		}
+	}
+
+
+	void JointEngine::requestReset( int index, bool model ) {
+		if( !reset_[index] ) {
+			reset_[index] = true;
+			reset_joints_++;
+		}
+		if( model )
+			reset_model_ = true;
+	}
+
+
+	int64_t JointEngine::takeResetRequest() {
+		int64_t time = reset_time_;
+		reset_time_ = 0;
+		reset_model_ = false;
+		return time;
+	}
+
+
+	PidBatch JointEngine::batch() {
+		PidBatch b;
+		b.size = size_;
+		b.angle = angle_.data();
+		b.velocity = velocity_.data();
+		b.desired = desired_.data();
+		b.p_gain = p_gain_.data();
+		b.i_gain = i_gain_.data();
+		b.d_gain = d_gain_.data();
+		b.i_max = i_max_.data();
+		b.i_min = i_min_.data();
+		b.multiplier = multiplier_.data();
+		b.max_force = max_force_.data();
+		b.max_velocity = max_velocity_.data();
+		b.damping = damping_.data();
+		b.input_type = input_type_.data();
+		b.update_type = update_type_.data();
+		b.pid_form = pid_form_.data();
+		b.anti_windup = anti_windup_.data();
+		b.d_filter = d_filter_.data();
+		b.tracking_time = tracking_time_.data();
+		b.c_p = c_p_.data();
+		b.c_i = c_i_.data();
+		b.c_d = c_d_.data();
+		b.c_filter = c_filter_.data();
+		b.c_slope = c_slope_.data();
+		b.c_track = c_track_.data();
+		b.c_i_lo = c_i_lo_.data();
+		b.c_i_hi = c_i_hi_.data();
+		b.desired_velocity = desired_velocity_.data();
+		b.p_error = p_error_.data();
+		b.i_error = i_error_.data();
+		b.d_error = d_error_.data();
+		b.force = force_.data();
+		b.delta_force = delta_force_.data();
+		return b;
+	}
+
+
+	void JointEngine::read( double dt ) {
+		int64_t t = profiler_ ? LatencyProfiler::now() : 0;
+		
+		// read the state of all joints first, so that the controller only touches our own arrays
+		access_->readAngles( angle_.data() );
+		bool joint_velocity = joint_velocity_joints_ > 0  &&  access_->readVelocities( joint_velocity_.data() );
+		
+		// push the angles into the histories and estimate the velocities
+		VelocityBatch b;
+		b.size = size_;
+		b.angle = angle_.data();
+		b.joint_velocity = joint_velocity ? joint_velocity_.data() : NULL;
+		b.estimator = velocity_estimator_.data();
+		b.taps = velocity_taps_.data();
+		b.alpha = velocity_alpha_.data();
+		b.state = velocity_state_.data();
+		b.velocity = velocity_.data();
+		velocity_estimator::estimate( b, dt, 0, size_ );
+		
+		if( profiler_ )
+			profiler_->lap( LatencyProfiler::PHASE_READ, t );
+	}
+
+
+	void JointEngine::compute( double dt ) {
+		int64_t t = profiler_ ? LatencyProfiler::now() : 0;
+		
+		// compute the new forces of the joints that are due at this tick, one specialized kernel per run of joints with
+		// the same modes and rate
+		PidBatch b = batch();
+		if( regroup_ ) {
+			schedule();
+			regroup_ = false;
+		}
+		time_ += dt;
+		int phase = tick_ & (period_ - 1);
+
+		// with gain schedules, the lookup and the kernel alternate block by block, so that the kernel finds the gains and
+		// the inputs that the lookup just touched in the cache
+		bool scheduled = false;
+		if( scheduler_ ) {
+			scheduler_->update();
+			scheduled = scheduler_->active();
+		}
+
+		for( int n=phase_begin_[phase]; n<phase_begin_[phase+1]; n++ ) {
+			const pid_kernel::Run &run = runs_[n];
+			double run_dt = runDt( n, dt );
+			// the difference of the running time jitters in the last bits, the coefficients are only recomputed for a
+			// real change of dt
+			if( fabs( run_dt - coeff_dt_[run.begin] ) > 1e-9 * run_dt ) {
+				pid_kernel::coefficients( b, run_dt, run.begin, run.end );
+				for( int i=run.begin; i<run.end; i++ )
+					coeff_dt_[i] = run_dt;
+			}
+			if( scheduled ) {
+				for( int begin=run.begin; begin<run.end; begin+=SCHEDULE_BLOCK ) {
+					int end = begin + SCHEDULE_BLOCK < run.end ? begin + SCHEDULE_BLOCK : run.end;
+					scheduler_->apply( b, run_dt, begin, end, p_gain_.data(), i_gain_.data(), d_gain_.data() );
+					run.kernel( b, run_dt, begin, end );
+				}
+			} else {
+				run.kernel( b, run_dt, run.begin, run.end );
+			}
+			for( int i=run.begin; i<run.end; i++ )
+				update_time_[i] = time_;
+		}
+		tick_++;
+		
+		if( profiler_ )
+			profiler_->lap( LatencyProfiler::PHASE_COMPUTE, t );
+	}
+
+
+	void JointEngine::write() {
+		int64_t t = profiler_ ? LatencyProfiler::now() : 0;
+		
+		// apply the new forces
+		access_->writeForces( force_.data() );
+		if( profiler_ )
+			profiler_->lap( LatencyProfiler::PHASE_WRITE, t );
+	}
+
+
+}	// end of namespace 'gazebo'
@@ -0,0 +1,192 @@
+#include "../include/gazebo_crab_plugin/joint_log.hpp"
+
+// C++ headers
+#include <string.h>
+#include <iostream>
+#include <chrono>
+
+// BOOST headers
+#include <boost/filesystem.hpp>
+
+
+
+
+namespace gazebo {
+
+
+	/// @brief size of the stdio buffer of every log file
+	static const size_t FILE_BUFFER_SIZE = 1 << 20;
+
+
+	void JointLogWriter::configure( const std::string &directory, uint64_t max_file_size, int joints ) {
+		directory_ = directory;
+		if( !directory_.empty() && directory_[directory_.size()-1] != '/' )
+			directory_ += "/";
+		max_file_size_ = max_file_size;
+
+		// create path & folders (if not already exists)
+		boost::system::error_code ec;
+		boost::filesystem::create_directories( boost::filesystem::path(directory_), ec );
+		if( ec ) {
+			std::cout << "failed to create directory '" << directory_ << "', error=" << ec.message() << std::endl;
+		}
+
+		files_.clear();
+		for( int i=0; i<joints; i++ )
+			files_.push_back( std::unique_ptr< File >( new File() ) );
+	}
+
+
+	void JointLogWriter::start( size_t capacity ) {
+		if( running_ )
+			return;
+
+		ring_.reset( new SpscRing< Entry >( capacity ) );
+		running_ = true;
+		thread_ = std::thread( &JointLogWriter::run, this );
+	}
+
+
+	void JointLogWriter::stop() {
+		if( !running_ )
+			return;
+
+		running_ = false;
+		if( thread_.joinable() )
+			thread_.join();
+
+		// write what is left and close the files
+		Entry entry;
+		while( ring_->pop( entry ) )
+			write( entry );
+		for( int i=0; i<(int)files_.size(); i++ )
+			close( i );
+	}
+
+
+	bool JointLogWriter::open( int joint, const std::string &name, const std::string &text ) {
+		File &file = *files_[joint];
+		std::lock_guard<std::mutex> lock( file.mutex );
+
+		closePart( file );
+		file.name = name;
+		file.text = text;
+		file.part = 0;
+		if( !openPart( file ) ) {
+			if( file.open.exchange( false ) )
+				active_--;
+			return false;
+		}
+
+		std::cout << "log file=" << directory_ << name << ".bin" << std::endl;
+		if( !file.open.exchange( true ) )
+			active_++;
+		return true;
+	}
+
+
+	void JointLogWriter::close( int joint ) {
+		File &file = *files_[joint];
+		std::lock_guard<std::mutex> lock( file.mutex );
+
+		if( file.open.exchange( false ) )
+			active_--;
+		closePart( file );
+	}
+
+
+	void JointLogWriter::run() {
+		const std::chrono::milliseconds idle_sleep( 1 );		// sleep time if the ring is empty
+		const int flush_interval = 100;							// flush the files every 100 idle loops (~100ms)
+		int idle_count = 0;
+		bool written = false;									// something was written since the last flush
+		Entry entry;
+
+		while( running_ ) {
+			bool empty = true;
+			while( ring_->pop( entry ) ) {
+				write( entry );
+				empty = false;
+				written = true;
+			}
+
+			if( empty ) {
+				if( written  &&  ++idle_count >= flush_interval ) {
+					idle_count = 0;
+					written = false;
+					for( int i=0; i<(int)files_.size(); i++ ) {
+						std::lock_guard<std::mutex> lock( files_[i]->mutex );
+						if( files_[i]->file )
+							fflush( files_[i]->file );
+					}
+				}
+				std::this_thread::sleep_for( idle_sleep );
+			}
+		}
+	}
+
+
+	void JointLogWriter::write( const Entry &entry ) {
+		File &file = *files_[entry.joint];
+		std::lock_guard<std::mutex> lock( file.mutex );
+
+		// the file was closed after the record was queued
+		if( !file.file )
+			return;
+
+		// size-based rotation
+		if( max_file_size_ > 0  &&  file.size + sizeof(JointLogRecord) > max_file_size_ ) {
+			closePart( file );
+			file.part++;
+			if( !openPart( file ) ) {
+				if( file.open.exchange( false ) )
+					active_--;
+				return;
+			}
+		}
+
+		fwrite( &entry.record, sizeof(JointLogRecord), 1, file.file );
+		file.size += sizeof(JointLogRecord);
+	}
+
+
+	bool JointLogWriter::openPart( File &file ) {
+		std::string path = directory_ + file.name;
+		if( file.part > 0 ) {
+			char str[32];
+			snprintf( str, 32, ".%i", file.part );
+			path += str;
+		}
+		path += ".bin";
+
+		file.file = fopen( path.c_str(), "wb" );
+		if( !file.file ) {
+			std::cout << "failed to open log file '" << path << "'" << std::endl;
+			return false;
+		}
+		file.buffer.resize( FILE_BUFFER_SIZE );
+		setvbuf( file.file, &file.buffer[0], _IOFBF, file.buffer.size() );
+
+		JointLogFileHeader header;
+		memset( &header, 0, sizeof(header) );
+		strncpy( header.magic, JOINT_LOG_MAGIC, sizeof(header.magic) );
+		header.version = JOINT_LOG_VERSION;
+		header.record_size = sizeof(JointLogRecord);
+		header.text_size = file.text.size();
+		fwrite( &header, sizeof(header), 1, file.file );
+		fwrite( file.text.data(), 1, file.text.size(), file.file );
+		file.size = sizeof(header) + file.text.size();
+		return true;
+	}
+
+
+	void JointLogWriter::closePart( File &file ) {
+		if( !file.file )
+			return;
+		fclose( file.file );
+		file.file = NULL;
+		file.size = 0;
+	}
+
+
+}	// end of namespace 'gazebo'
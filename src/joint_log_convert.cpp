@@ -0,0 +1,99 @@
+// project headers
+#include "../include/gazebo_crab_plugin/joint_log.hpp"
+
+// C++ headers
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+
+
+
+/** @brief converts binary joint log files (written by JointLogWriter) to the text format of the old log files:
+ *         a parameter line starting with '#', followed by one line per tick with the fields
+ *         time, target angle, current angle, velocity, position error and velocity error
+ *
+ * usage: joint_log_convert <file.bin> [<file.bin> ...]
+ *        every file is written next to the input file, with the extension '.log' instead of '.bin'
+ */
+
+
+/// @brief converts a single file. returns false on error
+bool convert( const std::string &in_path, const std::string &out_path ) {
+	FILE *in = fopen( in_path.c_str(), "rb" );
+	if( !in ) {
+		std::cout << "failed to open '" << in_path << "'" << std::endl;
+		return false;
+	}
+
+	gazebo::JointLogFileHeader header;
+	if( fread( &header, sizeof(header), 1, in ) != 1  ||  strncmp( header.magic, JOINT_LOG_MAGIC, sizeof(header.magic) ) != 0 ) {
+		std::cout << "'" << in_path << "' is not a joint log file" << std::endl;
+		fclose( in );
+		return false;
+	}
+	if( header.version != JOINT_LOG_VERSION  ||  header.record_size != sizeof(gazebo::JointLogRecord) ) {
+		std::cout << "'" << in_path << "' has an unsupported version (" << header.version
+			<< ", record size " << header.record_size << ")" << std::endl;
+		fclose( in );
+		return false;
+	}
+
+	std::vector< char > text( header.text_size );
+	if( header.text_size > 0  &&  fread( &text[0], 1, header.text_size, in ) != header.text_size ) {
+		std::cout << "'" << in_path << "' is truncated" << std::endl;
+		fclose( in );
+		return false;
+	}
+
+	std::ofstream out( out_path.c_str(), std::ios::out );
+	if( !out.is_open() ) {
+		std::cout << "failed to create '" << out_path << "'" << std::endl;
+		fclose( in );
+		return false;
+	}
+	out.write( text.data(), text.size() );
+
+	// log fields: time, target_angle, current_angle, velocity, error (same formatting as ros::Time and double)
+	gazebo::JointLogRecord r;
+	char stamp[32];
+	long count = 0;
+	while( fread( &r, sizeof(r), 1, in ) == 1 ) {
+		snprintf( stamp, 32, "%u.%09u", r.sec, r.nsec );
+		out << stamp
+			<< " " << r.desired
+			<< " " << r.angle
+			<< " " << r.velocity
+			<< " " << r.angle_error
+			<< " " << r.velocity_error
+			<< "\n";
+		count++;
+	}
+
+	fclose( in );
+	std::cout << in_path << " -> " << out_path << " (" << count << " records)" << std::endl;
+	return true;
+}
+
+
+int main( int argc, char **argv ) {
+	if( argc < 2 ) {
+		std::cout << "usage: " << argv[0] << " <file.bin> [<file.bin> ...]" << std::endl;
+		return 1;
+	}
+
+	bool ok = true;
+	for( int n=1; n<argc; n++ ) {
+		std::string in_path( argv[n] );
+		std::string out_path = in_path;
+		if( out_path.size() > 4  &&  out_path.compare( out_path.size()-4, 4, ".bin" ) == 0 )
+			out_path.erase( out_path.size()-4 );
+		out_path += ".log";
+
+		ok = convert( in_path, out_path ) && ok;
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+#include "../include/gazebo_crab_plugin/latency_profiler.hpp"
+
+// C++ headers
+#include <math.h>
+
+
+
+
+namespace gazebo {
+
+
+	LatencyHistogram::LatencyHistogram() : max_(0) {
+		for( int n=0; n<N_BUCKETS; n++ )
+			counts_[n].store( 0, std::memory_order_relaxed );
+	}
+
+
+	void LatencyHistogram::snapshot( std::vector< uint64_t > &counts ) const {
+		counts.resize( N_BUCKETS );
+		for( int n=0; n<N_BUCKETS; n++ )
+			counts[n] = counts_[n].load( std::memory_order_relaxed );
+	}
+
+
+	int LatencyHistogram::index( uint64_t ns ) {
+		if( ns < 2*SUB )
+			return ns;
+		if( ns >> MAX_BITS )
+			ns = (1ULL << MAX_BITS) - 1;
+
+		// the SUB_BITS+1 highest bits select the bucket: the position of the highest bit and the next SUB_BITS bits
+		int msb = 63 - __builtin_clzll( ns );
+		int shift = msb - SUB_BITS;
+		return (shift + 1) * SUB + (int)(ns >> shift) - SUB;
+	}
+
+
+	double LatencyHistogram::value( int index ) {
+		if( index < 2*SUB )
+			return index;
+		int shift = index / SUB - 1;
+		uint64_t lower = (uint64_t)(index % SUB + SUB) << shift;
+		return lower + 0.5 * ((1ULL << shift) - 1);
+	}
+
+
+	uint64_t LatencyHistogram::total( const std::vector< uint64_t > &counts ) {
+		uint64_t total = 0;
+		for( int n=0; n<counts.size(); n++ )
+			total += counts[n];
+		return total;
+	}
+
+
+	double LatencyHistogram::percentile( const std::vector< uint64_t > &counts, double q ) {
+		uint64_t total = LatencyHistogram::total( counts );
+		if( !total )
+			return 0.0;
+
+		uint64_t rank = (uint64_t)ceil( q * total );
+		if( rank < 1 )
+			rank = 1;
+		uint64_t sum = 0;
+		for( int n=0; n<counts.size(); n++ ) {
+			sum += counts[n];
+			if( sum >= rank )
+				return value( n );
+		}
+		return value( counts.size() - 1 );
+	}
+
+
+	const char* LatencyProfiler::name( int phase ) {
+		static const char* names[N_PHASES] = { "tick", "params", "setpoints", "read", "compute", "write", "episode",
+			"publish", "log" };
+		return names[phase];
+	}
+
+
+}	// end of namespace 'gazebo'
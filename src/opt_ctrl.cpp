@@ -2,6 +2,7 @@
 #include <ros/ros.h>
 #include <std_msgs/Float64.h>
 #include <std_msgs/String.h>
+#include <std_msgs/Empty.h>
 #include <dynamic_reconfigure/server.h>
 #include <control_toolbox/pid.h>
 #include <gazebo_crab_plugin/dyn_paramsConfig.h>		// auto-generated, based on ../cfg/dyn_params.cfg
@@ -22,6 +23,8 @@
 #include <gazebo_crab_plugin/pid_joint_state.h>		// auto-generated by the project, based on msg/pid_joint_state.msg
 #include <gazebo_crab_plugin/pid_joint_param.h>		// auto-generated by the project, based on msg/pid_joint_param.msg
 #include <gazebo_crab_plugin/pid_joint_error.h>		// auto-generated by the project, based on msg/pid_joint_param.msg
+#include <gazebo_crab_plugin/model_joint_state.h>	// auto-generated by the project, based on msg/model_joint_state.msg
+#include <gazebo_crab_plugin/episode_summary.h>		// auto-generated by the project, based on msg/episode_summary.msg
 
 // C++ headers
 #include <stdio.h>
@@ -88,6 +91,8 @@ class OptCtrl {
 	
 	
 	typedef gazebo_crab_plugin::pid_joint_error joint_err;
+	typedef gazebo_crab_plugin::episode_summary episode_summary;
+	typedef gazebo_crab_plugin::model_joint_state model_state;
 	
 	typedef std::vector< ros::Subscriber > vec_sub;		// subscriber (vector over joints)
 	typedef std::vector< vec_sub > vec_sub_2d;			// subscriber (vector over arms)
@@ -125,6 +130,8 @@ class OptCtrl {
 			joint_log_filename_ = log_path + "opt_ctrl.joints." + time_str + ".log";
 			pop_log_filename_ = log_path + "opt_ctrl.gen_pop." + time_str + ".log";
 			
+			use_episode_summary_ = true;	// one error summary per bot and parameter set instead of the per-tick errors
+			use_model_topic_ = true;		// one pid_joint_states subscription per bot instead of one per joint
 			generation_ = 0;
 			max_population_ = 10;
 			max_generation_ = 100;
@@ -132,18 +139,50 @@ class OptCtrl {
 			//readPopulation();		// reads starting population from a text file (optional)
 			
 			// subscribe/advertise topics
+			vec_sub_model_.resize( 10 );
 			vec_sub_err_.resize( 10 );
 			vec_pub_params_.resize( 10 );
+			vec_sub_summary_.resize( 10 );
+			vec_pub_request_.resize( 10 );
+			vec_request_pending_.resize( 10, false );
+			vec_failed_.resize( 10, false );
+			vec_vel_mean_.resize( 10 );
+			vec_pos_mean_.resize( 10 );
 			vec_time_.resize( 10 );
 			vec_vel_err_.resize( 10 );
 			vec_pos_err_.resize( 10 );
 			vec_params_.resize( 10 );
 			for( int bot_nr=1; bot_nr<=10; bot_nr++ ) {
+				if( use_episode_summary_ ) {
+					char path[256];
+					// subscribe to the episode summary and advertise the summary request. the plugin accumulates the errors
+					// after its warm-up window (sdf: episodeWarmup), we request the summary after every parameter set
+					snprintf( path, sizeof(path), "/test_%02i/episode_summary", bot_nr );
+					vec_sub_summary_[bot_nr-1] = nh_.subscribe< episode_summary >(
+						path,
+						10,	// message queue/buffer size
+						boost::bind( &OptCtrl::subSummaryCallback, this, _1, bot_nr )
+					);
+					snprintf( path, sizeof(path), "/test_%02i/episode_summary_request", bot_nr );
+					vec_pub_request_[bot_nr-1] = nh_.advertise< std_msgs::Empty >( path, 1 );
+				} else if( use_model_topic_ ) {
+					char path[256];
+					// subscribe to the model state topic (all joints of the bot in one message)
+					snprintf( path, sizeof(path), "/test_%02i/pid_joint_states", bot_nr );
+					vec_sub_model_[bot_nr-1] = nh_.subscribe< model_state >(
+						path,
+						10,	// message queue/buffer size
+						boost::bind( &OptCtrl::subModelCallback, this, _1, bot_nr )
+					);
+				}
+				
 				vec_sub_err_[bot_nr-1].resize( 1 );
 				vec_pub_params_[bot_nr-1].resize( 1 );
 				vec_time_[bot_nr-1].resize( 1 );
 				vec_vel_err_[bot_nr-1].resize( 1 );
 				vec_pos_err_[bot_nr-1].resize( 1 );
+				vec_vel_mean_[bot_nr-1].resize( 1 );
+				vec_pos_mean_[bot_nr-1].resize( 1 );
 				vec_params_[bot_nr-1].resize( 1 );
 				for( int leg_nr=1; leg_nr<=1; leg_nr++ ) {
 					vec_sub_err_[bot_nr-1][leg_nr-1].resize( 4 );
@@ -151,18 +190,22 @@ class OptCtrl {
 					vec_time_[bot_nr-1][leg_nr-1].resize( 4 );
 					vec_vel_err_[bot_nr-1][leg_nr-1].resize( 4 );
 					vec_pos_err_[bot_nr-1][leg_nr-1].resize( 4 );
+					vec_vel_mean_[bot_nr-1][leg_nr-1].resize( 4 );
+					vec_pos_mean_[bot_nr-1][leg_nr-1].resize( 4 );
 					vec_params_[bot_nr-1][leg_nr-1].resize( 4 );
 					for( int joint_nr=2; joint_nr<=3; joint_nr++ ) {
 						char path[256];
 						// topic address, e.g. "/test_01/leg_1_joint_3"
 						
-						// subscribe to joint error topic
-						snprintf( path, sizeof(path), "/test_%02i/leg_%i_joint_%i_errors", bot_nr, leg_nr, joint_nr );
-						vec_sub_err_[bot_nr-1][leg_nr-1][joint_nr] = nh_.subscribe< joint_err >(
-							path,
-							10,	// message queue/buffer size
-							boost::bind( &OptCtrl::subErrCallback, this, _1, bot_nr, leg_nr, joint_nr )
-						);
+						// subscribe to joint error topic (not needed if we get the errors through the model topic)
+						if( !use_episode_summary_  &&  !use_model_topic_ ) {
+							snprintf( path, sizeof(path), "/test_%02i/leg_%i_joint_%i_errors", bot_nr, leg_nr, joint_nr );
+							vec_sub_err_[bot_nr-1][leg_nr-1][joint_nr] = nh_.subscribe< joint_err >(
+								path,
+								10,	// message queue/buffer size
+								boost::bind( &OptCtrl::subErrCallback, this, _1, bot_nr, leg_nr, joint_nr )
+							);
+						}
 						
 						// advertise joint param publisher (topic is latched)
 						snprintf( path, sizeof(path), "/test_%02i/leg_%i_joint_%i_str_param", bot_nr, leg_nr, joint_nr );
@@ -174,6 +217,9 @@ class OptCtrl {
 				}
 			}
 			
+			// without per-tick messages the parameter sets are timed by a timer
+			if( use_episode_summary_ )
+				timer_ = nh_.createTimer( ros::Duration(0.1), &OptCtrl::timerCallback, this );
 		};
 		
 		/// @brief called to reset all states of the object
@@ -194,6 +240,7 @@ class OptCtrl {
 						vec_time_[bot_nr-1][leg_nr-1][joint_nr] = ros::Time(0,0);
 					}
 				}
+				vec_request_pending_[bot_nr-1] = false;
 			}
 			
 			// new filename
@@ -211,15 +258,113 @@ class OptCtrl {
 		/// @brief called when the joint error is published
 		void subErrCallback( const gazebo_crab_plugin::pid_joint_error::ConstPtr &msg, int bot_nr, int leg_nr, int joint_nr ) {
 			// save the joint error
-			double error = msg->velocity_error;
-			vec_vel_err_[bot_nr-1][leg_nr-1][joint_nr].push_back( error*error );	// save the square (velocity) error
-			error = msg->angle_error;
-			vec_pos_err_[bot_nr-1][leg_nr-1][joint_nr].push_back( error*error );	// save the square (position/angle) error
+			saveError( bot_nr, leg_nr, joint_nr, msg->velocity_error, msg->angle_error );
 			
 			// we only react on events from joints with joint number 3 (last in the kinematic chain)
 			if( joint_nr != 3 )
 				return;
 			
+			updateParams( bot_nr, leg_nr, joint_nr );
+		}
+		
+		/// @brief called when the model state (all joints of a bot) is published. same as subErrCallback for every joint we optimize
+		void subModelCallback( const gazebo_crab_plugin::model_joint_state::ConstPtr &msg, int bot_nr ) {
+			int size = msg->name.size();
+			bool update = false;
+			
+			for( int n=0; n<size; n++ ) {
+				// joint names look like "leg_1_joint_3"
+				int leg_nr, joint_nr;
+				if( sscanf( msg->name[n].c_str(), "leg_%i_joint_%i", &leg_nr, &joint_nr ) != 2 )
+					continue;
+				if( leg_nr != 1  ||  joint_nr < 2  ||  joint_nr > 3 )
+					continue;
+				// entries of dropped telemetry records are NaN
+				if( isnan( msg->velocity_error[n] ) )
+					continue;
+				
+				saveError( bot_nr, leg_nr, joint_nr, msg->velocity_error[n], msg->angle_error[n] );
+				update = update || joint_nr == 3;
+			}
+			
+			// we only react on events from joints with joint number 3 (last in the kinematic chain)
+			if( update )
+				updateParams( bot_nr, 1, 3 );
+		}
+		
+		/** @brief called periodically if the errors come from the episode summaries. initializes the parameters of new bots
+		 *         and requests the summary of every bot whose parameter set has been evaluated long enough
+		 */
+		void timerCallback( const ros::TimerEvent &event ) {
+			for( int bot_nr=1; bot_nr<=10; bot_nr++ ) {
+				// the plugin subscribes to the request topic, so a bot without subscriber does not exist (yet)
+				if( !vec_pub_request_[bot_nr-1].getNumSubscribers() )
+					continue;
+				
+				if( vec_time_[bot_nr-1][0][3].isZero() ) {
+					updateParams( bot_nr, 1, 3 );
+					continue;
+				}
+				
+				ros::Duration dt = ros::Time::now() - vec_time_[bot_nr-1][0][3];
+				if( dt.sec < 5  ||  vec_request_pending_[bot_nr-1] )		// we want at least 5 seconds of movement before we compute the error
+					continue;
+				
+				vec_request_pending_[bot_nr-1] = true;
+				vec_pub_request_[bot_nr-1].publish( std_msgs::Empty() );
+			}
+		}
+		
+		/// @brief called when the episode summary of a bot is published. the summary replaces the per-tick errors
+		void subSummaryCallback( const gazebo_crab_plugin::episode_summary::ConstPtr &msg, int bot_nr ) {
+			// an episode that the watchdog of the plugin aborted (reason 2) rates the current parameter set at once. the
+			// summaries of other ended episodes (reason 0) belong to parameter sets that were already evaluated
+			bool failed = false;
+			if( msg->reason == 2 ) {
+				for( int n=0; n<msg->name.size(); n++ ) {
+					int leg_nr, joint_nr;
+					if( sscanf( msg->name[n].c_str(), "leg_%i_joint_%i", &leg_nr, &joint_nr ) == 2  &&  leg_nr == 1  &&
+							joint_nr >= 2  &&  joint_nr <= 3  &&  msg->failed[n] )
+						failed = true;
+				}
+				if( !failed  ||  vec_time_[bot_nr-1][0][3].isZero() )
+					return;
+			} else if( msg->reason != 1  ||  !vec_request_pending_[bot_nr-1] ) {
+				return;
+			}
+			vec_request_pending_[bot_nr-1] = false;
+			vec_failed_[bot_nr-1] = failed;
+			
+			for( int n=0; n<msg->name.size(); n++ ) {
+				// joint names look like "leg_1_joint_3"
+				int leg_nr, joint_nr;
+				if( sscanf( msg->name[n].c_str(), "leg_%i_joint_%i", &leg_nr, &joint_nr ) != 2 )
+					continue;
+				if( leg_nr != 1  ||  joint_nr < 2  ||  joint_nr > 3 )
+					continue;
+				
+				// a failed parameter set gets the worst possible rating (never pooled)
+				double count = msg->count[n];
+				if( failed ) {
+					vec_vel_mean_[bot_nr-1][leg_nr-1][joint_nr] = std::numeric_limits<double>::infinity();
+					vec_pos_mean_[bot_nr-1][leg_nr-1][joint_nr] = std::numeric_limits<double>::infinity();
+				} else {
+					vec_vel_mean_[bot_nr-1][leg_nr-1][joint_nr] = count > 0 ? msg->velocity_sq_sum[n] / count : std::numeric_limits<double>::quiet_NaN();
+					vec_pos_mean_[bot_nr-1][leg_nr-1][joint_nr] = count > 0 ? msg->angle_sq_sum[n] / count : std::numeric_limits<double>::quiet_NaN();
+				}
+			}
+			
+			updateParams( bot_nr, 1, 3 );
+		}
+		
+		/// @brief saves the square errors of a joint for the current parameter set
+		void saveError( int bot_nr, int leg_nr, int joint_nr, double velocity_error, double angle_error ) {
+			vec_vel_err_[bot_nr-1][leg_nr-1][joint_nr].push_back( velocity_error*velocity_error );	// save the square (velocity) error
+			vec_pos_err_[bot_nr-1][leg_nr-1][joint_nr].push_back( angle_error*angle_error );			// save the square (position/angle) error
+		}
+		
+		/// @brief sets the initial parameters of the leg, or new parameters if the current set has been evaluated long enough
+		void updateParams( int bot_nr, int leg_nr, int joint_nr ) {
 			//std::cout << "subErrCallback(" << bot_nr << ", " << leg_nr << ", " << joint_nr << ")" << std::endl;
 			double p,i,d,i_clamp,max_vel,damping;
 			if( vec_time_[bot_nr-1][leg_nr-1][joint_nr].isZero() ) {
@@ -258,7 +403,7 @@ class OptCtrl {
 				//return;
 				// check duration
 				ros::Duration dt = ros::Time::now() - vec_time_[bot_nr-1][leg_nr-1][joint_nr];
-				if( dt.sec < 5 )		// we want at least 5 seconds of movement before we compute the error
+				if( dt.sec < 5  &&  !(use_episode_summary_ && vec_failed_[bot_nr-1]) )		// we want at least 5 seconds of movement before we compute the error
 					return;
 			}
 			
@@ -486,6 +631,13 @@ class OptCtrl {
 			double sum;
 			int length;
 			
+			// the plugin already computed the means (without the warm-up window)
+			if( use_episode_summary_ ) {
+				vel_error = vec_vel_mean_[bot_nr-1][leg_nr-1][joint_nr];
+				pos_error = 10000*vec_pos_mean_[bot_nr-1][leg_nr-1][joint_nr];
+				return;
+			}
+			
 			length = vec_vel_err_[bot_nr-1][leg_nr-1][joint_nr].size();
 			if( length < 1 ) {
 				vel_error = std::numeric_limits<double>::quiet_NaN();
@@ -842,6 +994,7 @@ class OptCtrl {
 	private:
         ros::NodeHandle nh_;
 		std::default_random_engine generator_;	// random number generator (requires C++11)
+        vec_sub vec_sub_model_;			// subscribers (model state, one per bot)
         vec_sub_3d vec_sub_err_;		// subscribers (joint error)
         vec_pub_3d vec_pub_params_;		// publisher (joint parameters)
         vec_time_3d vec_time_;			// timestamp of last param update
@@ -859,6 +1012,15 @@ class OptCtrl {
 		int generation_;				// the current generation
 		int max_generation_;			// if our current generation is bigger than this, then we reset everything and start anew (including a new log file)
 		int reset_count_;				// number of resets since start
+		bool use_model_topic_;			// if true, we get the joint errors from the model topic instead of the per-joint topics
+		bool use_episode_summary_;		// if true, we get the mean errors from the episode summary of the plugin (no per-tick topics)
+		vec_sub vec_sub_summary_;		// subscribers (episode summary, one per bot)
+		vec_pub vec_pub_request_;		// publisher (episode summary request, one per bot)
+		std::vector< bool > vec_request_pending_;	// true while a summary request of the bot is not answered
+		std::vector< bool > vec_failed_;			// true if the last summary of the bot was a failed episode (watchdog)
+		vec_err_3d vec_vel_mean_;		// mean square velocity error of the last summary
+		vec_err_3d vec_pos_mean_;		// mean square position error of the last summary
+		ros::Timer timer_;				// requests the summaries (only with use_episode_summary_)
 };
 
 
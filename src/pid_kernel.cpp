@@ -0,0 +1,201 @@
+#include "pid_kernel_simd.hpp"
+
+// C++ headers
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+namespace gazebo {
+namespace pid_kernel {
+
+
+	/** @brief the kernel table for this cpu: AVX2 if it was built (CRAB_PLUGIN_AVX2) and the cpu supports it, the
+	 *         baseline otherwise. the environment variable CRAB_PID_KERNEL_ISA=baseline forces the baseline (benchmarks)
+	 */
+	static const Kernel* dispatch() {
+#if defined(CRAB_PLUGIN_AVX2)
+		const char *forced = getenv( "CRAB_PID_KERNEL_ISA" );
+		if( __builtin_cpu_supports( "avx2" )  &&  !(forced  &&  strcmp( forced, "baseline" ) == 0) )
+			return avx2Kernels();
+#endif
+		return &KERNELS[0][0][0];
+	}
+
+
+	/// @brief the kernel table, chosen once
+	static const Kernel* kernels() {
+		static const Kernel *table = dispatch();
+		return table;
+	}
+
+
+	const char* isa() {
+		if( kernels() != &KERNELS[0][0][0] )
+			return "avx2";
+#if defined(__SSE2__)
+		return "sse2";
+#else
+		return "scalar";
+#endif
+	}
+
+
+	void computeScalar( const PidBatch &b, double dt, int begin, int end ) {
+		const bool dt_valid = dt > 0.0;
+
+		for( int i=begin; i<end; i++ ) {
+			double d_angle = b.desired[i] - b.angle[i];
+
+			// desired velocity: velocity to reach the target angle with the next tick, damped and clamped to the max. velocity
+			double desired_velocity = b.damping[i] * d_angle / dt;
+			desired_velocity = min_sd( max_sd( desired_velocity, -b.max_velocity[i] ), b.max_velocity[i] );
+
+			// controller input
+			const bool is_vel = b.input_type[i] == 1;
+			double error = is_vel ? desired_velocity - b.velocity[i] : d_angle;
+			b.desired_velocity[i] = is_vel ? desired_velocity : 0.0;
+			const bool valid = dt_valid  &&  (error - error) == 0.0;
+			const double force = b.force[i];
+
+			if( b.pid_form[i] != 1 ) {
+				// pid controller (see control_toolbox::Pid::computeCommand). NaN/inf errors leave the state untouched
+				double error_dot = (error - b.p_error[i]) / dt;
+				double i_error = b.i_error[i] + dt * error;
+				double i_term = max_sd( b.i_min[i], min_sd( b.i_gain[i] * i_error, b.i_max[i] ) );
+				double out = b.multiplier[i] * ( b.p_gain[i]*error + i_term + b.d_gain[i]*error_dot );
+
+				double pid_out = valid ? out : 0.0;
+				b.p_error[i] = valid ? error : b.p_error[i];
+				b.d_error[i] = valid ? error_dot : b.d_error[i];
+				b.i_error[i] = valid ? i_error : b.i_error[i];
+
+				// new force, capped at the maximum joint force
+				double new_force = ( b.update_type[i] == 1 ? force : 0.0 ) + pid_out;
+				new_force = min_sd( max_sd( new_force, -b.max_force[i] ), b.max_force[i] );
+
+				b.delta_force[i] = new_force - force;
+				b.force[i] = new_force;
+				continue;
+			}
+
+			// discrete form with precomputed coefficients (see coefficients())
+			double e1 = b.p_error[i];
+			double ed1 = b.d_error[i];
+			double i_old = b.i_error[i];
+			double ed = b.c_filter[i] * ed1 + b.c_slope[i] * (error - e1);
+			ed = max_sd( ed, -ed ) - DERIVATIVE_FLOOR > 0.0 ? ed : 0.0;
+			double increment = b.c_i[i] * error;
+			double i_term = max_sd( b.c_i_lo[i], min_sd( i_old + increment, b.c_i_hi[i] ) );
+			double out = b.c_p[i] * error + i_term + b.c_d[i] * ed;
+			double pid_out = valid ? out : 0.0;
+
+			double unclamped = ( b.update_type[i] == 1 ? force : 0.0 ) + pid_out;
+			double new_force = min_sd( max_sd( unclamped, -b.max_force[i] ), b.max_force[i] );
+
+			// anti-windup, based on the part of the output that was cut off
+			double saturation = new_force - unclamped;
+			if( b.anti_windup[i] == 1 )
+				i_term = max_sd( b.c_i_lo[i], min_sd( i_term + b.c_track[i] * saturation, b.c_i_hi[i] ) );
+			else if( b.anti_windup[i] == 2 )
+				i_term = -saturation * increment > 0.0 ? i_old : i_term;
+
+			b.p_error[i] = valid ? error : e1;
+			b.d_error[i] = valid ? ed : ed1;
+			b.i_error[i] = valid ? i_term : i_old;
+			b.delta_force[i] = new_force - force;
+			b.force[i] = new_force;
+		}
+	}
+
+
+	int scheduleGains( const PidBatch &b, const GainCells &cells, double dt, int begin, int end, double *p_gain,
+			double *i_gain, double *d_gain, int *outside ) {
+#if defined(CRAB_PLUGIN_AVX2)
+		if( kernels() != &KERNELS[0][0][0] )
+			return avx2ScheduleGains( b, cells, dt, begin, end, p_gain, i_gain, d_gain, outside );
+#endif
+		return scheduleRange( b, cells, dt, begin, end, p_gain, i_gain, d_gain, outside );
+	}
+
+
+	Kernel select( int input_type, int update_type, int pid_form, int anti_windup ) {
+		// same interpretation as the scalar reference: everything that is not 1 is position input / direct force / classic
+		// form, unknown anti-windup schemes are clamping
+		int law = pid_form == 1 ? 1 + (anti_windup == 1  ||  anti_windup == 2 ? anti_windup : 0) : 0;
+		return kernels()[law * 4 + (input_type == 1 ? 2 : 0) + (update_type == 1 ? 1 : 0)];
+	}
+
+
+	void coefficients( const PidBatch &b, double dt, int begin, int end ) {
+		for( int i=begin; i<end; i++ ) {
+			double m = b.multiplier[i];
+			double filter = b.d_filter[i] > 0.0 ? b.d_filter[i] : 0.0;
+			gainCoefficients( b, dt, i );
+			b.c_filter[i] = filter / (filter + dt);
+			b.c_slope[i] = 1.0 / (filter + dt);
+			b.c_track[i] = b.tracking_time[i] > dt ? dt / b.tracking_time[i] : 1.0;
+			b.c_i_lo[i] = min_sd( m * b.i_min[i], m * b.i_max[i] );
+			b.c_i_hi[i] = max_sd( m * b.i_min[i], m * b.i_max[i] );
+		}
+	}
+
+
+	void group( const PidBatch &b, std::vector< Run > &runs ) {
+		runs.clear();
+		for( int i=0; i<b.size; i++ ) {
+			Kernel kernel = select( b.input_type[i], b.update_type[i], b.pid_form[i], b.anti_windup[i] );
+			if( runs.empty()  ||  runs.back().kernel != kernel ) {
+				Run run;
+				run.begin = i;
+				run.end = i + 1;
+				run.kernel = kernel;
+				runs.push_back( run );
+			} else {
+				runs.back().end = i + 1;
+			}
+		}
+		coalesce( runs, 0, NULL );
+	}
+
+
+	void coalesce( std::vector< Run > &runs, size_t first, const int *divider ) {
+		// a run is short if the kernel can not do a single SIMD step
+		const int width = kernels() != &KERNELS[0][0][0] ? 4 : SimdLane::WIDTH;
+
+		size_t out = first;
+		for( size_t n=first; n<runs.size(); ) {
+			size_t last = n;
+			while( last+1 < runs.size()  &&  runs[last].end - runs[last].begin < width
+					&&  runs[last+1].end - runs[last+1].begin < width  &&  runs[last+1].begin == runs[last].end
+					&&  (!divider  ||  divider[runs[last+1].begin] == divider[runs[n].begin]) )
+				last++;
+
+			Run run = runs[n];
+			if( last > n ) {
+				run.end = runs[last].end;
+				run.kernel = &computeScalar;
+			}
+			runs[out++] = run;
+			n = last + 1;
+		}
+		runs.resize( out );
+	}
+
+
+	void compute( const PidBatch &b, double dt, const std::vector< Run > &runs ) {
+		for( size_t n=0; n<runs.size(); n++ )
+			runs[n].kernel( b, dt, runs[n].begin, runs[n].end );
+	}
+
+
+	void compute( const PidBatch &b, double dt ) {
+		std::vector< Run > runs;
+		group( b, runs );
+		compute( b, dt, runs );
+	}
+
+
+} // end of namespace 'pid_kernel'
+} // end of namespace 'gazebo'
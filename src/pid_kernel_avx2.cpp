@@ -0,0 +1,26 @@
+#include "pid_kernel_simd.hpp"
+
+#if !defined(__AVX2__)
+	#error "pid_kernel_avx2.cpp has to be built with -mavx2"
+#endif
+
+
+
+
+namespace gazebo {
+namespace pid_kernel {
+
+
+	const Kernel* avx2Kernels() {
+		return &KERNELS[0][0][0];
+	}
+
+
+	int avx2ScheduleGains( const PidBatch &b, const GainCells &cells, double dt, int begin, int end, double *p_gain,
+			double *i_gain, double *d_gain, int *outside ) {
+		return scheduleRange( b, cells, dt, begin, end, p_gain, i_gain, d_gain, outside );
+	}
+
+
+} // end of namespace 'pid_kernel'
+} // end of namespace 'gazebo'
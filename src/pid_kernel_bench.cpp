@@ -0,0 +1,184 @@
+// project headers
+#include "../include/gazebo_crab_plugin/pid_kernel.hpp"
+
+// C++ headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+
+
+
+
+/** @brief benchmark for the pid kernel. compares the scalar reference (runtime mode checks) with the specialized,
+ *         vectorized kernels (pid_kernel::compute) for different joint counts and checks that both produce the same results.
+ *
+ * the kernels are the ones that the cpu gets (AVX2 if built and supported, see pid_kernel::isa()), the environment
+ * variable CRAB_PID_KERNEL_ISA=baseline measures the SSE2 baseline instead.
+ *
+ * usage: pid_kernel_bench [ticks]
+ */
+
+
+/// @brief owns the arrays of a PidBatch. the joints get random gains, setpoints and modes (both pid forms, all anti-windup schemes)
+class BenchBatch {
+	public:
+		BenchBatch( int size, unsigned int seed ) : size_(size) {
+			std::default_random_engine generator( seed );
+			std::uniform_real_distribution<double> uni_dist( -1.0, 1.0 );
+			std::uniform_int_distribution<int> mode_dist( 0, 1 );
+			std::uniform_int_distribution<int> windup_dist( 0, 2 );
+
+			data_.resize( N_DOUBLE * size, 0.0 );
+			modes_.resize( N_MODES * size, 0 );
+			for( int i=0; i<size; i++ ) {
+				array( ANGLE )[i] = uni_dist( generator );
+				array( VELOCITY )[i] = 0.01 * uni_dist( generator );
+				array( DESIRED )[i] = uni_dist( generator );
+				array( P_GAIN )[i] = 0.3 + 0.1 * uni_dist( generator );
+				array( I_GAIN )[i] = 1.0;
+				array( D_GAIN )[i] = 0.05;
+				array( I_MAX )[i] = 0.1;
+				array( I_MIN )[i] = -0.1;
+				array( MULTIPLIER )[i] = 1.0;
+				array( MAX_FORCE )[i] = 0.5 + 0.45 * uni_dist( generator );	// some joints saturate (anti-windup)
+				array( MAX_VELOCITY )[i] = 1.0;
+				array( DAMPING )[i] = 0.05;
+				array( D_FILTER )[i] = i % 2 ? 0.0 : 0.005;
+				array( TRACKING_TIME )[i] = i % 3 ? 0.0 : 0.02;
+			}
+			// the joints of a leg share their modes, so the kernels run on groups of MODE_BLOCK joints
+			for( int i=0; i<size; i+=MODE_BLOCK ) {
+				int input_type = mode_dist( generator );
+				int update_type = mode_dist( generator );
+				int pid_form = mode_dist( generator );
+				int anti_windup = windup_dist( generator );
+				for( int n=i; n<i+MODE_BLOCK && n<size; n++ ) {
+					modes_[n] = input_type;
+					modes_[size+n] = update_type;
+					modes_[2*size+n] = pid_form;
+					modes_[3*size+n] = anti_windup;
+				}
+			}
+		}
+
+		gazebo::PidBatch batch() {
+			gazebo::PidBatch b;
+			b.size = size_;
+			b.angle = array( ANGLE );
+			b.velocity = array( VELOCITY );
+			b.desired = array( DESIRED );
+			b.p_gain = array( P_GAIN );
+			b.i_gain = array( I_GAIN );
+			b.d_gain = array( D_GAIN );
+			b.i_max = array( I_MAX );
+			b.i_min = array( I_MIN );
+			b.multiplier = array( MULTIPLIER );
+			b.max_force = array( MAX_FORCE );
+			b.max_velocity = array( MAX_VELOCITY );
+			b.damping = array( DAMPING );
+			b.input_type = &modes_[0];
+			b.update_type = &modes_[size_];
+			b.pid_form = &modes_[2*size_];
+			b.anti_windup = &modes_[3*size_];
+			b.d_filter = array( D_FILTER );
+			b.tracking_time = array( TRACKING_TIME );
+			b.c_p = array( C_P );
+			b.c_i = array( C_I );
+			b.c_d = array( C_D );
+			b.c_filter = array( C_FILTER );
+			b.c_slope = array( C_SLOPE );
+			b.c_track = array( C_TRACK );
+			b.c_i_lo = array( C_I_LO );
+			b.c_i_hi = array( C_I_HI );
+			b.desired_velocity = array( DESIRED_VELOCITY );
+			b.p_error = array( P_ERROR );
+			b.i_error = array( I_ERROR );
+			b.d_error = array( D_ERROR );
+			b.force = array( FORCE );
+			b.delta_force = array( DELTA_FORCE );
+			return b;
+		}
+
+		/// @brief moves the joints a little (so that the kernel does not run on constant input)
+		void step() {
+			double *angle = array( ANGLE );
+			const double *force = array( FORCE );
+			for( int i=0; i<size_; i++ )
+				angle[i] += 1e-4 * force[i];
+		}
+
+		/// @brief returns true if the output and state arrays of both batches are bit-identical
+		bool equals( const BenchBatch &other ) const {
+			int offset = DESIRED_VELOCITY * size_;
+			return memcmp( &data_[offset], &other.data_[offset], (N_DOUBLE*size_ - offset) * sizeof(double) ) == 0;
+		}
+
+		/// @brief number of consecutive joints with the same modes
+		static const int MODE_BLOCK = 8;
+
+	private:
+		/// @brief number of mode arrays: input_type, update_type, pid_form, anti_windup
+		static const int N_MODES = 4;
+
+		enum { ANGLE, VELOCITY, DESIRED, P_GAIN, I_GAIN, D_GAIN, I_MAX, I_MIN, MULTIPLIER, MAX_FORCE, MAX_VELOCITY,
+			DAMPING, D_FILTER, TRACKING_TIME, C_P, C_I, C_D, C_FILTER, C_SLOPE, C_TRACK, C_I_LO, C_I_HI, DESIRED_VELOCITY, P_ERROR, I_ERROR, D_ERROR, FORCE, DELTA_FORCE, N_DOUBLE };
+
+		double* array( int n ) { return &data_[n*size_]; }
+		const double* array( int n ) const { return &data_[n*size_]; }
+
+		int size_;
+		std::vector< double > data_;
+		std::vector< int > modes_;
+};
+
+
+/// @brief runs 'ticks' updates and returns the time per joint and tick in nanoseconds
+double run( BenchBatch &batch, int ticks, bool vectorized ) {
+	const double dt = 0.001;
+	gazebo::PidBatch b = batch.batch();
+	std::vector< gazebo::pid_kernel::Run > runs;
+	gazebo::pid_kernel::group( b, runs );
+	gazebo::pid_kernel::coefficients( b, dt, 0, b.size );
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for( int t=0; t<ticks; t++ ) {
+		if( vectorized ) {
+			gazebo::pid_kernel::compute( b, dt, runs );
+		} else {
+			gazebo::pid_kernel::computeScalar( b, dt, 0, b.size );
+		}
+		batch.step();
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	double ns = std::chrono::duration_cast< std::chrono::nanoseconds >( end - start ).count();
+	return ns / ((double)ticks * b.size);
+}
+
+
+int main( int argc, char** argv ) {
+	int ticks = argc > 1 ? atoi( argv[1] ) : 100000;
+	const int sizes[] = { 16, 64, 256 };
+	bool all_equal = true;
+
+	std::cout << "pid kernel benchmark, isa=" << gazebo::pid_kernel::isa() << ", ticks=" << ticks << std::endl;
+	std::cout << "joints  scalar[ns/joint/tick]  " << gazebo::pid_kernel::isa() << "[ns/joint/tick]  speedup  identical" << std::endl;
+
+	for( int n=0; n<3; n++ ) {
+		BenchBatch scalar( sizes[n], 42 );
+		BenchBatch vectorized( sizes[n], 42 );
+
+		double t_scalar = run( scalar, ticks, false );
+		double t_vector = run( vectorized, ticks, true );
+		bool equal = scalar.equals( vectorized );
+		all_equal = all_equal && equal;
+
+		printf( "%6i  %21.3f  %19.3f  %7.2f  %s\n", sizes[n], t_scalar, t_vector, t_scalar / t_vector, equal ? "yes" : "NO" );
+	}
+
+	return all_equal ? 0 : 1;
+}
@@ -0,0 +1,440 @@
+#ifndef GAZEBO_CRAB_PLUGIN_PID_KERNEL_SIMD_HPP
+#define GAZEBO_CRAB_PLUGIN_PID_KERNEL_SIMD_HPP
+
+// project headers
+#include "../include/gazebo_crab_plugin/pid_kernel.hpp"
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+
+
+
+/** @brief the specialized kernels of pid_kernel for the instruction set of the file that includes this one: the SSE2
+ *         baseline of x86-64 (or scalar code) in pid_kernel.cpp and AVX2 in pid_kernel_avx2.cpp, the only file that is
+ *         built with -mavx2. pid_kernel.cpp picks the table at runtime (see select()).
+ *
+ * the kernels are in an unnamed namespace: both files instantiate the same templates, with external linkage the linker
+ * would keep one copy of each and the baseline could end up with AVX2 instructions.
+ */
+
+
+namespace gazebo {
+namespace pid_kernel {
+
+	/// @brief the kernel table built with AVX2, [law][input_type][update_type] flattened (pid_kernel_avx2.cpp)
+	const Kernel* avx2Kernels();
+
+	/// @brief scheduleGains() built with AVX2 (pid_kernel_avx2.cpp)
+	int avx2ScheduleGains( const PidBatch &b, const GainCells &cells, double dt, int begin, int end, double *p_gain,
+		double *i_gain, double *d_gain, int *outside );
+
+namespace {
+
+
+	/// @brief same semantics as the minpd/maxpd instructions, so that the scalar and the vectorized code round alike
+	static inline double min_sd( double a, double b ) { return a < b ? a : b; }
+	static inline double max_sd( double a, double b ) { return a > b ? a : b; }
+
+	/** @brief filtered derivatives below this magnitude are set to zero. the filter decays geometrically when the joint
+	 *         settles and would run into subnormal numbers, which cost ~10x per tick (the physics thread does not flush
+	 *         them to zero, changing the mxcsr would affect the physics engine)
+	 */
+	static const double DERIVATIVE_FLOOR = 1e-150;
+
+
+	// lane types: the arithmetic of one register (1, 2 or 4 joints). the kernel below is written once against this
+	// interface and instantiated for every lane type
+
+
+	/// @brief one joint per step, used for the remaining joints of a group (and if there is no SIMD support)
+	struct ScalarLane {
+		typedef double reg;
+		typedef bool mask;
+		enum { WIDTH = 1 };
+
+		static inline reg load( const double *p ) { return *p; }
+		static inline void store( double *p, reg a ) { *p = a; }
+		static inline reg set1( double a ) { return a; }
+		static inline reg zero() { return 0.0; }
+		static inline reg add( reg a, reg b ) { return a + b; }
+		static inline reg sub( reg a, reg b ) { return a - b; }
+		static inline reg mul( reg a, reg b ) { return a * b; }
+		static inline reg div( reg a, reg b ) { return a / b; }
+		static inline reg min( reg a, reg b ) { return min_sd( a, b ); }
+		static inline reg max( reg a, reg b ) { return max_sd( a, b ); }
+		static inline reg neg( reg a ) { return -a; }
+		static inline mask positive( reg a ) { return a > 0.0; }
+		static inline mask finite( reg a ) { return (a - a) == 0.0; }
+		static inline mask less( reg a, reg b ) { return a < b; }
+		static inline mask lessEqual( reg a, reg b ) { return a <= b; }
+		static inline mask both( mask a, mask b ) { return a && b; }
+		static inline bool all( mask m ) { return m; }
+		static inline reg select( mask m, reg a, reg b ) { return m ? a : b; }
+		static inline reg keep( reg a, mask m ) { return m ? a : 0.0; }
+	};
+
+
+#if defined(__AVX2__)
+
+	/// @brief four joints per step
+	struct SimdLane {
+		typedef __m256d reg;
+		typedef __m256d mask;
+		enum { WIDTH = 4 };
+
+		static inline reg load( const double *p ) { return _mm256_loadu_pd( p ); }
+		static inline void store( double *p, reg a ) { _mm256_storeu_pd( p, a ); }
+		static inline reg set1( double a ) { return _mm256_set1_pd( a ); }
+		static inline reg zero() { return _mm256_setzero_pd(); }
+		static inline reg add( reg a, reg b ) { return _mm256_add_pd( a, b ); }
+		static inline reg sub( reg a, reg b ) { return _mm256_sub_pd( a, b ); }
+		static inline reg mul( reg a, reg b ) { return _mm256_mul_pd( a, b ); }
+		static inline reg div( reg a, reg b ) { return _mm256_div_pd( a, b ); }
+		static inline reg min( reg a, reg b ) { return _mm256_min_pd( a, b ); }
+		static inline reg max( reg a, reg b ) { return _mm256_max_pd( a, b ); }
+		static inline reg neg( reg a ) { return _mm256_xor_pd( a, _mm256_set1_pd( -0.0 ) ); }
+		static inline mask positive( reg a ) { return _mm256_cmp_pd( a, zero(), _CMP_GT_OQ ); }
+		static inline mask finite( reg a ) { return _mm256_cmp_pd( _mm256_sub_pd( a, a ), zero(), _CMP_EQ_OQ ); }
+		static inline mask less( reg a, reg b ) { return _mm256_cmp_pd( a, b, _CMP_LT_OQ ); }
+		static inline mask lessEqual( reg a, reg b ) { return _mm256_cmp_pd( a, b, _CMP_LE_OQ ); }
+		static inline mask both( mask a, mask b ) { return _mm256_and_pd( a, b ); }
+		static inline bool all( mask m ) { return _mm256_movemask_pd( m ) == 0xf; }
+		static inline reg select( mask m, reg a, reg b ) { return _mm256_blendv_pd( b, a, m ); }
+		static inline reg keep( reg a, mask m ) { return _mm256_and_pd( a, m ); }
+	};
+
+#elif defined(__SSE2__)
+
+	/// @brief two joints per step
+	struct SimdLane {
+		typedef __m128d reg;
+		typedef __m128d mask;
+		enum { WIDTH = 2 };
+
+		static inline reg load( const double *p ) { return _mm_loadu_pd( p ); }
+		static inline void store( double *p, reg a ) { _mm_storeu_pd( p, a ); }
+		static inline reg set1( double a ) { return _mm_set1_pd( a ); }
+		static inline reg zero() { return _mm_setzero_pd(); }
+		static inline reg add( reg a, reg b ) { return _mm_add_pd( a, b ); }
+		static inline reg sub( reg a, reg b ) { return _mm_sub_pd( a, b ); }
+		static inline reg mul( reg a, reg b ) { return _mm_mul_pd( a, b ); }
+		static inline reg div( reg a, reg b ) { return _mm_div_pd( a, b ); }
+		static inline reg min( reg a, reg b ) { return _mm_min_pd( a, b ); }
+		static inline reg max( reg a, reg b ) { return _mm_max_pd( a, b ); }
+		static inline reg neg( reg a ) { return _mm_xor_pd( a, _mm_set1_pd( -0.0 ) ); }
+		static inline mask positive( reg a ) { return _mm_cmpgt_pd( a, zero() ); }
+		static inline mask finite( reg a ) { return _mm_cmpeq_pd( _mm_sub_pd( a, a ), zero() ); }
+		static inline mask less( reg a, reg b ) { return _mm_cmplt_pd( a, b ); }
+		static inline mask lessEqual( reg a, reg b ) { return _mm_cmple_pd( a, b ); }
+		static inline mask both( mask a, mask b ) { return _mm_and_pd( a, b ); }
+		static inline bool all( mask m ) { return _mm_movemask_pd( m ) == 0x3; }
+		/// SSE2 has no blend instruction: (mask & a) | (~mask & b)
+		static inline reg select( mask m, reg a, reg b ) { return _mm_or_pd( _mm_and_pd( m, a ), _mm_andnot_pd( m, b ) ); }
+		static inline reg keep( reg a, mask m ) { return _mm_and_pd( a, m ); }
+	};
+
+#else
+
+	typedef ScalarLane SimdLane;
+
+#endif
+
+
+
+
+	// clamp policies: limit a value to [-limit, limit]
+
+
+	/// @brief saturates at +/- limit
+	struct SymmetricClamp {
+		template< class V >
+		static inline typename V::reg clamp( typename V::reg a, typename V::reg limit ) {
+			return V::min( V::max( a, V::neg( limit ) ), limit );
+		}
+	};
+
+
+	// input policies: compute the controller error (and the desired velocity) of the joints [i, i+WIDTH)
+
+
+	/// @brief input_type 0: the controller works on the angle error. the desired velocity is not used
+	struct PositionInput {
+		template< class V, class Clamp >
+		static inline typename V::reg error( const PidBatch &b, int i, typename V::reg d_angle, typename V::reg /*dt*/ ) {
+			V::store( b.desired_velocity + i, V::zero() );
+			return d_angle;
+		}
+	};
+
+
+	/// @brief input_type 1: the controller works on the velocity error. the desired velocity is the velocity that reaches
+	///        the target angle with the next tick, damped and clamped to the max. velocity
+	struct VelocityInput {
+		template< class V, class Clamp >
+		static inline typename V::reg error( const PidBatch &b, int i, typename V::reg d_angle, typename V::reg dt ) {
+			typedef typename V::reg reg;
+			reg desired_velocity = V::div( V::mul( V::load( b.damping + i ), d_angle ), dt );
+			desired_velocity = Clamp::template clamp<V>( desired_velocity, V::load( b.max_velocity + i ) );
+			V::store( b.desired_velocity + i, desired_velocity );
+			return V::sub( desired_velocity, V::load( b.velocity + i ) );
+		}
+	};
+
+
+	// output policies: the new (unclamped) force from the current force and the pid output
+
+
+	/// @brief update_type 0: the pid output is the force
+	struct DirectForce {
+		template< class V >
+		static inline typename V::reg force( typename V::reg /*force*/, typename V::reg pid_out ) {
+			return V::add( V::zero(), pid_out );		// 0.0 + pid_out, as in the scalar reference (sign of a zero force)
+		}
+	};
+
+
+	/// @brief update_type 1: the pid output is added to the current force
+	struct DeltaForce {
+		template< class V >
+		static inline typename V::reg force( typename V::reg force, typename V::reg pid_out ) {
+			return V::add( force, pid_out );
+		}
+	};
+
+
+
+
+	// anti-windup policies of the discrete form: correct the integral term after the force clamp. 'saturation' is the
+	// part of the output that the clamp cut off, 'increment' the integration of this tick
+
+
+	/// @brief anti_windup 0: only the limits of the integral term
+	struct ClampingWindup {
+		template< class V >
+		static inline typename V::reg correct( const PidBatch & /*b*/, int /*i*/, typename V::reg i_term, typename V::reg /*i_old*/,
+				typename V::reg /*increment*/, typename V::reg /*saturation*/ ) {
+			return i_term;
+		}
+	};
+
+
+	/// @brief anti_windup 1: back-calculation, the integral term tracks the clamped output with the gain c_track
+	struct BackCalculation {
+		template< class V >
+		static inline typename V::reg correct( const PidBatch &b, int i, typename V::reg i_term, typename V::reg /*i_old*/,
+				typename V::reg /*increment*/, typename V::reg saturation ) {
+			i_term = V::add( i_term, V::mul( V::load( b.c_track + i ), saturation ) );
+			return V::max( V::load( b.c_i_lo + i ), V::min( i_term, V::load( b.c_i_hi + i ) ) );
+		}
+	};
+
+
+	/// @brief anti_windup 2: conditional integration, no integration while the output is saturated and the error drives
+	///        it further into the saturation
+	struct ConditionalIntegration {
+		template< class V >
+		static inline typename V::reg correct( const PidBatch & /*b*/, int /*i*/, typename V::reg i_term, typename V::reg i_old,
+				typename V::reg increment, typename V::reg saturation ) {
+			return V::select( V::positive( V::mul( V::neg( saturation ), increment ) ), i_old, i_term );
+		}
+	};
+
+
+	// control laws: the pid output, the new force and the controller state of the joints [i, i+WIDTH). return the new force
+
+
+	/// @brief pid_form 0: control_toolbox::Pid::computeCommand( error, dt ). NaN/inf errors leave the state untouched
+	struct ClassicLaw {
+		template< class V, class Output, class Clamp >
+		static inline typename V::reg update( const PidBatch &b, int i, typename V::reg error, typename V::reg dt,
+				typename V::mask valid, typename V::reg force ) {
+			typedef typename V::reg reg;
+
+			reg p_error = V::load( b.p_error + i );
+			reg i_error_old = V::load( b.i_error + i );
+			reg error_dot = V::div( V::sub( error, p_error ), dt );
+			reg i_error = V::add( i_error_old, V::mul( dt, error ) );
+			reg i_term = V::max( V::load( b.i_min + i ), V::min( V::mul( V::load( b.i_gain + i ), i_error ), V::load( b.i_max + i ) ) );
+			reg out = V::add( V::add( V::mul( V::load( b.p_gain + i ), error ), i_term ), V::mul( V::load( b.d_gain + i ), error_dot ) );
+			out = V::mul( V::load( b.multiplier + i ), out );
+
+			reg pid_out = V::keep( out, valid );
+			V::store( b.p_error + i, V::select( valid, error, p_error ) );
+			V::store( b.d_error + i, V::select( valid, error_dot, V::load( b.d_error + i ) ) );
+			V::store( b.i_error + i, V::select( valid, i_error, i_error_old ) );
+
+			// new force, capped at the maximum joint force
+			return Clamp::template clamp<V>( Output::template force<V>( force, pid_out ), V::load( b.max_force + i ) );
+		}
+	};
+
+
+	/// @brief pid_form 1: discrete form with precomputed coefficients, filtered derivative and anti-windup (see the header)
+	template< class AntiWindup >
+	struct DiscreteLaw {
+		template< class V, class Output, class Clamp >
+		static inline typename V::reg update( const PidBatch &b, int i, typename V::reg error, typename V::reg /*dt*/,
+				typename V::mask valid, typename V::reg force ) {
+			typedef typename V::reg reg;
+
+			reg e1 = V::load( b.p_error + i );
+			reg ed1 = V::load( b.d_error + i );
+			reg i_old = V::load( b.i_error + i );
+			reg ed = V::add( V::mul( V::load( b.c_filter + i ), ed1 ), V::mul( V::load( b.c_slope + i ), V::sub( error, e1 ) ) );
+			ed = V::keep( ed, V::positive( V::sub( V::max( ed, V::neg( ed ) ), V::set1( DERIVATIVE_FLOOR ) ) ) );
+			reg increment = V::mul( V::load( b.c_i + i ), error );
+			reg i_term = V::max( V::load( b.c_i_lo + i ), V::min( V::add( i_old, increment ), V::load( b.c_i_hi + i ) ) );
+			reg out = V::add( V::add( V::mul( V::load( b.c_p + i ), error ), i_term ), V::mul( V::load( b.c_d + i ), ed ) );
+			reg pid_out = V::keep( out, valid );
+
+			// new force, capped at the maximum joint force
+			reg unclamped = Output::template force<V>( force, pid_out );
+			reg new_force = Clamp::template clamp<V>( unclamped, V::load( b.max_force + i ) );
+
+			i_term = AntiWindup::template correct<V>( b, i, i_term, i_old, increment, V::sub( new_force, unclamped ) );
+			V::store( b.p_error + i, V::select( valid, error, e1 ) );
+			V::store( b.d_error + i, V::select( valid, ed, ed1 ) );
+			V::store( b.i_error + i, V::select( valid, i_term, i_old ) );
+			return new_force;
+		}
+	};
+
+
+
+
+	/// @brief pid controller for the joints [i, i+WIDTH). no branch depends on the joint, the modes are compile-time policies
+	template< class V, class Input, class Law, class Output, class Clamp >
+	static inline void step( const PidBatch &b, int i, typename V::reg dt, typename V::mask dt_valid ) {
+		typedef typename V::reg reg;
+		typedef typename V::mask mask;
+
+		reg d_angle = V::sub( V::load( b.desired + i ), V::load( b.angle + i ) );
+		reg error = Input::template error<V, Clamp>( b, i, d_angle, dt );
+
+		// NaN/inf errors leave the controller state untouched
+		mask valid = V::both( dt_valid, V::finite( error ) );
+		reg force = V::load( b.force + i );
+		reg new_force = Law::template update<V, Output, Clamp>( b, i, error, dt, valid, force );
+
+		V::store( b.delta_force + i, V::sub( new_force, force ) );
+		V::store( b.force + i, new_force );
+	}
+
+
+	/// @brief runs one specialization over the joints [begin, end): SIMD steps first, the rest one joint at a time
+	template< class Input, class Law, class Output, class Clamp >
+	static void computeRange( const PidBatch &b, double dt, int begin, int end ) {
+		const typename SimdLane::reg v_dt = SimdLane::set1( dt );
+		const typename SimdLane::mask v_dt_valid = SimdLane::positive( v_dt );
+		const bool dt_valid = ScalarLane::positive( dt );
+
+		int i = begin;
+		for( ; i+SimdLane::WIDTH<=end; i+=SimdLane::WIDTH )
+			step< SimdLane, Input, Law, Output, Clamp >( b, i, v_dt, v_dt_valid );
+		for( ; i<end; i++ )
+			step< ScalarLane, Input, Law, Output, Clamp >( b, i, dt, dt_valid );
+	}
+
+
+	/// @brief the kernels of one control law, indexed by [input_type][update_type]
+	#define PID_KERNELS( Law ) { \
+		{ &computeRange< PositionInput, Law, DirectForce, SymmetricClamp >, &computeRange< PositionInput, Law, DeltaForce, SymmetricClamp > }, \
+		{ &computeRange< VelocityInput, Law, DirectForce, SymmetricClamp >, &computeRange< VelocityInput, Law, DeltaForce, SymmetricClamp > } }
+
+
+	/** @brief all specializations of this instruction set, indexed by [law][input_type][update_type], law 0: classic, 1-3:
+	 *         discrete with anti_windup 0-2. a new mode is a new policy and a new entry here
+	 */
+	static const Kernel KERNELS[4][2][2] = {
+		PID_KERNELS( ClassicLaw ),
+		PID_KERNELS( DiscreteLaw< ClampingWindup > ),
+		PID_KERNELS( DiscreteLaw< BackCalculation > ),
+		PID_KERNELS( DiscreteLaw< ConditionalIntegration > )
+	};
+
+
+
+
+	// gain schedule lookup (see scheduleGains())
+
+
+	/// @brief k[0] + k[1] angle + k[2] velocity + k[3] cross of the joints [i, i+WIDTH)
+	template< class V >
+	static inline typename V::reg polynomial( const double *const *k, int i, typename V::reg angle,
+			typename V::reg velocity, typename V::reg cross ) {
+		typename V::reg g = V::add( V::load( k[0] + i ), V::mul( V::load( k[1] + i ), angle ) );
+		g = V::add( g, V::mul( V::load( k[2] + i ), velocity ) );
+		return V::add( g, V::mul( V::load( k[3] + i ), cross ) );
+	}
+
+
+	/** @brief the gains of the joints [i, i+WIDTH) from their cells. the keys as in the scalar code of GainScheduler: the
+	 *         clamp also turns a NaN velocity into a finite one, a NaN or infinite angle counts as 0. returns false if a
+	 *         joint is outside of its cell (or has no valid cell), a joint without a schedule has an unbounded one
+	 */
+	template< class V >
+	static inline bool scheduleStep( const PidBatch &b, const GainCells &c, int i, typename V::reg dt,
+			typename V::reg inv_dt, double *p_gain, double *i_gain, double *d_gain ) {
+		typedef typename V::reg reg;
+		typedef typename V::mask mask;
+
+		reg angle = V::load( b.angle + i );
+		reg velocity = V::mul( V::mul( V::load( b.damping + i ), V::sub( V::load( b.desired + i ), angle ) ), inv_dt );
+		velocity = SymmetricClamp::clamp<V>( velocity, V::load( b.max_velocity + i ) );
+		angle = V::keep( angle, V::finite( angle ) );
+
+		mask in_angle = V::both( V::lessEqual( V::load( c.angle_lo + i ), angle ), V::less( angle, V::load( c.angle_hi + i ) ) );
+		mask in_velocity = V::both( V::lessEqual( V::load( c.velocity_lo + i ), velocity ),
+			V::less( velocity, V::load( c.velocity_hi + i ) ) );
+
+		reg cross = V::mul( angle, velocity );
+		reg p = polynomial<V>( c.p, i, angle, velocity, cross );
+		reg ig = polynomial<V>( c.i, i, angle, velocity, cross );
+		reg d = polynomial<V>( c.d, i, angle, velocity, cross );
+
+		// the joints without a schedule keep their gains and coefficients
+		mask scheduled = V::positive( V::load( c.scheduled + i ) );
+		reg m = V::load( b.multiplier + i );
+		V::store( p_gain + i, V::select( scheduled, p, V::load( p_gain + i ) ) );
+		V::store( i_gain + i, V::select( scheduled, ig, V::load( i_gain + i ) ) );
+		V::store( d_gain + i, V::select( scheduled, d, V::load( d_gain + i ) ) );
+		V::store( b.c_p + i, V::select( scheduled, V::mul( m, p ), V::load( b.c_p + i ) ) );
+		V::store( b.c_i + i, V::select( scheduled, V::mul( V::mul( m, ig ), dt ), V::load( b.c_i + i ) ) );
+		V::store( b.c_d + i, V::select( scheduled, V::mul( m, d ), V::load( b.c_d + i ) ) );
+
+		return V::all( V::both( in_angle, in_velocity ) );
+	}
+
+
+	/** @brief scheduleGains() of this instruction set: SIMD steps first, the rest one joint at a time. the groups with a
+	 *         joint outside of its cell are appended to 'outside' without a branch (the entry after the last one is
+	 *         overwritten by the next group)
+	 */
+	static int scheduleRange( const PidBatch &b, const GainCells &c, double dt, int begin, int end, double *p_gain,
+			double *i_gain, double *d_gain, int *outside ) {
+		const double inv_dt = dt > 0.0 ? 1.0 / dt : 0.0;
+		const typename SimdLane::reg v_dt = SimdLane::set1( dt );
+		const typename SimdLane::reg v_inv_dt = SimdLane::set1( inv_dt );
+
+		int count = 0;
+		int i = begin;
+		for( ; i+SimdLane::WIDTH<=end; i+=SimdLane::WIDTH ) {
+			outside[count] = i;
+			count += !scheduleStep< SimdLane >( b, c, i, v_dt, v_inv_dt, p_gain, i_gain, d_gain );
+		}
+		for( ; i<end; i++ ) {
+			outside[count] = i;
+			count += !scheduleStep< ScalarLane >( b, c, i, dt, inv_dt, p_gain, i_gain, d_gain );
+		}
+		return count;
+	}
+
+} // end of unnamed namespace
+} // end of namespace 'pid_kernel'
+} // end of namespace 'gazebo'
+
+#endif
@@ -0,0 +1,415 @@
+#include "../include/gazebo_crab_plugin/telemetry.hpp"
+
+// ROS headers
+#include <std_msgs/UInt64.h>
+#include <std_msgs/Float64.h>
+#include <gazebo_crab_plugin/pid_joint_state.h>		// auto-generated by the project, based on msg/pid_joint_state.msg
+#include <gazebo_crab_plugin/pid_joint_error.h>		// auto-generated by the project, based on msg/pid_joint_error.msg
+
+// C++ headers
+#include <math.h>
+#include <chrono>
+#include <limits>
+
+
+
+
+namespace gazebo {
+
+
+	/// @brief the fields of TelemetryRecord that are aggregated by the windows
+	static double TelemetryRecord::* const WINDOW_FIELDS[] = {
+		&TelemetryRecord::desired,
+		&TelemetryRecord::angle,
+		&TelemetryRecord::angle_error,
+		&TelemetryRecord::velocity,
+		&TelemetryRecord::desired_velocity,
+		&TelemetryRecord::velocity_error,
+		&TelemetryRecord::force,
+		&TelemetryRecord::delta_force,
+		&TelemetryRecord::p_gain,
+		&TelemetryRecord::i_gain,
+		&TelemetryRecord::d_gain,
+		&TelemetryRecord::p_error,
+		&TelemetryRecord::i_error,
+		&TelemetryRecord::d_error
+	};
+
+
+	void TelemetryPublisher::Window::clear() {
+		count = 0;
+		stamp = 0.0;
+		for( int n=0; n<N_FIELDS; n++ ) {
+			sum[n] = 0.0;
+			sum_sq[n] = 0.0;
+			peak[n] = 0.0;
+		}
+	}
+
+
+	void TelemetryPublisher::Window::add( const TelemetryRecord &r ) {
+		for( int n=0; n<N_FIELDS; n++ ) {
+			double value = r.*WINDOW_FIELDS[n];
+			sum[n] += value;
+			sum_sq[n] += value * value;
+			if( count == 0  ||  fabs( value ) > fabs( peak[n] ) )
+				peak[n] = value;
+		}
+		stamp = r.stamp;
+		count++;
+	}
+
+
+	void TelemetryPublisher::Window::result( int mode, TelemetryRecord &r ) const {
+		r.stamp = stamp;
+		for( int n=0; n<N_FIELDS; n++ ) {
+			double value;
+			if( mode == MODE_MAX ) {
+				value = peak[n];
+			} else if( mode == MODE_RMS ) {
+				value = sqrt( sum_sq[n] / count );
+			} else {
+				value = sum[n] / count;
+			}
+			r.*WINDOW_FIELDS[n] = value;
+		}
+	}
+
+
+	TelemetryPublisher::TelemetryPublisher() : model_count_(0), wanted_model_(false), running_(false), dropped_(0) {
+		for( int kind=0; kind<N_KINDS; kind++ ) {
+			period_[kind] = 1;
+			mode_[kind] = MODE_SAMPLE;
+		}
+	}
+
+
+	void TelemetryPublisher::addJoint( const std::string &name, const ros::Publisher &state_pub, const ros::Publisher &error_pub ) {
+		names_.push_back( name );
+		state_pub_.push_back( state_pub );
+		error_pub_.push_back( error_pub );
+	}
+
+
+	void TelemetryPublisher::start( ros::NodeHandle &nh, size_t capacity, bool model_topic ) {
+		if( running_ )
+			return;
+
+		int size = state_pub_.size();
+		wanted_.reset( new std::atomic<int>[size] );
+		for( int i=0; i<size; i++ )
+			wanted_[i] = 0;
+		for( int kind=0; kind<N_KINDS; kind++ ) {
+			windows_[kind].resize( size );
+			for( int i=0; i<size; i++ )
+				windows_[kind][i].clear();
+		}
+		ring_.reset( new SpscRing< TelemetryRecord >( capacity ) );
+		dropped_pub_ = nh.advertise< std_msgs::UInt64 >( "telemetry_dropped", 1, true );
+
+		// a few summaries of all joints (a request and a reset may come in the same tick)
+		episode_ring_.reset( new SpscRing< EpisodeRecord >( 4 * (size + 1) ) );
+		episode_pub_ = nh.advertise< gazebo_crab_plugin::episode_summary >( "episode_summary", 10 );
+		reset_latency_pub_ = nh.advertise< std_msgs::Float64 >( "reset_latency", 1, true );
+
+		if( model_topic ) {
+			model_msg_.name = names_;
+			model_msg_.desired.resize( size );
+			model_msg_.angle.resize( size );
+			model_msg_.angle_error.resize( size );
+			model_msg_.velocity.resize( size );
+			model_msg_.velocity_error.resize( size );
+			model_msg_.force.resize( size );
+			model_msg_.force_delta.resize( size );
+			clearModel();
+			model_pub_ = nh.advertise< gazebo_crab_plugin::model_joint_state >( "pid_joint_states", 10 );
+		}
+
+		running_ = true;
+		thread_ = std::thread( &TelemetryPublisher::run, this );
+	}
+
+
+	void TelemetryPublisher::stop() {
+		if( !running_ )
+			return;
+
+		running_ = false;
+		if( thread_.joinable() )
+			thread_.join();
+	}
+
+
+	void TelemetryPublisher::setRate( int kind, int period, int mode ) {
+		if( kind < 0  ||  kind >= N_KINDS )
+			return;
+		if( mode < MODE_SAMPLE  ||  mode > MODE_RMS ) {
+			ROS_WARN( "unknown telemetry mode %i, using 'sample'", mode );
+			mode = MODE_SAMPLE;
+		}
+		period_[kind].store( period > 1 ? period : 1, std::memory_order_relaxed );
+		mode_[kind].store( mode, std::memory_order_relaxed );
+	}
+
+
+	int TelemetryPublisher::parseMode( const std::string &name ) {
+		if( name == "sample" )
+			return MODE_SAMPLE;
+		if( name == "mean" )
+			return MODE_MEAN;
+		if( name == "max" )
+			return MODE_MAX;
+		if( name == "rms" )
+			return MODE_RMS;
+		return -1;
+	}
+
+
+	int TelemetryPublisher::due( uint64_t tick ) const {
+		static const int topic[N_KINDS] = { TOPIC_STATE, TOPIC_ERROR, TOPIC_MODEL };
+		int topics = 0;
+		for( int kind=0; kind<N_KINDS; kind++ ) {
+			// the aggregating modes need every tick
+			if( mode( kind ) != MODE_SAMPLE  ||  tick % period( kind ) == 0 )
+				topics |= topic[kind];
+		}
+		return topics;
+	}
+
+
+	void TelemetryPublisher::run() {
+		const std::chrono::milliseconds idle_sleep( 1 );		// sleep time if the ring is empty
+		const int wanted_interval = 100;						// poll the subscriber counts every 100 loops (~100ms when idle)
+		int idle_count = wanted_interval;
+		uint64_t dropped_published = (uint64_t)-1;
+		TelemetryRecord record;
+		EpisodeRecord episode;
+
+		while( running_ ) {
+			// publish everything that is in the rings
+			bool empty = true;
+			while( ring_->pop( record ) ) {
+				publish( record );
+				empty = false;
+			}
+			while( episode_ring_->pop( episode ) ) {
+				collectEpisode( episode );
+				empty = false;
+			}
+
+			if( ++idle_count >= wanted_interval ) {
+				idle_count = 0;
+				updateWanted();
+
+				uint64_t dropped = dropped_.load( std::memory_order_relaxed );
+				if( dropped != dropped_published ) {
+					if( dropped_published != (uint64_t)-1 )
+						ROS_WARN( "telemetry ring full, %llu records dropped so far", (unsigned long long)dropped );
+					std_msgs::UInt64 msg;
+					msg.data = dropped;
+					dropped_pub_.publish( msg );
+					dropped_published = dropped;
+				}
+			}
+
+			if( empty )
+				std::this_thread::sleep_for( idle_sleep );
+		}
+	}
+
+
+	void TelemetryPublisher::publish( const TelemetryRecord &r ) {
+		if( r.topics & TOPIC_MODEL )
+			collectModel( r );
+
+		if( r.topics & TOPIC_STATE ) {
+			int mode = this->mode( KIND_STATE );
+			if( mode == MODE_SAMPLE ) {
+				publishState( r );
+			} else {
+				Window &w = windows_[KIND_STATE][r.joint];
+				w.add( r );
+				if( w.count >= period( KIND_STATE ) ) {
+					TelemetryRecord result = r;
+					w.result( mode, result );
+					publishState( result );
+					w.clear();
+				}
+			}
+		}
+
+		if( r.topics & TOPIC_ERROR ) {
+			int mode = this->mode( KIND_ERROR );
+			if( mode == MODE_SAMPLE ) {
+				publishError( r );
+			} else {
+				Window &w = windows_[KIND_ERROR][r.joint];
+				w.add( r );
+				if( w.count >= period( KIND_ERROR ) ) {
+					TelemetryRecord result = r;
+					w.result( mode, result );
+					publishError( result );
+					w.clear();
+				}
+			}
+		}
+	}
+
+
+	void TelemetryPublisher::publishState( const TelemetryRecord &r ) {
+		gazebo_crab_plugin::pid_joint_state msg;
+		msg.header.stamp = ros::Time( r.stamp );
+		msg.desired = r.desired;
+		msg.value = r.angle;
+		msg.force = r.force;
+		msg.d_force = r.delta_force;
+		msg.pid_p = r.p_gain;
+		msg.pid_i = r.i_gain;
+		msg.pid_d = r.d_gain;
+		msg.pid_pe = r.p_error;
+		msg.pid_ie = r.i_error;
+		msg.pid_de = r.d_error;
+		state_pub_[r.joint].publish( msg );
+	}
+
+
+	void TelemetryPublisher::publishError( const TelemetryRecord &r ) {
+		gazebo_crab_plugin::pid_joint_error err_msg;
+		err_msg.header.stamp = ros::Time( r.stamp );
+		err_msg.angle = r.angle;
+		err_msg.angle_error = r.angle_error;
+		err_msg.velocity = r.velocity;
+		err_msg.velocity_error = r.velocity_error;
+		err_msg.force = r.force;
+		err_msg.force_delta = r.delta_force;
+		error_pub_[r.joint].publish( err_msg );
+	}
+
+
+	void TelemetryPublisher::collectEpisode( const EpisodeRecord &r ) {
+		// records of a summary whose end record was dropped are discarded
+		if( episode_msg_.episode != r.episode )
+			clearEpisode();
+		episode_msg_.episode = r.episode;
+
+		if( r.joint >= 0 ) {
+			episode_msg_.name.push_back( names_[r.joint] );
+			episode_msg_.duration.push_back( r.duration );
+			episode_msg_.count.push_back( r.count );
+			episode_msg_.velocity_sq_sum.push_back( r.velocity_sq_sum );
+			episode_msg_.angle_sq_sum.push_back( r.angle_sq_sum );
+			episode_msg_.velocity_max.push_back( r.velocity_max );
+			episode_msg_.angle_max.push_back( r.angle_max );
+			episode_msg_.failed.push_back( r.failed );
+			// the failure is reported once, with the summary of the reset that ends the episode (reason 0 or 2)
+			if( r.failed  &&  r.reason != 1 )
+				ROS_WARN( "watchdog: joint '%s' failed (reasons %i), reset", names_[r.joint].c_str(), r.failed );
+		}
+
+		if( !(r.flags & EPISODE_END) )
+			return;
+
+		episode_msg_.header.stamp = ros::Time( r.stamp );
+		episode_msg_.reason = r.reason;
+		episode_msg_.warmup = r.warmup;
+		episode_pub_.publish( episode_msg_ );
+		clearEpisode();
+
+		if( r.flags & EPISODE_RESET ) {
+			ROS_INFO( "reset %s%i joint(s) in %.3f ms, %.3f ms after the request", (r.flags & EPISODE_RESET_MODEL) ?
+				"model and " : "", r.reset_joints, r.reset_time * 1e3, r.reset_latency * 1e3 );
+			std_msgs::Float64 msg;
+			msg.data = r.reset_latency;
+			reset_latency_pub_.publish( msg );
+		}
+	}
+
+
+	void TelemetryPublisher::clearEpisode() {
+		episode_msg_.name.clear();
+		episode_msg_.duration.clear();
+		episode_msg_.count.clear();
+		episode_msg_.velocity_sq_sum.clear();
+		episode_msg_.angle_sq_sum.clear();
+		episode_msg_.velocity_max.clear();
+		episode_msg_.angle_max.clear();
+		episode_msg_.failed.clear();
+	}
+
+
+	void TelemetryPublisher::collectModel( const TelemetryRecord &r ) {
+		int mode = this->mode( KIND_MODEL );
+		if( mode == MODE_SAMPLE )
+			setModelEntry( r.joint, r );
+		else
+			windows_[KIND_MODEL][r.joint].add( r );
+
+		if( !(r.topics & TOPIC_MODEL_END) )
+			return;
+
+		if( mode != MODE_SAMPLE ) {
+			// end of a tick, publish only if the window is complete
+			if( ++model_count_ < period( KIND_MODEL ) )
+				return;
+			model_count_ = 0;
+
+			std::vector< Window > &windows = windows_[KIND_MODEL];
+			for( int i=0; i<(int)windows.size(); i++ ) {
+				if( windows[i].count > 0 ) {
+					TelemetryRecord result = r;
+					windows[i].result( mode, result );
+					setModelEntry( i, result );
+				}
+				windows[i].clear();
+			}
+		}
+
+		model_msg_.header.stamp = ros::Time( r.stamp );
+		model_pub_.publish( model_msg_ );
+
+		// mark all entries as missing for the next tick
+		clearModel();
+	}
+
+
+	void TelemetryPublisher::setModelEntry( int i, const TelemetryRecord &r ) {
+		model_msg_.desired[i] = r.desired;
+		model_msg_.angle[i] = r.angle;
+		model_msg_.angle_error[i] = r.angle_error;
+		model_msg_.velocity[i] = r.velocity;
+		model_msg_.velocity_error[i] = r.velocity_error;
+		model_msg_.force[i] = r.force;
+		model_msg_.force_delta[i] = r.delta_force;
+	}
+
+
+	void TelemetryPublisher::clearModel() {
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		int size = model_msg_.angle.size();
+		for( int n=0; n<size; n++ ) {
+			model_msg_.desired[n] = nan;
+			model_msg_.angle[n] = nan;
+			model_msg_.angle_error[n] = nan;
+			model_msg_.velocity[n] = nan;
+			model_msg_.velocity_error[n] = nan;
+			model_msg_.force[n] = nan;
+			model_msg_.force_delta[n] = nan;
+		}
+	}
+
+
+	void TelemetryPublisher::updateWanted() {
+		int size = state_pub_.size();
+		for( int i=0; i<size; i++ ) {
+			int topics = 0;
+			if( state_pub_[i].getNumSubscribers() > 0 )
+				topics |= TOPIC_STATE;
+			if( error_pub_[i].getNumSubscribers() > 0 )
+				topics |= TOPIC_ERROR;
+			wanted_[i].store( topics, std::memory_order_relaxed );
+		}
+		wanted_model_.store( model_pub_.getNumSubscribers() > 0, std::memory_order_relaxed );
+	}
+
+
+}	// end of namespace 'gazebo'
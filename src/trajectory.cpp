@@ -0,0 +1,182 @@
+#include "../include/gazebo_crab_plugin/trajectory.hpp"
+
+
+
+
+namespace gazebo {
+
+
+	void JointTrajectories::configure( int joints, int capacity ) {
+		joints_ = joints;
+		capacity_ = capacity;
+
+		for( int n=0; n<3; n++ ) {
+			Block &b = blocks_[n];
+			b.start.assign( joints, 0.0 );
+			b.interpolation.assign( joints, LINEAR );
+			b.count.assign( joints, -1 );
+			b.has_velocity.assign( joints, 0 );
+			b.time.assign( joints * capacity, 0.0 );
+			b.position.assign( joints * capacity, 0.0 );
+			b.velocity.assign( joints * capacity, 0.0 );
+		}
+
+		int size = joints * (capacity + 1);
+		time_.assign( size, 0.0 );
+		position_.assign( size, 0.0 );
+		velocity_.assign( size, 0.0 );
+		size_.assign( joints, 0 );
+		segment_.assign( joints, 0 );
+		interpolation_.assign( joints, LINEAR );
+		active_count_ = 0;
+	}
+
+
+	JointTrajectories::Block& JointTrajectories::writeBlock() {
+		// take the published block back if the physics thread did not get it yet, the new message is merged into it. the
+		// block that goes into the exchange slot instead is not fresh, update() does not take it
+		int middle = middle_.exchange( back_, std::memory_order_acq_rel );
+		back_ = middle & ~FRESH;
+		Block &b = blocks_[back_];
+		if( middle & FRESH )
+			return b;
+
+		for( int j=0; j<joints_; j++ ) {
+			b.count[j] = -1;
+			b.has_velocity[j] = 0;
+		}
+		return b;
+	}
+
+
+	void JointTrajectories::publish() {
+		back_ = middle_.exchange( back_ | FRESH, std::memory_order_acq_rel ) & ~FRESH;
+	}
+
+
+	void JointTrajectories::update( double now, double *desired ) {
+		// pick up a new block (cheap check first)
+		if( middle_.load( std::memory_order_relaxed ) & FRESH ) {
+			// the writer may have taken the block back in the meantime, then the slot holds a block that is not fresh
+			int middle = middle_.exchange( front_, std::memory_order_acq_rel );
+			front_ = middle & ~FRESH;
+			if( middle & FRESH )
+				take( blocks_[front_], now, desired );
+		}
+
+		if( !active_count_ )
+			return;
+
+		for( int j=0; j<joints_; j++ ) {
+			if( !size_[j] )
+				continue;
+
+			double angle;
+			bool more = sample( j, now, angle );
+			desired[j] = angle;
+			if( !more ) {
+				// the last waypoint is reached, hold its angle
+				size_[j] = 0;
+				active_count_--;
+			}
+		}
+	}
+
+
+	void JointTrajectories::take( const Block &block, double now, const double *desired ) {
+		for( int j=0; j<joints_; j++ ) {
+			int count = block.count[j];
+			if( count < 0 )
+				continue;
+
+			double start = block.start[j] > 0.0 ? block.start[j] : now;
+			if( size_[j] )
+				active_count_--;
+			size_[j] = 0;
+			segment_[j] = 0;
+			interpolation_[j] = block.interpolation[j];
+			if( count == 0 )
+				continue;
+
+			const double *time = &block.time[j*capacity_];
+			const double *position = &block.position[j*capacity_];
+			const double *velocity = &block.velocity[j*capacity_];
+			double *dst_time = &time_[j*(capacity_+1)];
+			double *dst_position = &position_[j*(capacity_+1)];
+			double *dst_velocity = &velocity_[j*(capacity_+1)];
+
+			// start from the current setpoint if the trajectory starts in the future
+			int n = 0;
+			if( start + time[0] > now ) {
+				dst_time[0] = now;
+				dst_position[0] = desired[j];
+				dst_velocity[0] = 0.0;
+				n = 1;
+			}
+			for( int k=0; k<count; k++, n++ ) {
+				dst_time[n] = start + time[k];
+				dst_position[n] = position[k];
+				dst_velocity[n] = block.has_velocity[j] ? velocity[k] : 0.0;
+			}
+
+			size_[j] = n;
+			active_count_++;
+			if( interpolation_[j] == CUBIC  &&  !block.has_velocity[j] )
+				estimateVelocities( j );
+		}
+	}
+
+
+	void JointTrajectories::estimateVelocities( int j ) {
+		const double *time = &time_[j*(capacity_+1)];
+		const double *position = &position_[j*(capacity_+1)];
+		double *velocity = &velocity_[j*(capacity_+1)];
+		int n = size_[j];
+
+		// zero velocity at the first and the last waypoint, slope of the neighbours in between
+		velocity[0] = 0.0;
+		velocity[n-1] = 0.0;
+		for( int k=1; k<n-1; k++ )
+			velocity[k] = (position[k+1] - position[k-1]) / (time[k+1] - time[k-1]);
+	}
+
+
+	bool JointTrajectories::sample( int j, double t, double &angle ) {
+		const double *time = &time_[j*(capacity_+1)];
+		const double *position = &position_[j*(capacity_+1)];
+		const double *velocity = &velocity_[j*(capacity_+1)];
+		int n = size_[j];
+
+		// the time only moves forward, so the segment is found by moving the cursor
+		int k = segment_[j];
+		while( k+1 < n  &&  time[k+1] <= t )
+			k++;
+		segment_[j] = k;
+
+		if( k+1 >= n ) {
+			angle = position[n-1];
+			return false;
+		}
+		if( t <= time[k] ) {
+			angle = position[k];
+			return true;
+		}
+
+		double h = time[k+1] - time[k];
+		double s = (t - time[k]) / h;
+		if( interpolation_[j] == CUBIC ) {
+			// cubic hermite spline
+			double s2 = s * s;
+			double s3 = s2 * s;
+			angle = (2*s3 - 3*s2 + 1) * position[k]
+				+ (s3 - 2*s2 + s) * h * velocity[k]
+				+ (-2*s3 + 3*s2) * position[k+1]
+				+ (s3 - s2) * h * velocity[k+1];
+		} else {
+			angle = position[k] + s * (position[k+1] - position[k]);
+		}
+		return true;
+	}
+
+
+}	// end of namespace 'gazebo'
@@ -0,0 +1,167 @@
+// project headers
+#include "../include/gazebo_crab_plugin/velocity_estimator.hpp"
+
+// C++ headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+
+
+
+
+/** @brief benchmark for the velocity estimators: time per joint and tick, and the error of the estimate for joints that
+ *         follow sine waves (0.5-3 Hz, 0.5 rad), with exact angles and with angle noise.
+ *
+ * the error is the rms difference to the true velocity in rad/s (the tick difference is divided by dt for the
+ * comparison). it contains the delay of the estimator as well as the noise, so an estimator that smooths more is not
+ * always better. the joint velocity estimator gets the true velocity (an ideal physics engine).
+ *
+ * usage: velocity_bench [ticks]
+ */
+
+
+using gazebo::VelocityState;
+using gazebo::VelocityBatch;
+namespace velocity_estimator = gazebo::velocity_estimator;
+
+
+/// @brief dt of the benchmark (1 kHz, the physics rate of the simulations)
+static const double DT = 0.001;
+
+/// @brief number of angles of the fir estimator and gain of the alpha-beta tracker
+static const int TAPS = 4;
+static const double ALPHA = 0.5;
+
+
+/// @brief joints with sine trajectories, all with the same estimator
+class BenchJoints {
+	public:
+		BenchJoints( int size, int estimator, double noise, unsigned int seed ) : size_(size), noise_(noise),
+			generator_(seed), noise_dist_(0.0, 1.0), angle_(size), joint_velocity_(size), true_velocity_(size),
+			frequency_(size), phase_(size), estimator_(size, estimator), taps_(size, TAPS), alpha_(size, ALPHA),
+			state_(size), velocity_(size, 0.0) {
+			std::uniform_real_distribution<double> uni_dist( 0.0, 1.0 );
+			for( int i=0; i<size; i++ ) {
+				frequency_[i] = 2*M_PI * (0.5 + 2.5 * uni_dist( generator_ ));
+				phase_[i] = 2*M_PI * uni_dist( generator_ );
+			}
+		}
+
+		/// @brief moves the joints to time t (angles with noise, true velocities)
+		void move( double t ) {
+			for( int i=0; i<size_; i++ ) {
+				double x = frequency_[i] * t + phase_[i];
+				angle_[i] = AMPLITUDE * sin( x ) + (noise_ > 0.0 ? noise_ * noise_dist_( generator_ ) : 0.0);
+				true_velocity_[i] = AMPLITUDE * frequency_[i] * cos( x );
+				joint_velocity_[i] = true_velocity_[i];
+			}
+		}
+
+		/// @brief moves the joints a little (cheap, for the time measurement)
+		void step() {
+			for( int i=0; i<size_; i++ )
+				angle_[i] += 1e-4 * velocity_[i] + 1e-6;
+		}
+
+		void estimate() {
+			VelocityBatch b;
+			b.size = size_;
+			b.angle = angle_.data();
+			b.joint_velocity = joint_velocity_.data();
+			b.estimator = estimator_.data();
+			b.taps = taps_.data();
+			b.alpha = alpha_.data();
+			b.state = state_.data();
+			b.velocity = velocity_.data();
+			velocity_estimator::estimate( b, DT, 0, size_ );
+		}
+
+		/// @brief sum of the squared errors of the estimates (rad/s)
+		double squaredError() const {
+			double scale = estimator_[0] == velocity_estimator::TICK_DIFFERENCE ? 1.0 / DT : 1.0;
+			double sum = 0.0;
+			for( int i=0; i<size_; i++ ) {
+				double error = scale * velocity_[i] - true_velocity_[i];
+				sum += error * error;
+			}
+			return sum;
+		}
+
+		int size() const { return size_; }
+
+	private:
+		static constexpr double AMPLITUDE = 0.5;
+
+		int size_;
+		double noise_;
+		std::default_random_engine generator_;
+		std::normal_distribution<double> noise_dist_;
+
+		std::vector< double > angle_;
+		std::vector< double > joint_velocity_;
+		std::vector< double > true_velocity_;
+		std::vector< double > frequency_;
+		std::vector< double > phase_;
+		std::vector< int > estimator_;
+		std::vector< int > taps_;
+		std::vector< double > alpha_;
+		std::vector< VelocityState > state_;
+		std::vector< double > velocity_;
+};
+
+
+/// @brief runs 'ticks' estimates and returns the time per joint and tick in nanoseconds
+double timeEstimator( int estimator, int size, int ticks ) {
+	BenchJoints joints( size, estimator, 0.0, 42 );
+	joints.move( 0.0 );
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for( int t=0; t<ticks; t++ ) {
+		joints.estimate();
+		joints.step();
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	double ns = std::chrono::duration_cast< std::chrono::nanoseconds >( end - start ).count();
+	return ns / ((double)ticks * size);
+}
+
+
+/// @brief rms error (rad/s) of an estimator over 'ticks' ticks, after a warm-up of 100 ticks
+double rmsError( int estimator, double noise, int ticks ) {
+	const int WARMUP = 100;
+	BenchJoints joints( 64, estimator, noise, 7 );
+
+	double sum = 0.0;
+	for( int t=0; t<WARMUP+ticks; t++ ) {
+		joints.move( t * DT );
+		joints.estimate();
+		if( t >= WARMUP )
+			sum += joints.squaredError();
+	}
+	return sqrt( sum / ((double)ticks * joints.size()) );
+}
+
+
+int main( int argc, char** argv ) {
+	int ticks = argc > 1 ? atoi( argv[1] ) : 100000;
+	const double noise[] = { 0.0, 1e-5, 1e-4 };
+
+	std::cout << "velocity estimator benchmark, dt=" << DT << ", fir taps=" << TAPS << ", alpha=" << ALPHA
+		<< ", ticks=" << ticks << std::endl;
+	std::cout << "estimator          ns/joint/tick(256)  rms error [rad/s] at angle noise 0 / 1e-5 / 1e-4 rad" << std::endl;
+
+	for( int e=0; e<velocity_estimator::N_ESTIMATORS; e++ ) {
+		double ns = timeEstimator( e, 256, ticks );
+		printf( "%-18s %19.3f ", velocity_estimator::name( e ), ns );
+		for( int n=0; n<3; n++ )
+			printf( " %10.4f", rmsError( e, noise[n], ticks / 10 ) );
+		printf( "\n" );
+	}
+
+	return 0;
+}
@@ -0,0 +1,141 @@
+#include "../include/gazebo_crab_plugin/velocity_estimator.hpp"
+
+
+
+
+namespace gazebo {
+
+	namespace velocity_estimator {
+
+
+		/** @brief weights of the fir estimator: slope of the least-squares line through the last 'taps' angles, newest
+		 *         first. weight[taps][k] = 6 (taps - 1 - 2k) / (taps (taps^2 - 1)), taps=2 is the finite difference
+		 */
+		static struct FirWeights {
+			FirWeights() {
+				for( int taps=0; taps<=VelocityState::HISTORY; taps++ ) {
+					for( int k=0; k<VelocityState::HISTORY; k++ ) {
+						weight[taps][k] = taps >= 2  &&  k < taps ?
+							6.0 * (taps - 1 - 2*k) / (taps * (taps*taps - 1.0)) : 0.0;
+					}
+				}
+			}
+
+			double weight[VelocityState::HISTORY+1][VelocityState::HISTORY];
+		} FIR_WEIGHTS;
+
+
+		const char* name( int estimator ) {
+			static const char* names[N_ESTIMATORS] = { "tick_difference", "finite_difference", "fir", "alpha_beta",
+				"joint_velocity" };
+			return estimator >= 0  &&  estimator < N_ESTIMATORS ? names[estimator] : "unknown";
+		}
+
+
+		/// @brief the velocity of one joint from its history (newest angle at 'index'), for the estimator E
+		template< int E >
+		static inline double velocity( const VelocityBatch &b, int i, VelocityState &s, int index, int last, double dt,
+				double inv_dt ) {
+			const int MASK = VelocityState::HISTORY - 1;
+			double angle = s.history[index];
+
+			switch( E ) {
+				case FINITE_DIFFERENCE:
+					return (angle - s.history[last]) * inv_dt;
+
+				case FIR: {
+					int taps = b.taps[i] < 2 ? 2 : (b.taps[i] > VelocityState::HISTORY ? VelocityState::HISTORY : b.taps[i]);
+					const double *weight = FIR_WEIGHTS.weight[taps];
+					double slope = 0.0;
+					for( int k=0; k<taps; k++ )
+						slope += weight[k] * s.history[(index - k) & MASK];
+					return slope * inv_dt;
+				}
+
+				case ALPHA_BETA: {
+					double alpha = b.alpha[i] < 0.0 ? 0.0 : (b.alpha[i] > 1.0 ? 1.0 : b.alpha[i]);
+					double beta = alpha * alpha / (2.0 - alpha);
+					double predicted = s.angle + s.velocity * dt;
+					double residual = angle - predicted;
+					s.angle = predicted + alpha * residual;
+					s.velocity += beta * residual * inv_dt;
+					return s.velocity;
+				}
+
+				case JOINT_VELOCITY:
+					return b.joint_velocity ? b.joint_velocity[i] : (angle - s.history[last]) * inv_dt;
+
+				default:
+					// TICK_DIFFERENCE
+					return angle - s.history[last];
+			}
+		}
+
+
+		/// @brief estimator E for the joints [begin, end)
+		template< int E >
+		static void estimateRange( const VelocityBatch &b, double dt, int begin, int end ) {
+			// the estimators in rad/s keep the last velocity for an invalid dt
+			const bool dt_valid = E == TICK_DIFFERENCE  ||  dt > 0.0;
+			const double inv_dt = dt > 0.0 ? 1.0 / dt : 0.0;
+
+			for( int i=begin; i<end; i++ ) {
+				VelocityState &s = b.state[i];
+				double angle = b.angle[i];
+
+				// non-finite angles do not enter the history (the watchdog resets the joint)
+				if( !(angle - angle == 0.0) ) {
+					b.velocity[i] = angle - angle;
+					continue;
+				}
+
+				// first angle after adding or resetting the joint: at rest
+				if( !s.primed ) {
+					for( int n=0; n<VelocityState::HISTORY; n++ )
+						s.history[n] = angle;
+					s.angle = angle;
+					s.velocity = 0.0;
+					s.primed = 1;
+					b.velocity[i] = 0.0;
+					continue;
+				}
+
+				int last = s.index;
+				int index = (last + 1) & (VelocityState::HISTORY - 1);
+				s.history[index] = angle;
+				s.index = index;
+				if( dt_valid )
+					b.velocity[i] = velocity<E>( b, i, s, index, last, dt, inv_dt );
+			}
+		}
+
+
+		void estimate( const VelocityBatch &b, double dt, int begin, int end ) {
+			// runs of joints with the same estimator (usually all joints of a model), so that the inner loop has no switch
+			int i = begin;
+			while( i < end ) {
+				int estimator = b.estimator[i];
+				int run_end = i + 1;
+				while( run_end < end  &&  b.estimator[run_end] == estimator )
+					run_end++;
+
+				switch( estimator ) {
+					case FINITE_DIFFERENCE:	estimateRange< FINITE_DIFFERENCE >( b, dt, i, run_end ); break;
+					case FIR:				estimateRange< FIR >( b, dt, i, run_end ); break;
+					case ALPHA_BETA:		estimateRange< ALPHA_BETA >( b, dt, i, run_end ); break;
+					case JOINT_VELOCITY:	estimateRange< JOINT_VELOCITY >( b, dt, i, run_end ); break;
+					default:				estimateRange< TICK_DIFFERENCE >( b, dt, i, run_end ); break;	// also unknown ones
+				}
+				i = run_end;
+			}
+		}
+
+
+		void reset( VelocityState &state ) {
+			state = VelocityState();
+		}
+
+
+	} // end of namespace 'velocity_estimator'
+
+}	// end of namespace 'gazebo'
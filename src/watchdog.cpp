@@ -0,0 +1,95 @@
+#include "../include/gazebo_crab_plugin/watchdog.hpp"
+
+// C++ headers
+#include <math.h>
+
+
+
+
+namespace gazebo {
+
+
+	void DivergenceWatchdog::configure( int joints, const WatchdogConfig &config ) {
+		joints_ = joints;
+		config_ = config;
+		failed_.assign( joints, 0 );
+		checked_from_.assign( joints, config.grace );
+		last_angle_.assign( joints, NAN );
+		saturated_since_.assign( joints, -1.0 );
+		window_start_.assign( joints, 0.0 );
+		window_max_.assign( joints, 0.0 );
+		last_window_max_.assign( joints, 0.0 );
+		growing_.assign( joints, 0 );
+	}
+
+
+	void DivergenceWatchdog::start( int j, double now ) {
+		failed_[j] = 0;
+		checked_from_[j] = now + config_.grace;
+		last_angle_[j] = NAN;
+		saturated_since_[j] = -1.0;
+		window_start_[j] = now + config_.grace;
+		window_max_[j] = 0.0;
+		last_window_max_[j] = 0.0;
+		growing_[j] = 0;
+	}
+
+
+	int DivergenceWatchdog::check( double now, double dt, const double *desired, const double *angle, const double *force,
+			const double *max_force ) {
+		int failed = 0;
+
+		for( int j=0; j<joints_; j++ ) {
+			if( failed_[j] )
+				continue;
+
+			double velocity = dt > 0.0 ? (angle[j] - last_angle_[j]) / dt : 0.0;	// nan at the first check
+			bool first = isnan( last_angle_[j] );
+			last_angle_[j] = angle[j];
+
+			// not finite values fail the episode at once, even in the grace time
+			int reasons = 0;
+			if( !isfinite( angle[j] )  ||  !isfinite( force[j] )  ||  (!first && !isfinite( velocity )) )
+				reasons |= FAIL_NAN;
+
+			if( !reasons  &&  now >= checked_from_[j] ) {
+				if( config_.max_velocity > 0.0  &&  !first  &&  fabs( velocity ) > config_.max_velocity )
+					reasons |= FAIL_VELOCITY;
+
+				// sustained saturation
+				if( config_.saturation_time > 0.0 ) {
+					if( fabs( force[j] ) < max_force[j] * 0.999 )
+						saturated_since_[j] = -1.0;
+					else if( saturated_since_[j] < 0.0 )
+						saturated_since_[j] = now;
+					else if( now - saturated_since_[j] >= config_.saturation_time )
+						reasons |= FAIL_SATURATION;
+				}
+
+				// error growth: the maximum error of consecutive windows
+				if( config_.growth_window > 0.0 ) {
+					window_max_[j] = fmax( window_max_[j], fabs( desired[j] - angle[j] ) );
+					if( now - window_start_[j] >= config_.growth_window ) {
+						bool growing = window_max_[j] > config_.growth_min_error  &&
+							window_max_[j] > config_.growth_factor * last_window_max_[j];
+						growing_[j] = growing ? growing_[j] + 1 : 0;
+						if( growing_[j] >= config_.growth_windows )
+							reasons |= FAIL_GROWTH;
+						last_window_max_[j] = window_max_[j];
+						window_max_[j] = 0.0;
+						window_start_[j] = now;
+					}
+				}
+			}
+
+			if( reasons ) {
+				failed_[j] = reasons;
+				failed++;
+			}
+		}
+
+		return failed;
+	}
+
+
+}	// end of namespace 'gazebo'
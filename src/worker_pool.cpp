@@ -0,0 +1,100 @@
+#include "../include/gazebo_crab_plugin/worker_pool.hpp"
+
+// C++ headers
+#include <chrono>
+
+
+
+
+namespace gazebo {
+	
+	
+	WorkerPool::WorkerPool() : spin_(0), task_(NULL), context_(NULL), tasks_(0), generation_(0), next_(0), finished_(0),
+		stop_(false) {
+	}
+	
+	
+	void WorkerPool::start( int threads, int spin ) {
+		stop();
+		stop_ = false;
+		spin_ = spin;
+		uint64_t generation = generation_.load( std::memory_order_relaxed );
+		for( int n=0; n<threads; n++ )
+			threads_.push_back( std::thread( &WorkerPool::worker, this, generation ) );
+	}
+	
+	
+	void WorkerPool::stop() {
+		if( threads_.empty() )
+			return;
+		
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			stop_ = true;
+		}
+		wake_.notify_all();
+		for( int n=0; n<threads_.size(); n++ )
+			threads_[n].join();
+		threads_.clear();
+	}
+	
+	
+	void WorkerPool::run( int tasks, Task task, void *context ) {
+		if( threads_.empty() ) {
+			for( int i=0; i<tasks; i++ )
+				task( context, i );
+			return;
+		}
+		
+		// publish the batch. the workers read it after they see the new generation
+		task_ = task;
+		context_ = context;
+		tasks_ = tasks;
+		next_.store( 0, std::memory_order_relaxed );
+		finished_.store( 0, std::memory_order_relaxed );
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			generation_.fetch_add( 1, std::memory_order_release );
+		}
+		wake_.notify_all();
+		
+		work();
+		
+		// barrier: wait for all workers, including the ones that did not get a task
+		int workers = threads_.size();
+		while( finished_.load( std::memory_order_acquire ) < workers )
+			std::this_thread::yield();
+	}
+	
+	
+	void WorkerPool::worker( uint64_t seen ) {
+		while( true ) {
+			// spin for a while, then block until the next batch
+			if( generation_.load( std::memory_order_acquire ) == seen ) {
+				std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + std::chrono::microseconds( spin_ );
+				while( generation_.load( std::memory_order_acquire ) == seen  &&  !stop_.load( std::memory_order_relaxed )
+						&& std::chrono::steady_clock::now() < until )
+					std::this_thread::yield();
+			}
+			if( generation_.load( std::memory_order_acquire ) == seen ) {
+				std::unique_lock<std::mutex> lock( mutex_ );
+				wake_.wait( lock, [&]{ return generation_.load( std::memory_order_acquire ) != seen || stop_; } );
+			}
+			if( stop_ )
+				return;
+			
+			seen = generation_.load( std::memory_order_acquire );
+			work();
+			finished_.fetch_add( 1, std::memory_order_release );
+		}
+	}
+	
+	
+	void WorkerPool::work() {
+		int i;
+		while( (i = next_.fetch_add( 1, std::memory_order_relaxed )) < tasks_ )
+			task_( context_, i );
+	}
+	
+	
+}	// end of namespace 'gazebo'
@@ -0,0 +1,117 @@
+// project headers
+#include "../src/bench_model.hpp"
+
+// C++ headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+
+
+
+/** @brief allocation check of the physics thread: runs the tick of ModelPIDJoint (see BenchTick) for several joint counts
+ *         and rate dividers, counts the heap allocations (operator new/delete) inside the ticks and fails (exit code 1)
+ *         if a tick after the first one allocates or frees memory. so a change that puts the allocator on the physics
+ *         thread fails the tests. the ros callbacks of the model run between the ticks and are not counted.
+ *
+ * usage: tick_alloc_test [ticks]
+ */
+
+
+using namespace gazebo;
+
+
+/// @brief number of operator new/delete calls while counting is set
+static std::atomic< uint64_t > allocations( 0 );
+
+/// @brief set while the thread executes code that must not allocate
+static thread_local bool counting = false;
+
+
+// all replaced allocation functions take the memory from malloc and give it back with free
+
+void* operator new( size_t size ) {
+	if( counting )
+		allocations.fetch_add( 1, std::memory_order_relaxed );
+	void *p = malloc( size ? size : 1 );
+	if( !p )
+		throw std::bad_alloc();
+	return p;
+}
+
+
+void* operator new[]( size_t size ) {
+	return operator new( size );
+}
+
+
+void operator delete( void *p ) noexcept {
+	if( p  &&  counting )
+		allocations.fetch_add( 1, std::memory_order_relaxed );
+	free( p );
+}
+
+
+void operator delete[]( void *p ) noexcept {
+	operator delete( p );
+}
+
+
+void operator delete( void *p, size_t ) noexcept {
+	operator delete( p );
+}
+
+
+void operator delete[]( void *p, size_t ) noexcept {
+	operator delete( p );
+}
+
+
+/// @brief counts the allocations of the current thread while it exists
+struct Counting {
+	Counting() { counting = true; }
+	~Counting() { counting = false; }
+};
+
+
+/// @brief runs 'ticks' ticks of a model and returns the number of allocations after the first tick
+static uint64_t countAllocations( int joints, int divider, int ticks ) {
+	BenchTick bench( joints, divider );
+	uint64_t allocated = 0;
+	for( int tick=0; tick<ticks; tick++ ) {
+		bench.callbacks();
+		uint64_t before = allocations.load( std::memory_order_relaxed );
+		{
+			Counting counting;
+			bench.tick();
+		}
+		if( tick > 0 )
+			allocated += allocations.load( std::memory_order_relaxed ) - before;
+	}
+	return allocated;
+}
+
+
+int main( int argc, char **argv ) {
+	// long enough for several parameter, excitation and gain schedule changes (see BenchTick::callbacks())
+	int ticks = 5000;
+	if( argc > 1 )
+		ticks = atoi( argv[1] );
+
+	static const int joints[] = { 24, 256 };
+	static const int dividers[] = { 1, 4 };
+	int failed = 0;
+	for( int n=0; n<2; n++ ) {
+		for( int d=0; d<2; d++ ) {
+			uint64_t allocated = countAllocations( joints[n], dividers[d], ticks );
+			printf( "%4i joints, divider %i: %llu allocations in %i ticks %s\n", joints[n], dividers[d],
+				(unsigned long long)allocated, ticks, allocated ? "FAILED" : "ok" );
+			failed += allocated > 0;
+		}
+	}
+
+	if( failed )
+		printf( "the physics thread allocated memory after the first tick\n" );
+	return failed ? 1 : 0;
+}